@@ -0,0 +1,84 @@
+#ifndef _BENCH_H_
+# define _BENCH_H_
+
+/** \file bench.h
+ * Microbenchmark harness.
+ * Every measurement is reported as a CSV line to stdout:
+ * suite,subject,operation,size,ops,total_ns,ns_per_op
+ */
+
+# include <stddef.h>
+# include <stdint.h>
+# include <stdbool.h>
+# include <time.h>
+
+/** Minimal operation count per measurement, small sizes are repeated */
+# define BENCH_MIN_OPS              (1000000)
+/** Upper bound of work for operations with linear cost (e.g. list lookup) */
+# define BENCH_MAX_LINEAR_WORK      (100000000)
+
+typedef struct bench_config {
+    size_t min_size;
+    size_t max_size;
+    /** run suites which name contains this substring, NULL for all */
+    const char *filter;
+} bench_config_t;
+
+typedef void (*bench_suite_t)(const bench_config_t *cfg);
+
+/** prevents the compiler from eliminating benchmarked computations */
+extern volatile uint64_t bench_sink;
+
+static inline
+uint64_t bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** xorshift64* generator */
+static inline
+uint64_t bench_rand(uint64_t *state) {
+    uint64_t x = *state;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+
+    return x * 0x2545f4914f6cdd1dull;
+}
+
+/**
+ * Number of repetitions to make at least \c BENCH_MIN_OPS operations
+ * \param [in] size operations per repetition
+ */
+static inline
+size_t bench_rounds(size_t size) {
+    return size >= BENCH_MIN_OPS ? 1 : (BENCH_MIN_OPS + size - 1) / size;
+}
+
+void bench_report(const char *suite, const char *subject,
+                  const char *operation, size_t size,
+                  uint64_t ops, uint64_t ns);
+
+/**
+ * Allocate array of \c size distinct keys in random order.
+ * \return array to be freed with \c free
+ */
+int64_t *bench_keys(size_t size, uint64_t seed);
+
+/**
+ * Allocate random permutation of <tt>[0, size)</tt>.
+ */
+size_t *bench_permutation(size_t size, uint64_t seed);
+
+void bench_containers(const bench_config_t *cfg);
+void bench_hashing(const bench_config_t *cfg);
+void bench_io_service(const bench_config_t *cfg);
+void bench_timer(const bench_config_t *cfg);
+void bench_queues(const bench_config_t *cfg);
+
+#endif /* _BENCH_H_ */
@@ -0,0 +1,541 @@
+#include "bench.h"
+#include "containers.h"
+#include "containers-typed.h"
+#include "chain-buffer.h"
+#include "avl-tree.h"
+#include "hash-map.h"
+#include "hash-functions.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#define SUITE                   "containers"
+#define CHAIN_CHUNK_SIZE        (64)
+
+VECTOR_TYPED_DECLARE(i64_vector, int64_t)
+LIST_TYPED_DECLARE(i64_list, int64_t)
+AVL_TREE_TYPED_DECLARE(i64_tree, int64_t, int64_t, CONTAINERS_TYPED_LESS)
+
+static const char *POLICY_NAMES[buffer_policy_max] = {
+    [bp_shrinkable]     = "buffer-shrinkable",
+    [bp_non_shrinkable] = "buffer-non-shrinkable",
+    [bp_economic]       = "buffer-economic"
+};
+
+/* lookups per round for containers with linear search cost */
+static inline
+size_t linear_lookups(size_t size, size_t rounds) {
+    size_t n = BENCH_MAX_LINEAR_WORK / size / size / rounds;
+
+    return n ? (n < size ? n : size) : 1;
+}
+
+static
+void bench_buffer(size_t size, enum buffer_policy pol) {
+    size_t rounds = bench_rounds(size), r, idx;
+    uint64_t grow = 0, shrink = 0, t;
+    buffer_t b;
+
+    for (r = 0; r < rounds; ++r) {
+        buffer_init(&b, 0, pol);
+
+        t = bench_now();
+        for (idx = 1; idx <= size; ++idx)
+            buffer_realloc(&b, idx);
+        grow += bench_now() - t;
+
+        t = bench_now();
+        for (idx = size; idx; --idx)
+            buffer_realloc(&b, idx - 1);
+        shrink += bench_now() - t;
+
+        buffer_deinit(&b);
+    }
+
+    bench_report(SUITE, POLICY_NAMES[pol], "grow", size, rounds * size, grow);
+    bench_report(SUITE, POLICY_NAMES[pol], "shrink", size,
+                 rounds * size, shrink);
+}
+
+static
+void bench_vector(size_t size, const int64_t *keys, const size_t *perm) {
+    size_t rounds = bench_rounds(size), r, idx;
+    uint64_t ins = 0, ins_rsv = 0, get = 0, iter = 0, rem = 0, t, sum = 0;
+    int64_t *p, *end;
+    vector_t v;
+
+    for (r = 0; r < rounds; ++r) {
+        vector_init(&v, sizeof(int64_t), 0);
+
+        t = bench_now();
+        vector_reserve(&v, size);
+        for (idx = 0; idx < size; ++idx)
+            *(int64_t *)vector_append(&v) = keys[idx];
+        ins_rsv += bench_now() - t;
+
+        vector_deinit(&v);
+        vector_init(&v, sizeof(int64_t), 0);
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx)
+            *(int64_t *)vector_append(&v) = keys[idx];
+        ins += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx)
+            sum += *(int64_t *)vector_get(&v, perm[idx]);
+        get += bench_now() - t;
+
+        t = bench_now();
+        for (p = vector_begin(&v), end = vector_end(&v); p != end;
+             p = vector_next(&v, p))
+            sum += *p;
+        iter += bench_now() - t;
+
+        t = bench_now();
+        for (idx = size; idx; --idx)
+            vector_remove(&v, idx - 1);
+        rem += bench_now() - t;
+
+        vector_deinit(&v);
+    }
+
+    bench_sink = sum;
+
+    bench_report(SUITE, "vector", "insert", size, rounds * size, ins);
+    bench_report(SUITE, "vector", "insert-reserved", size,
+                 rounds * size, ins_rsv);
+    bench_report(SUITE, "vector", "lookup", size, rounds * size, get);
+    bench_report(SUITE, "vector", "iterate", size, rounds * size, iter);
+    bench_report(SUITE, "vector", "remove", size, rounds * size, rem);
+}
+
+static
+void bench_list(size_t size, const int64_t *keys, const size_t *perm) {
+    size_t rounds = bench_rounds(size), lookups = linear_lookups(size, rounds);
+    size_t r, idx;
+    uint64_t ins = 0, get = 0, iter = 0, rem = 0, t, sum = 0;
+    list_element_t *le;
+    list_t l;
+
+    for (r = 0; r < rounds; ++r) {
+        list_init(&l, true, sizeof(int64_t));
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx)
+            *(int64_t *)list_append(&l)->data = keys[idx];
+        ins += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < lookups; ++idx)
+            for (le = list_begin(&l); le; le = list_next(&l, le))
+                if (*(int64_t *)le->data == keys[perm[idx]]) {
+                    ++sum;
+                    break;
+                }
+        get += bench_now() - t;
+
+        t = bench_now();
+        for (le = list_begin(&l); le; le = list_next(&l, le))
+            sum += *(int64_t *)le->data;
+        iter += bench_now() - t;
+
+        t = bench_now();
+        for (le = list_begin(&l); le;)
+            le = list_remove_and_advance(&l, le);
+        rem += bench_now() - t;
+
+        list_purge(&l);
+    }
+
+    bench_sink = sum;
+
+    bench_report(SUITE, "list", "insert", size, rounds * size, ins);
+    bench_report(SUITE, "list", "lookup", size, rounds * lookups, get);
+    bench_report(SUITE, "list", "iterate", size, rounds * size, iter);
+    bench_report(SUITE, "list", "remove", size, rounds * size, rem);
+}
+
+static
+void bench_deque(size_t size, const int64_t *keys, const size_t *perm) {
+    size_t rounds = bench_rounds(size), r, idx;
+    uint64_t ins = 0, get = 0, iter = 0, rem = 0, t, sum = 0;
+    int64_t out;
+    deque_t d;
+
+    for (r = 0; r < rounds; ++r) {
+        deque_init(&d, sizeof(int64_t), 0);
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx)
+            *(int64_t *)deque_push_back(&d) = keys[idx];
+        ins += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx)
+            sum += *(int64_t *)deque_get(&d, perm[idx]);
+        get += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < deque_count(&d); ++idx)
+            sum += *(int64_t *)deque_get(&d, idx);
+        iter += bench_now() - t;
+
+        t = bench_now();
+        while (deque_pop_front(&d, &out))
+            sum += out;
+        rem += bench_now() - t;
+
+        deque_deinit(&d);
+    }
+
+    bench_sink = sum;
+
+    bench_report(SUITE, "deque", "insert", size, rounds * size, ins);
+    bench_report(SUITE, "deque", "lookup", size, rounds * size, get);
+    bench_report(SUITE, "deque", "iterate", size, rounds * size, iter);
+    bench_report(SUITE, "deque", "remove", size, rounds * size, rem);
+}
+
+static
+void bench_avl_tree(size_t size, const int64_t *keys, const size_t *perm) {
+    size_t rounds = bench_rounds(size), r, idx;
+    uint64_t ins = 0, get = 0, iter = 0, rem = 0, t, sum = 0;
+    avl_tree_node_t *n;
+    avl_tree_t tree;
+    bool inserted;
+
+    for (r = 0; r < rounds; ++r) {
+        avl_tree_init(&tree, true, sizeof(int64_t));
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx) {
+            n = avl_tree_add_or_get(&tree, keys[idx], &inserted);
+            *(int64_t *)n->data = keys[idx];
+        }
+        ins += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx)
+            sum += *(int64_t *)avl_tree_get(&tree, keys[perm[idx]])->data;
+        get += bench_now() - t;
+
+        t = bench_now();
+        for (n = avl_tree_node_min(tree.root); n; n = avl_tree_node_next(n))
+            sum += n->key;
+        iter += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx)
+            avl_tree_remove(&tree, keys[perm[idx]]);
+        rem += bench_now() - t;
+
+        avl_tree_purge(&tree);
+    }
+
+    bench_sink = sum;
+
+    bench_report(SUITE, "avl-tree", "insert", size, rounds * size, ins);
+    bench_report(SUITE, "avl-tree", "lookup", size, rounds * size, get);
+    bench_report(SUITE, "avl-tree", "iterate", size, rounds * size, iter);
+    bench_report(SUITE, "avl-tree", "remove", size, rounds * size, rem);
+}
+
+static
+void bench_typed_vector(size_t size, const int64_t *keys, const size_t *perm) {
+    size_t rounds = bench_rounds(size), r, idx;
+    uint64_t ins = 0, get = 0, iter = 0, rem = 0, t, sum = 0;
+    int64_t *p, *end;
+    i64_vector_t v;
+
+    for (r = 0; r < rounds; ++r) {
+        i64_vector_init(&v);
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx)
+            *i64_vector_append(&v) = keys[idx];
+        ins += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx)
+            sum += *i64_vector_get(&v, perm[idx]);
+        get += bench_now() - t;
+
+        t = bench_now();
+        for (p = i64_vector_begin(&v), end = i64_vector_end(&v); p != end; ++p)
+            sum += *p;
+        iter += bench_now() - t;
+
+        t = bench_now();
+        for (idx = size; idx; --idx)
+            i64_vector_remove(&v, idx - 1);
+        rem += bench_now() - t;
+
+        i64_vector_deinit(&v);
+    }
+
+    bench_sink = sum;
+
+    bench_report(SUITE, "vector-typed", "insert", size, rounds * size, ins);
+    bench_report(SUITE, "vector-typed", "lookup", size, rounds * size, get);
+    bench_report(SUITE, "vector-typed", "iterate", size, rounds * size, iter);
+    bench_report(SUITE, "vector-typed", "remove", size, rounds * size, rem);
+}
+
+static
+void bench_typed_list(size_t size, const int64_t *keys, const size_t *perm) {
+    size_t rounds = bench_rounds(size), lookups = linear_lookups(size, rounds);
+    size_t r, idx;
+    uint64_t ins = 0, get = 0, iter = 0, rem = 0, t, sum = 0;
+    i64_list_element_t *le;
+    i64_list_t l;
+
+    for (r = 0; r < rounds; ++r) {
+        i64_list_init(&l);
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx)
+            i64_list_append(&l)->data = keys[idx];
+        ins += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < lookups; ++idx)
+            for (le = i64_list_begin(&l); le; le = i64_list_next(le))
+                if (le->data == keys[perm[idx]]) {
+                    ++sum;
+                    break;
+                }
+        get += bench_now() - t;
+
+        t = bench_now();
+        for (le = i64_list_begin(&l); le; le = i64_list_next(le))
+            sum += le->data;
+        iter += bench_now() - t;
+
+        t = bench_now();
+        for (le = i64_list_begin(&l); le;)
+            le = i64_list_remove_and_advance(&l, le);
+        rem += bench_now() - t;
+
+        i64_list_purge(&l);
+    }
+
+    bench_sink = sum;
+
+    bench_report(SUITE, "list-typed", "insert", size, rounds * size, ins);
+    bench_report(SUITE, "list-typed", "lookup", size, rounds * lookups, get);
+    bench_report(SUITE, "list-typed", "iterate", size, rounds * size, iter);
+    bench_report(SUITE, "list-typed", "remove", size, rounds * size, rem);
+}
+
+static
+void bench_typed_tree(size_t size, const int64_t *keys, const size_t *perm) {
+    size_t rounds = bench_rounds(size), r, idx;
+    uint64_t ins = 0, get = 0, iter = 0, rem = 0, t, sum = 0;
+    i64_tree_node_t *n;
+    i64_tree_t tree;
+    bool inserted;
+
+    for (r = 0; r < rounds; ++r) {
+        i64_tree_init(&tree);
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx)
+            i64_tree_add_or_get(&tree, keys[idx], &inserted)->value = keys[idx];
+        ins += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx)
+            sum += i64_tree_get(&tree, keys[perm[idx]])->value;
+        get += bench_now() - t;
+
+        t = bench_now();
+        for (n = i64_tree_min(tree.root); n; n = i64_tree_next(n))
+            sum += n->key;
+        iter += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx)
+            i64_tree_remove(&tree, keys[perm[idx]]);
+        rem += bench_now() - t;
+
+        i64_tree_purge(&tree);
+    }
+
+    bench_sink = sum;
+
+    bench_report(SUITE, "avl-tree-typed", "insert", size, rounds * size, ins);
+    bench_report(SUITE, "avl-tree-typed", "lookup", size, rounds * size, get);
+    bench_report(SUITE, "avl-tree-typed", "iterate", size, rounds * size,
+                 iter);
+    bench_report(SUITE, "avl-tree-typed", "remove", size, rounds * size, rem);
+}
+
+static
+void bench_hash_map(size_t size, const int64_t *keys, const size_t *perm) {
+    size_t rounds = bench_rounds(size), r, idx;
+    uint64_t ins = 0, get = 0, iter = 0, rem = 0, t, sum = 0;
+    hash_map_node_data_t hmnd;
+    hash_map_node_t *hmn;
+    hash_map_t hm;
+    hash_t h;
+
+    for (r = 0; r < rounds; ++r) {
+        hash_map_init(&hm, hash_pearson, hash_update_pearson);
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx) {
+            h = hm.hasher(&keys[idx], sizeof(keys[idx]));
+            hmn = hash_map_add_or_get(&hm, h);
+
+            hmnd.data = (void *)&keys[idx];
+            hmnd.size = sizeof(keys[idx]);
+            hash_map_node_add(hmn, hmnd);
+        }
+        ins += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx) {
+            h = hm.hasher(&keys[perm[idx]], sizeof(keys[0]));
+            hmn = hash_map_get(&hm, h);
+            sum += hash_map_node_size(hmn);
+        }
+        get += bench_now() - t;
+
+        t = bench_now();
+        for (hmn = hash_map_begin(&hm); hmn; hmn = hash_map_next(&hm, hmn))
+            sum += hmn->hash;
+        iter += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx) {
+            h = hm.hasher(&keys[perm[idx]], sizeof(keys[0]));
+            hash_map_remove(&hm, h);
+        }
+        rem += bench_now() - t;
+
+        hash_map_purge(&hm);
+    }
+
+    bench_sink = sum;
+
+    bench_report(SUITE, "hash-map", "insert", size, rounds * size, ins);
+    bench_report(SUITE, "hash-map", "lookup", size, rounds * size, get);
+    bench_report(SUITE, "hash-map", "iterate", size, rounds * size, iter);
+    bench_report(SUITE, "hash-map", "remove", size, rounds * size, rem);
+}
+
+static
+void bench_chain_buffer(size_t size) {
+    size_t rounds = bench_rounds(size), r, idx;
+    uint64_t ins = 0, split = 0, copy = 0, rem = 0, t;
+    uint8_t chunk[CHAIN_CHUNK_SIZE];
+    chain_buffer_t cb, head;
+
+    memset(chunk, 0x5a, sizeof(chunk));
+
+    for (r = 0; r < rounds; ++r) {
+        chain_buffer_init(&cb, 0);
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx)
+            chain_buffer_append(&cb, chunk, sizeof(chunk));
+        ins += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < size; ++idx)
+            chain_buffer_copy_out(&cb, 0, chunk, sizeof(chunk));
+        copy += bench_now() - t;
+
+        /* framing: split every chunk off and drop it */
+        t = bench_now();
+        for (idx = 0; idx < size / 2; ++idx) {
+            chain_buffer_init(&head, 0);
+            chain_buffer_split(&cb, sizeof(chunk), &head);
+            chain_buffer_deinit(&head);
+        }
+        split += bench_now() - t;
+
+        t = bench_now();
+        while (chain_buffer_length(&cb))
+            chain_buffer_consume(&cb, sizeof(chunk));
+        rem += bench_now() - t;
+
+        chain_buffer_deinit(&cb);
+    }
+
+    bench_report(SUITE, "chain-buffer", "insert", size, rounds * size, ins);
+    bench_report(SUITE, "chain-buffer", "lookup", size, rounds * size, copy);
+    bench_report(SUITE, "chain-buffer", "split", size, rounds * (size / 2),
+                 split);
+    bench_report(SUITE, "chain-buffer", "remove", size,
+                 rounds * (size - size / 2), rem);
+}
+
+/**************** API ****************/
+void bench_containers(const bench_config_t *cfg) {
+    size_t size;
+    int64_t *keys;
+    size_t *perm;
+    enum buffer_policy pol;
+
+    for (size = cfg->min_size; size <= cfg->max_size; size *= 10) {
+        keys = bench_keys(size, size);
+        perm = bench_permutation(size, ~size);
+
+        assert(keys && perm);
+
+        for (pol = 0; pol < buffer_policy_max; ++pol)
+            bench_buffer(size, pol);
+
+        bench_vector(size, keys, perm);
+        bench_typed_vector(size, keys, perm);
+        bench_list(size, keys, perm);
+        bench_typed_list(size, keys, perm);
+        bench_deque(size, keys, perm);
+        bench_avl_tree(size, keys, perm);
+        bench_typed_tree(size, keys, perm);
+        bench_hash_map(size, keys, perm);
+        bench_chain_buffer(size);
+
+        free(keys);
+        free(perm);
+    }
+}
+
+void bench_hashing(const bench_config_t *cfg) {
+    static const size_t LENGTHS[] = { 4, 8, 16, 64, 256, 1024 };
+    uint8_t data[1024];
+    size_t idx, len, ops, count;
+    uint64_t t, seed = 1;
+    hash_t h = 0;
+
+    for (idx = 0; idx < sizeof(data); ++idx)
+        data[idx] = bench_rand(&seed);
+
+    for (idx = 0; idx < sizeof(LENGTHS) / sizeof(LENGTHS[0]); ++idx) {
+        len = LENGTHS[idx];
+
+        /* about the same amount of hashed bytes for every length */
+        count = BENCH_MIN_OPS * 4 / len;
+
+        t = bench_now();
+        for (ops = 0; ops < count; ++ops) {
+            data[0] = ops;
+            h ^= hash_pearson(data, len);
+        }
+        bench_report("hashing", "pearson", "hash", len, ops, bench_now() - t);
+
+        t = bench_now();
+        for (ops = 0; ops < count; ++ops) {
+            data[1] = ops;
+            h = hash_update_pearson(h, data, len);
+        }
+        bench_report("hashing", "pearson", "update", len, ops,
+                     bench_now() - t);
+    }
+
+    bench_sink = h;
+}
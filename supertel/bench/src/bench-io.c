@@ -0,0 +1,158 @@
+#include "bench.h"
+#include "io-service.h"
+#include "timer.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+/* fds reserved for stdio, epoll and event fd of io service, timers */
+#define RESERVED_FDS            (16)
+#define TIMER_FAR_SEC           (60)
+
+typedef struct dispatch_ctx {
+    io_service_t *iosvc;
+    int *fds;
+    size_t count;
+    /** dispatches left to do */
+    size_t left;
+    size_t next;
+} dispatch_ctx_t;
+
+typedef struct timer_ctx {
+    tmr_t *tmr;
+    io_service_t *iosvc;
+    size_t left;
+} timer_ctx_t;
+
+/* consume own event and make the next fd in the ring readable */
+static
+void dispatch_job(int fd, io_svc_op_t op, void *_ctx) {
+    dispatch_ctx_t *ctx = _ctx;
+    eventfd_t v;
+
+    eventfd_read(fd, &v);
+
+    if (!--ctx->left) {
+        io_service_stop(ctx->iosvc, false);
+        return;
+    }
+
+    ctx->next = (ctx->next + 1) % ctx->count;
+    eventfd_write(ctx->fds[ctx->next], 1);
+}
+
+static
+void timer_fired(void *_ctx) {
+    timer_ctx_t *ctx = _ctx;
+
+    if (!--ctx->left) {
+        io_service_stop(ctx->iosvc, false);
+        return;
+    }
+
+    timer_set_deadline(ctx->tmr, 0, 1, timer_fired, ctx);
+}
+
+static
+void timer_stub(void *ctx) {
+}
+
+static
+size_t fd_limit(void) {
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) || rl.rlim_cur <= RESERVED_FDS)
+        return 0;
+
+    return rl.rlim_cur - RESERVED_FDS;
+}
+
+static
+void bench_dispatch(size_t fd_count) {
+    io_service_t iosvc;
+    dispatch_ctx_t ctx;
+    size_t idx, ops = BENCH_MIN_OPS / 10;
+    uint64_t t;
+
+    ctx.fds = malloc(fd_count * sizeof(int));
+    assert(ctx.fds);
+
+    io_service_init(&iosvc);
+
+    for (idx = 0; idx < fd_count; ++idx) {
+        ctx.fds[idx] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        assert(ctx.fds[idx] >= 0);
+
+        io_service_post_job(&iosvc, ctx.fds[idx], IO_SVC_OP_READ,
+                            !IOSVC_JOB_ONESHOT, dispatch_job, &ctx);
+    }
+
+    ctx.iosvc = &iosvc;
+    ctx.count = fd_count;
+    ctx.left = ops;
+    ctx.next = 0;
+
+    eventfd_write(ctx.fds[0], 1);
+
+    t = bench_now();
+    io_service_run(&iosvc);
+    t = bench_now() - t;
+
+    bench_report("io-service", "eventfd", "dispatch", fd_count, ops, t);
+
+    io_service_deinit(&iosvc);
+
+    for (idx = 0; idx < fd_count; ++idx)
+        close(ctx.fds[idx]);
+
+    free(ctx.fds);
+}
+
+/**************** API ****************/
+void bench_io_service(const bench_config_t *cfg) {
+    size_t size, limit = fd_limit();
+
+    for (size = 1; size <= cfg->max_size && size <= limit; size *= 10)
+        bench_dispatch(size);
+}
+
+void bench_timer(const bench_config_t *cfg) {
+    io_service_t iosvc;
+    tmr_t tmr;
+    timer_ctx_t ctx;
+    size_t idx, ops = BENCH_MIN_OPS / 10;
+    uint64_t t;
+
+    io_service_init(&iosvc);
+    timer_init(&tmr, &iosvc);
+
+    t = bench_now();
+    for (idx = 0; idx < ops; ++idx)
+        timer_set_deadline(&tmr, TIMER_FAR_SEC, 0, timer_stub, NULL);
+    bench_report("timer", "timerfd", "arm", 1, ops, bench_now() - t);
+
+    t = bench_now();
+    for (idx = 0; idx < ops; ++idx) {
+        timer_set_deadline(&tmr, TIMER_FAR_SEC, 0, timer_stub, NULL);
+        timer_cancel(&tmr);
+    }
+    bench_report("timer", "timerfd", "arm-cancel", 1, ops, bench_now() - t);
+
+    /* 1 ns deadline: measures expiry delivery through io service */
+    ctx.tmr = &tmr;
+    ctx.iosvc = &iosvc;
+    ctx.left = ops;
+
+    timer_set_deadline(&tmr, 0, 1, timer_fired, &ctx);
+
+    t = bench_now();
+    io_service_run(&iosvc);
+    bench_report("timer", "timerfd", "fire", 1, ops, bench_now() - t);
+
+    timer_deinit(&tmr);
+    io_service_deinit(&iosvc);
+}
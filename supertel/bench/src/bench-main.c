@@ -0,0 +1,133 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define DEFAULT_MIN_SIZE        (10)
+#define DEFAULT_MAX_SIZE        (100000)
+
+typedef struct suite_description {
+    const char *name;
+    bench_suite_t run;
+} suite_description_t;
+
+static const suite_description_t SUITES[] = {
+    { "containers", bench_containers },
+    { "hashing",    bench_hashing },
+    { "io-service", bench_io_service },
+    { "timer",      bench_timer },
+    { "queues",     bench_queues }
+};
+
+volatile uint64_t bench_sink;
+
+static
+void print_usage(const char *self) {
+    printf("usage: %s [-m <min size>] [-n <max size>] [-s <suite>]\n", self);
+    printf("  sizes go from min to max with factor of 10 "
+           "(default %d .. %d)\n", DEFAULT_MIN_SIZE, DEFAULT_MAX_SIZE);
+    printf("  suites:");
+
+    for (size_t idx = 0; idx < sizeof(SUITES) / sizeof(SUITES[0]); ++idx)
+        printf(" %s", SUITES[idx].name);
+
+    printf("\n");
+}
+
+/**************** API ****************/
+void bench_report(const char *suite, const char *subject,
+                  const char *operation, size_t size,
+                  uint64_t ops, uint64_t ns) {
+    printf("%s,%s,%s,%zu,%llu,%llu,%.3f\n",
+           suite, subject, operation, size,
+           (unsigned long long)ops, (unsigned long long)ns,
+           ops ? (double)ns / ops : 0.0);
+    fflush(stdout);
+}
+
+int64_t *bench_keys(size_t size, uint64_t seed) {
+    int64_t *keys = malloc(size * sizeof(*keys));
+    size_t *perm = bench_permutation(size, seed);
+    size_t idx;
+
+    if (!keys || !perm) {
+        free(keys);
+        free(perm);
+        return NULL;
+    }
+
+    /* odd multiplier keeps keys distinct and spreads them over the range */
+    for (idx = 0; idx < size; ++idx)
+        keys[idx] = (int64_t)(perm[idx] * 0x9e3779b97f4a7c15ull);
+
+    free(perm);
+
+    return keys;
+}
+
+size_t *bench_permutation(size_t size, uint64_t seed) {
+    size_t *perm = malloc(size * sizeof(*perm));
+    size_t idx, j, tmp;
+    uint64_t state = seed | 1;
+
+    if (!perm)
+        return NULL;
+
+    for (idx = 0; idx < size; ++idx)
+        perm[idx] = idx;
+
+    for (idx = size; idx > 1; --idx) {
+        j = bench_rand(&state) % idx;
+        tmp = perm[idx - 1];
+        perm[idx - 1] = perm[j];
+        perm[j] = tmp;
+    }
+
+    return perm;
+}
+
+int main(int argc, char **argv) {
+    bench_config_t cfg = {
+        .min_size = DEFAULT_MIN_SIZE,
+        .max_size = DEFAULT_MAX_SIZE,
+        .filter = NULL
+    };
+    size_t idx;
+    int opt;
+
+    while (-1 != (opt = getopt(argc, argv, "m:n:s:h"))) {
+        switch (opt) {
+            case 'm':
+                cfg.min_size = strtoull(optarg, NULL, 10);
+                break;
+            case 'n':
+                cfg.max_size = strtoull(optarg, NULL, 10);
+                break;
+            case 's':
+                cfg.filter = optarg;
+                break;
+            default:
+                print_usage(argv[0]);
+                exit(opt == 'h' ? 0 : 2);
+        }
+    }
+
+    if (!cfg.min_size || cfg.min_size > cfg.max_size) {
+        print_usage(argv[0]);
+        exit(2);
+    }
+
+    printf("suite,subject,operation,size,ops,total_ns,ns_per_op\n");
+
+    for (idx = 0; idx < sizeof(SUITES) / sizeof(SUITES[0]); ++idx) {
+        if (cfg.filter && !strstr(SUITES[idx].name, cfg.filter))
+            continue;
+
+        SUITES[idx].run(&cfg);
+    }
+
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include "bench.h"
+#include "lockfree-queue.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+
+#define QUEUE_CAPACITY          (1024)
+#define QUEUE_BATCH             (32)
+
+typedef struct transfer_ctx {
+    spsc_queue_t *spsc;
+    mpsc_queue_t *mpsc;
+    size_t count;
+} transfer_ctx_t;
+
+static
+void *spsc_producer(void *_ctx) {
+    transfer_ctx_t *ctx = _ctx;
+    uint64_t idx;
+
+    for (idx = 0; idx < ctx->count;)
+        if (spsc_queue_push(ctx->spsc, &idx))
+            ++idx;
+        else
+            sched_yield();
+
+    return NULL;
+}
+
+static
+void *mpsc_producer(void *_ctx) {
+    transfer_ctx_t *ctx = _ctx;
+    uint64_t idx;
+
+    for (idx = 0; idx < ctx->count;)
+        if (mpsc_queue_push(ctx->mpsc, &idx))
+            ++idx;
+        else
+            sched_yield();
+
+    return NULL;
+}
+
+static
+void bench_single_thread(size_t size) {
+    uint64_t batch[QUEUE_BATCH], v = 0, t, push = 0, pop = 0;
+    uint64_t push_n = 0, pop_n = 0;
+    size_t done, idx;
+    bool inited;
+    spsc_queue_t sq;
+    mpsc_queue_t mq;
+
+    inited = spsc_queue_init(&sq, sizeof(uint64_t), QUEUE_CAPACITY) &&
+             mpsc_queue_init(&mq, sizeof(uint64_t), QUEUE_CAPACITY);
+    assert(inited);
+
+    for (done = 0; done < size; done += QUEUE_CAPACITY) {
+        t = bench_now();
+        for (idx = 0; idx < QUEUE_CAPACITY; ++idx)
+            spsc_queue_push(&sq, &v);
+        push += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < QUEUE_CAPACITY; ++idx)
+            spsc_queue_pop(&sq, &v);
+        pop += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < QUEUE_CAPACITY; idx += QUEUE_BATCH)
+            spsc_queue_push_n(&sq, batch, QUEUE_BATCH);
+        push_n += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < QUEUE_CAPACITY; idx += QUEUE_BATCH)
+            spsc_queue_pop_n(&sq, batch, QUEUE_BATCH);
+        pop_n += bench_now() - t;
+    }
+
+    bench_report("queues", "spsc", "push", QUEUE_CAPACITY, done, push);
+    bench_report("queues", "spsc", "pop", QUEUE_CAPACITY, done, pop);
+    bench_report("queues", "spsc", "push-batch", QUEUE_BATCH, done, push_n);
+    bench_report("queues", "spsc", "pop-batch", QUEUE_BATCH, done, pop_n);
+
+    push = pop = push_n = pop_n = 0;
+
+    for (done = 0; done < size; done += QUEUE_CAPACITY) {
+        t = bench_now();
+        for (idx = 0; idx < QUEUE_CAPACITY; ++idx)
+            mpsc_queue_push(&mq, &v);
+        push += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < QUEUE_CAPACITY; ++idx)
+            mpsc_queue_pop(&mq, &v);
+        pop += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < QUEUE_CAPACITY; idx += QUEUE_BATCH)
+            mpsc_queue_push_n(&mq, batch, QUEUE_BATCH);
+        push_n += bench_now() - t;
+
+        t = bench_now();
+        for (idx = 0; idx < QUEUE_CAPACITY; idx += QUEUE_BATCH)
+            mpsc_queue_pop_n(&mq, batch, QUEUE_BATCH);
+        pop_n += bench_now() - t;
+    }
+
+    bench_report("queues", "mpsc", "push", QUEUE_CAPACITY, done, push);
+    bench_report("queues", "mpsc", "pop", QUEUE_CAPACITY, done, pop);
+    bench_report("queues", "mpsc", "push-batch", QUEUE_BATCH, done, push_n);
+    bench_report("queues", "mpsc", "pop-batch", QUEUE_BATCH, done, pop_n);
+
+    bench_sink = v + batch[0];
+
+    spsc_queue_deinit(&sq);
+    mpsc_queue_deinit(&mq);
+}
+
+/* producer thread to consumer (this thread) transfer rate */
+static
+void bench_transfer(size_t size) {
+    transfer_ctx_t ctx;
+    spsc_queue_t sq;
+    mpsc_queue_t mq;
+    pthread_t producer;
+    uint64_t t, v;
+    size_t idx;
+    bool inited;
+
+    inited = spsc_queue_init(&sq, sizeof(uint64_t), QUEUE_CAPACITY) &&
+             mpsc_queue_init(&mq, sizeof(uint64_t), QUEUE_CAPACITY);
+    assert(inited);
+
+    ctx.spsc = &sq;
+    ctx.mpsc = &mq;
+    ctx.count = size;
+
+    t = bench_now();
+    pthread_create(&producer, NULL, spsc_producer, &ctx);
+
+    for (idx = 0; idx < size;)
+        if (spsc_queue_pop(&sq, &v))
+            ++idx;
+        else
+            sched_yield();
+
+    pthread_join(producer, NULL);
+    bench_report("queues", "spsc", "transfer", QUEUE_CAPACITY, size,
+                 bench_now() - t);
+
+    t = bench_now();
+    pthread_create(&producer, NULL, mpsc_producer, &ctx);
+
+    for (idx = 0; idx < size;)
+        if (mpsc_queue_pop(&mq, &v))
+            ++idx;
+        else
+            sched_yield();
+
+    pthread_join(producer, NULL);
+    bench_report("queues", "mpsc", "transfer", QUEUE_CAPACITY, size,
+                 bench_now() - t);
+
+    spsc_queue_deinit(&sq);
+    mpsc_queue_deinit(&mq);
+}
+
+/**************** API ****************/
+void bench_queues(const bench_config_t *cfg) {
+    bench_single_thread(BENCH_MIN_OPS);
+    bench_transfer(BENCH_MIN_OPS);
+}
@@ -0,0 +1,89 @@
+#ifndef _CHAIN_BUFFER_H_
+# define _CHAIN_BUFFER_H_
+
+/** \file chain-buffer.h
+ * Chained buffer library.
+ * Chain buffer is a sequence of slices. Each slice references a range
+ * of a refcounted segment. Segments are shared between chains
+ * on split, so framing never copies payload around.
+ *
+ * Single-thread implementation.
+ */
+
+# include "containers.h"
+
+# include <stddef.h>
+# include <stdint.h>
+# include <stdbool.h>
+# include <sys/types.h>
+# include <sys/uio.h>
+
+/** Default segment size for appended data */
+# define CHAIN_BUFFER_SEGMENT_SIZE      (4096)
+/** Space left in front of fresh segment for prepending headers */
+# define CHAIN_BUFFER_HEADROOM          (32)
+/** Maximum iovec count per single readv/writev/sendmsg call */
+# define CHAIN_BUFFER_MAX_IOV           (64)
+
+typedef struct cbuf_segment {
+    size_t refcount;
+    /** allocated size of data */
+    size_t size;
+    /** lowest offset written */
+    size_t begin;
+    /** highest offset written (exclusive) */
+    size_t end;
+    uint8_t *data;
+} cbuf_segment_t;
+
+typedef struct cbuf_slice {
+    cbuf_segment_t *seg;
+    size_t offset;
+    size_t len;
+} cbuf_slice_t;
+
+typedef struct chain_buffer {
+    /* deque of cbuf_slice_t */
+    deque_t slices;
+    /** total bytes within chain */
+    size_t length;
+    size_t segment_size;
+} chain_buffer_t;
+
+void chain_buffer_init(chain_buffer_t *cb, size_t segment_size);
+void chain_buffer_deinit(chain_buffer_t *cb);
+size_t chain_buffer_length(const chain_buffer_t *cb);
+bool chain_buffer_append(chain_buffer_t *cb, const void *d, size_t len);
+void *chain_buffer_append_space(chain_buffer_t *cb, size_t len);
+bool chain_buffer_prepend(chain_buffer_t *cb, const void *d, size_t len);
+bool chain_buffer_adopt(chain_buffer_t *cb, void *mem, size_t len);
+void chain_buffer_append_chain(chain_buffer_t *dst, chain_buffer_t *src);
+bool chain_buffer_split(chain_buffer_t *cb, size_t at, chain_buffer_t *head);
+size_t chain_buffer_consume(chain_buffer_t *cb, size_t len);
+size_t chain_buffer_copy_out(const chain_buffer_t *cb, size_t offset,
+                             void *dst, size_t len);
+const void *chain_buffer_contiguous(const chain_buffer_t *cb, size_t len);
+int chain_buffer_iovec(const chain_buffer_t *cb,
+                       struct iovec *iov, int max_iov);
+
+/**
+ * Write chain contents with \c writev and consume what was written.
+ * \return bytes written or \c -1 with \c errno set
+ */
+ssize_t chain_buffer_writev(int fd, chain_buffer_t *cb);
+
+/**
+ * Send chain contents with \c sendmsg and consume what was sent.
+ * \param [in] flags \c sendmsg flags
+ * \return bytes sent or \c -1 with \c errno set
+ */
+ssize_t chain_buffer_sendmsg(int fd, chain_buffer_t *cb, int flags);
+
+/**
+ * Read up to \c max bytes with \c readv appending them to the chain.
+ * Free space of the tail segment is filled first.
+ * \return bytes read, \c 0 on EOF or \c -1 with \c errno set
+ */
+ssize_t chain_buffer_readv(int fd, chain_buffer_t *cb, size_t max);
+
+#endif /* _CHAIN_BUFFER_H_ */
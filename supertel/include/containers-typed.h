@@ -0,0 +1,571 @@
+#ifndef _CONTAINERS_TYPED_H_
+# define _CONTAINERS_TYPED_H_
+
+/** \file containers-typed.h
+ * Type-specialized containers generator.
+ *
+ * Each macro emits a container type and a set of static inline functions
+ * for the given element type, so element size is a compile-time constant
+ * and element access is a plain typed pointer.
+ *
+ * \code
+ * VECTOR_TYPED_DECLARE(i64_vector, int64_t)
+ * i64_vector_t v;
+ * i64_vector_init(&v);
+ * *i64_vector_append(&v) = 42;
+ * \endcode
+ *
+ * Generic runtime-sized containers from containers.h and avl-tree.h
+ * are not affected.
+ */
+
+# include <stddef.h>
+# include <stdbool.h>
+# include <stdlib.h>
+# include <string.h>
+# include <assert.h>
+
+/** Default key comparison for \c AVL_TREE_TYPED_DECLARE */
+# define CONTAINERS_TYPED_LESS(a, b)    ((a) < (b))
+
+/**
+ * Vector of \c type with doubling growth.
+ * Emits \c name_t and \c name_init, \c name_deinit, \c name_reserve,
+ * \c name_clear, \c name_count, \c name_append, \c name_push,
+ * \c name_insert, \c name_remove, \c name_remove_range, \c name_get,
+ * \c name_begin, \c name_end.
+ */
+# define VECTOR_TYPED_DECLARE(name, type)                                    \
+typedef struct name {                                                       \
+    type *data;                                                             \
+    size_t count;                                                           \
+    size_t capacity;                                                        \
+} name##_t;                                                                 \
+                                                                            \
+static inline                                                               \
+void name##_init(name##_t *v) {                                             \
+    assert(v);                                                              \
+    v->data = NULL;                                                         \
+    v->count = v->capacity = 0;                                             \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+void name##_deinit(name##_t *v) {                                           \
+    assert(v);                                                              \
+    free(v->data);                                                          \
+    v->data = NULL;                                                         \
+    v->count = v->capacity = 0;                                             \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+bool name##_reserve(name##_t *v, size_t capacity) {                         \
+    type *d;                                                                \
+                                                                            \
+    assert(v);                                                              \
+                                                                            \
+    if (capacity <= v->capacity)                                            \
+        return true;                                                        \
+                                                                            \
+    d = realloc(v->data, capacity * sizeof(type));                          \
+                                                                            \
+    if (!d)                                                                 \
+        return false;                                                       \
+                                                                            \
+    v->data = d;                                                            \
+    v->capacity = capacity;                                                 \
+                                                                            \
+    return true;                                                            \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+void name##_clear(name##_t *v) {                                            \
+    assert(v);                                                              \
+    v->count = 0;                                                           \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+size_t name##_count(const name##_t *v) {                                    \
+    return v ? v->count : 0;                                                \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+type *name##_append(name##_t *v) {                                          \
+    assert(v);                                                              \
+                                                                            \
+    if (v->count == v->capacity &&                                          \
+        !name##_reserve(v, v->capacity ? v->capacity * 2 : 4))              \
+        return NULL;                                                        \
+                                                                            \
+    return v->data + v->count++;                                            \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+bool name##_push(name##_t *v, type value) {                                 \
+    type *d = name##_append(v);                                             \
+                                                                            \
+    if (d)                                                                  \
+        *d = value;                                                         \
+                                                                            \
+    return !!d;                                                             \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+type *name##_insert(name##_t *v, size_t idx) {                              \
+    assert(v && idx <= v->count);                                           \
+                                                                            \
+    if (!name##_append(v))                                                  \
+        return NULL;                                                        \
+                                                                            \
+    memmove(v->data + idx + 1, v->data + idx,                               \
+            (v->count - 1 - idx) * sizeof(type));                           \
+                                                                            \
+    return v->data + idx;                                                   \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+void name##_remove_range(name##_t *v, size_t from, size_t count) {          \
+    assert(v && from + count <= v->count);                                  \
+                                                                            \
+    memmove(v->data + from, v->data + from + count,                         \
+            (v->count - from - count) * sizeof(type));                      \
+    v->count -= count;                                                      \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+void name##_remove(name##_t *v, size_t idx) {                               \
+    name##_remove_range(v, idx, 1);                                         \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+type *name##_get(name##_t *v, size_t idx) {                                 \
+    assert(v && idx < v->count);                                            \
+    return v->data + idx;                                                   \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+type *name##_begin(name##_t *v) {                                           \
+    assert(v);                                                              \
+    return v->data;                                                         \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+type *name##_end(name##_t *v) {                                             \
+    assert(v);                                                              \
+    return v->data + v->count;                                              \
+}
+
+/**
+ * Doubly linked list of \c type, element data is stored inplace.
+ * Emits \c name_t, \c name_element_t and \c name_init, \c name_purge,
+ * \c name_count, \c name_append, \c name_prepend, \c name_add_after,
+ * \c name_remove_and_advance, \c name_begin, \c name_end,
+ * \c name_next, \c name_prev.
+ */
+# define LIST_TYPED_DECLARE(name, type)                                      \
+typedef struct name##_element {                                             \
+    struct name##_element *prev;                                            \
+    struct name##_element *next;                                            \
+    type data;                                                              \
+} name##_element_t;                                                         \
+                                                                            \
+typedef struct name {                                                       \
+    name##_element_t *front;                                                \
+    name##_element_t *back;                                                 \
+    size_t count;                                                           \
+} name##_t;                                                                 \
+                                                                            \
+static inline                                                               \
+void name##_init(name##_t *l) {                                             \
+    assert(l);                                                              \
+    l->front = l->back = NULL;                                              \
+    l->count = 0;                                                           \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+size_t name##_count(const name##_t *l) {                                    \
+    return l ? l->count : 0;                                                \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+name##_element_t *name##_add_after(name##_t *l, name##_element_t *el) {     \
+    name##_element_t *n;                                                    \
+                                                                            \
+    assert(l);                                                              \
+                                                                            \
+    n = malloc(sizeof(*n));                                                 \
+                                                                            \
+    if (!n)                                                                 \
+        return NULL;                                                        \
+                                                                            \
+    n->prev = el;                                                           \
+    n->next = el ? el->next : l->front;                                     \
+                                                                            \
+    if (n->next)                                                            \
+        n->next->prev = n;                                                  \
+    else                                                                    \
+        l->back = n;                                                        \
+                                                                            \
+    if (el)                                                                 \
+        el->next = n;                                                       \
+    else                                                                    \
+        l->front = n;                                                       \
+                                                                            \
+    ++l->count;                                                             \
+                                                                            \
+    return n;                                                               \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+name##_element_t *name##_append(name##_t *l) {                              \
+    assert(l);                                                              \
+    return name##_add_after(l, l->back);                                    \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+name##_element_t *name##_prepend(name##_t *l) {                             \
+    return name##_add_after(l, NULL);                                       \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+name##_element_t *name##_remove_and_advance(name##_t *l,                    \
+                                            name##_element_t *el) {         \
+    name##_element_t *next;                                                 \
+                                                                            \
+    assert(l && el);                                                        \
+                                                                            \
+    next = el->next;                                                        \
+                                                                            \
+    if (el->prev)                                                           \
+        el->prev->next = next;                                              \
+    else                                                                    \
+        l->front = next;                                                    \
+                                                                            \
+    if (next)                                                               \
+        next->prev = el->prev;                                              \
+    else                                                                    \
+        l->back = el->prev;                                                 \
+                                                                            \
+    --l->count;                                                             \
+    free(el);                                                               \
+                                                                            \
+    return next;                                                            \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+void name##_purge(name##_t *l) {                                            \
+    assert(l);                                                              \
+                                                                            \
+    while (l->front)                                                        \
+        name##_remove_and_advance(l, l->front);                             \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+name##_element_t *name##_begin(name##_t *l) {                               \
+    assert(l);                                                              \
+    return l->front;                                                        \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+name##_element_t *name##_end(name##_t *l) {                                 \
+    assert(l);                                                              \
+    return l->back;                                                         \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+name##_element_t *name##_next(name##_element_t *el) {                       \
+    return el ? el->next : NULL;                                            \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+name##_element_t *name##_prev(name##_element_t *el) {                       \
+    return el ? el->prev : NULL;                                            \
+}
+
+/**
+ * AVL tree mapping \c key_type to \c value_type.
+ * \c less is a function or function-like macro \c less(a, b) ordering keys,
+ * e.g. \c CONTAINERS_TYPED_LESS.
+ * Node pointers stay valid until the node itself is removed.
+ * Emits \c name_t, \c name_node_t and \c name_init, \c name_purge,
+ * \c name_count, \c name_get, \c name_add_or_get, \c name_remove_node,
+ * \c name_remove, \c name_min, \c name_max, \c name_next, \c name_prev.
+ */
+# define AVL_TREE_TYPED_DECLARE(name, key_type, value_type, less)            \
+typedef struct name##_node name##_node_t;                                   \
+struct name##_node {                                                        \
+    name##_node_t *left;                                                    \
+    name##_node_t *right;                                                   \
+    name##_node_t *parent;                                                  \
+    int height;                                                             \
+    key_type key;                                                           \
+    value_type value;                                                       \
+};                                                                          \
+                                                                            \
+typedef struct name {                                                       \
+    name##_node_t *root;                                                    \
+    size_t count;                                                           \
+} name##_t;                                                                 \
+                                                                            \
+static inline                                                               \
+int name##_height_(const name##_node_t *n) {                                \
+    return n ? n->height : 0;                                               \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+void name##_update_(name##_node_t *n) {                                     \
+    int hl = name##_height_(n->left), hr = name##_height_(n->right);        \
+    n->height = 1 + (hl > hr ? hl : hr);                                    \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+void name##_replace_child_(name##_t *t, name##_node_t *parent,              \
+                           name##_node_t *old, name##_node_t *n) {          \
+    if (!parent)                                                            \
+        t->root = n;                                                        \
+    else if (parent->left == old)                                           \
+        parent->left = n;                                                   \
+    else                                                                    \
+        parent->right = n;                                                  \
+                                                                            \
+    if (n)                                                                  \
+        n->parent = parent;                                                 \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+name##_node_t *name##_rotate_left_(name##_t *t, name##_node_t *x) {         \
+    name##_node_t *y = x->right;                                            \
+                                                                            \
+    x->right = y->left;                                                     \
+    if (y->left)                                                            \
+        y->left->parent = x;                                                \
+                                                                            \
+    name##_replace_child_(t, x->parent, x, y);                              \
+    y->left = x;                                                            \
+    x->parent = y;                                                          \
+                                                                            \
+    name##_update_(x);                                                      \
+    name##_update_(y);                                                      \
+                                                                            \
+    return y;                                                               \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+name##_node_t *name##_rotate_right_(name##_t *t, name##_node_t *x) {        \
+    name##_node_t *y = x->left;                                             \
+                                                                            \
+    x->left = y->right;                                                     \
+    if (y->right)                                                           \
+        y->right->parent = x;                                               \
+                                                                            \
+    name##_replace_child_(t, x->parent, x, y);                              \
+    y->right = x;                                                           \
+    x->parent = y;                                                          \
+                                                                            \
+    name##_update_(x);                                                      \
+    name##_update_(y);                                                      \
+                                                                            \
+    return y;                                                               \
+}                                                                           \
+                                                                            \
+/* restore heights and balance from n up to the root */                     \
+static inline                                                               \
+void name##_rebalance_(name##_t *t, name##_node_t *n) {                     \
+    int bf;                                                                 \
+                                                                            \
+    for (; n; n = n->parent) {                                              \
+        name##_update_(n);                                                  \
+        bf = name##_height_(n->left) - name##_height_(n->right);            \
+                                                                            \
+        if (bf > 1) {                                                       \
+            if (name##_height_(n->left->left) <                             \
+                name##_height_(n->left->right))                             \
+                name##_rotate_left_(t, n->left);                            \
+            n = name##_rotate_right_(t, n);                                 \
+        }                                                                   \
+        else if (bf < -1) {                                                 \
+            if (name##_height_(n->right->right) <                           \
+                name##_height_(n->right->left))                             \
+                name##_rotate_right_(t, n->right);                          \
+            n = name##_rotate_left_(t, n);                                  \
+        }                                                                   \
+    }                                                                       \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+void name##_init(name##_t *t) {                                             \
+    assert(t);                                                              \
+    t->root = NULL;                                                         \
+    t->count = 0;                                                           \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+size_t name##_count(const name##_t *t) {                                    \
+    return t ? t->count : 0;                                                \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+void name##_purge(name##_t *t) {                                            \
+    name##_node_t *n, *p;                                                   \
+                                                                            \
+    assert(t);                                                              \
+                                                                            \
+    for (n = t->root; n;) {                                                 \
+        if (n->left)                                                        \
+            n = n->left;                                                    \
+        else if (n->right)                                                  \
+            n = n->right;                                                   \
+        else {                                                              \
+            p = n->parent;                                                  \
+            name##_replace_child_(t, p, n, NULL);                           \
+            free(n);                                                        \
+            n = p;                                                          \
+        }                                                                   \
+    }                                                                       \
+                                                                            \
+    t->count = 0;                                                           \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+name##_node_t *name##_get(name##_t *t, key_type k) {                        \
+    name##_node_t *n;                                                       \
+                                                                            \
+    assert(t);                                                              \
+                                                                            \
+    for (n = t->root; n;) {                                                 \
+        if (less(k, n->key))                                                \
+            n = n->left;                                                    \
+        else if (less(n->key, k))                                           \
+            n = n->right;                                                   \
+        else                                                                \
+            break;                                                          \
+    }                                                                       \
+                                                                            \
+    return n;                                                               \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+name##_node_t *name##_add_or_get(name##_t *t, key_type k, bool *inserted) { \
+    name##_node_t *p = NULL, **link, *n;                                    \
+                                                                            \
+    assert(t && inserted);                                                  \
+                                                                            \
+    *inserted = false;                                                      \
+                                                                            \
+    for (link = &t->root; *link;) {                                         \
+        p = *link;                                                          \
+                                                                            \
+        if (less(k, p->key))                                                \
+            link = &p->left;                                                \
+        else if (less(p->key, k))                                           \
+            link = &p->right;                                               \
+        else                                                                \
+            return p;                                                       \
+    }                                                                       \
+                                                                            \
+    n = malloc(sizeof(*n));                                                 \
+                                                                            \
+    if (!n)                                                                 \
+        return NULL;                                                        \
+                                                                            \
+    n->left = n->right = NULL;                                              \
+    n->parent = p;                                                          \
+    n->height = 1;                                                          \
+    n->key = k;                                                             \
+    *link = n;                                                              \
+                                                                            \
+    ++t->count;                                                             \
+    *inserted = true;                                                       \
+                                                                            \
+    name##_rebalance_(t, p);                                                \
+                                                                            \
+    return n;                                                               \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+name##_node_t *name##_min(name##_node_t *n) {                               \
+    if (n)                                                                  \
+        while (n->left)                                                     \
+            n = n->left;                                                    \
+    return n;                                                               \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+name##_node_t *name##_max(name##_node_t *n) {                               \
+    if (n)                                                                  \
+        while (n->right)                                                    \
+            n = n->right;                                                   \
+    return n;                                                               \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+name##_node_t *name##_next(name##_node_t *n) {                              \
+    if (!n)                                                                 \
+        return NULL;                                                        \
+                                                                            \
+    if (n->right)                                                           \
+        return name##_min(n->right);                                        \
+                                                                            \
+    while (n->parent && n->parent->right == n)                              \
+        n = n->parent;                                                      \
+                                                                            \
+    return n->parent;                                                       \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+name##_node_t *name##_prev(name##_node_t *n) {                              \
+    if (!n)                                                                 \
+        return NULL;                                                        \
+                                                                            \
+    if (n->left)                                                            \
+        return name##_max(n->left);                                         \
+                                                                            \
+    while (n->parent && n->parent->left == n)                               \
+        n = n->parent;                                                      \
+                                                                            \
+    return n->parent;                                                       \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+void name##_remove_node(name##_t *t, name##_node_t *n) {                    \
+    name##_node_t *s, *fix;                                                 \
+                                                                            \
+    assert(t && n);                                                         \
+                                                                            \
+    if (n->left && n->right) {                                              \
+        /* successor takes place of the node, nodes are not copied */       \
+        s = name##_min(n->right);                                           \
+        fix = s->parent == n ? s : s->parent;                               \
+                                                                            \
+        if (s->parent != n) {                                               \
+            name##_replace_child_(t, s->parent, s, s->right);               \
+            s->right = n->right;                                            \
+            s->right->parent = s;                                           \
+        }                                                                   \
+                                                                            \
+        name##_replace_child_(t, n->parent, n, s);                          \
+        s->left = n->left;                                                  \
+        s->left->parent = s;                                                \
+    }                                                                       \
+    else {                                                                  \
+        fix = n->parent;                                                    \
+        name##_replace_child_(t, n->parent, n,                              \
+                              n->left ? n->left : n->right);                \
+    }                                                                       \
+                                                                            \
+    name##_rebalance_(t, fix);                                              \
+                                                                            \
+    free(n);                                                                \
+    --t->count;                                                             \
+}                                                                           \
+                                                                            \
+static inline                                                               \
+bool name##_remove(name##_t *t, key_type k) {                               \
+    name##_node_t *n = name##_get(t, k);                                    \
+                                                                            \
+    if (n)                                                                  \
+        name##_remove_node(t, n);                                           \
+                                                                            \
+    return !!n;                                                             \
+}
+
+#endif /* _CONTAINERS_TYPED_H_ */
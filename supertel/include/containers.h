@@ -3,7 +3,7 @@
 
 /** \file containers.h
  * Containers/collections library:
- * buffer, vector, array, list, queue, stack
+ * buffer, vector, array, list, deque (queue, stack)
  */
 
 # include <stddef.h>
@@ -16,7 +16,9 @@ enum buffer_policy {
     buffer_policy_max   = 3
 };
 
-/** Dumb buffer with shrinkability selection
+/** Dumb buffer with shrinkability selection.
+ * Buffer may be given caller-owned inline storage, it is used while
+ * the data fits and heap is touched only past it.
  */
 typedef struct buffer {
     enum buffer_policy pol;
@@ -28,6 +30,11 @@ typedef struct buffer {
     size_t real_size;
     /** offset for user's use */
     size_t offset;
+    /** caller-owned storage, NULL if none */
+    void *inline_data;
+    size_t inline_size;
+    /** real size never goes below this one */
+    size_t reserved;
 } buffer_t;
 
 /** A vector with dynamic size
@@ -56,21 +63,58 @@ struct list {
     size_t element_size;
 };
 
+/** A double-ended queue over circular buffer.
+ * Capacity is always a power of two, so index wrapping is a mask.
+ * Elements are stored inplace, no per-element allocation.
+ */
+typedef struct deque {
+    void *data;
+    size_t element_size;
+    /** allocated element slots, power of two or zero */
+    size_t capacity;
+    /** index of front element */
+    size_t head;
+    size_t count;
+} deque_t;
+
 /**** buffer operations ****/
 void buffer_init(buffer_t *b,
                  size_t size,
                  enum buffer_policy pol);
 
+/**
+ * Initialize buffer of zero size over caller-owned storage.
+ * \param [in] storage should outlive the buffer and not move,
+ *                     data goes to heap once it doesn't fit
+ */
+void buffer_init_inline(buffer_t *b,
+                        void *storage, size_t storage_size,
+                        enum buffer_policy pol);
+
 bool buffer_realloc(buffer_t *b, size_t newsize);
+/**
+ * Allocate at least \c capacity bytes and keep them
+ * until \c buffer_shrink_to_fit whatever the policy is.
+ */
+bool buffer_reserve(buffer_t *b, size_t capacity);
+/** Drop reservation and release memory past user size */
+bool buffer_shrink_to_fit(buffer_t *b);
 void buffer_deinit(buffer_t *b);
 
 /**** vector operations ****/
 void vector_init(vector_t *v, size_t size, size_t count);
+/** Initialize empty vector over caller-owned storage for \c storage_count elements */
+void vector_init_inline(vector_t *v, size_t size,
+                        void *storage, size_t storage_count);
 void vector_deinit(vector_t *v);
+bool vector_reserve(vector_t *v, size_t count);
+bool vector_shrink_to_fit(vector_t *v);
 void vector_remove(vector_t *v, size_t idx);
 void vector_remove_range(vector_t *v, size_t from, size_t count);
 void *vector_insert(vector_t *v, size_t idx);
 void *vector_append(vector_t *v);
+/** Append \c count elements with single reallocation, \return first of them */
+void *vector_append_n(vector_t *v, size_t count);
 void *vector_prepend(vector_t *v);
 void *vector_begin(vector_t *v);
 void *vector_end(vector_t *v);
@@ -93,4 +137,20 @@ list_element_t *list_end(list_t *l);
 list_element_t *list_next(list_t *l, list_element_t *el);
 list_element_t *list_prev(list_t *l, list_element_t *el);
 
+/**** deque operations ****/
+void deque_init(deque_t *d, size_t size, size_t capacity);
+void deque_deinit(deque_t *d);
+bool deque_reserve(deque_t *d, size_t capacity);
+void deque_clear(deque_t *d);
+size_t deque_count(const deque_t *d);
+void *deque_push_back(deque_t *d);
+void *deque_push_front(deque_t *d);
+bool deque_pop_back(deque_t *d, void *out);
+bool deque_pop_front(deque_t *d, void *out);
+size_t deque_push_back_n(deque_t *d, const void *src, size_t count);
+size_t deque_pop_front_n(deque_t *d, void *dst, size_t count);
+void *deque_front(deque_t *d);
+void *deque_back(deque_t *d);
+void *deque_get(deque_t *d, size_t idx);
+
 #endif
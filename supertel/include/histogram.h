@@ -0,0 +1,51 @@
+#ifndef _HISTOGRAM_H_
+# define _HISTOGRAM_H_
+
+/** \file histogram.h
+ * Log-linear histogram of unsigned 64-bit values.
+ * Each power of two range is split into \c HISTOGRAM_SUB_BUCKETS linear
+ * buckets, values below \c 2 * HISTOGRAM_SUB_BUCKETS are exact.
+ * Relative error is below <tt>1 / HISTOGRAM_SUB_BUCKETS</tt>.
+ *
+ * Single-thread implementation.
+ */
+
+# include <stdint.h>
+# include <stddef.h>
+# include <stdio.h>
+
+# define HISTOGRAM_SUB_BITS         (4)
+# define HISTOGRAM_SUB_BUCKETS      (1 << HISTOGRAM_SUB_BITS)
+# define HISTOGRAM_BUCKETS          \
+    ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct histogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+} histogram_t;
+
+void histogram_reset(histogram_t *h);
+void histogram_record(histogram_t *h, uint64_t value);
+
+/**
+ * Estimate quantile.
+ * \param [in] q quantile in <tt>[0, 1]</tt>
+ * \return upper bound of the bucket where quantile lies
+ */
+uint64_t histogram_quantile(const histogram_t *h, double q);
+
+/** Lowest value of bucket \c idx */
+uint64_t histogram_bucket_low(size_t idx);
+size_t histogram_bucket_index(uint64_t value);
+
+/**
+ * Print summary line (count, min, mean, p50, p90, p99, p99.9, max)
+ * followed by non-empty buckets if \c buckets is set.
+ */
+void histogram_print(const histogram_t *h, FILE *f,
+                     const char *name, int buckets);
+
+#endif /* _HISTOGRAM_H_ */
@@ -6,6 +6,10 @@
 # include <stdbool.h>
 # include <sys/epoll.h>
 
+# ifdef IO_SERVICE_STATS
+#  include <stdio.h>
+# endif
+
 # define IOSVC_JOB_ONESHOT true
 
 struct io_service;
@@ -37,6 +41,11 @@ struct io_service {
 
     int epoll_fd;
     struct epoll_event event_fd_event;
+
+# ifdef IO_SERVICE_STATS
+    /* see io_service_stats_dump */
+    struct io_service_stats *stats;
+# endif
 };
 
 void io_service_init(io_service_t *iosvc);
@@ -49,4 +58,23 @@ void io_service_post_job(io_service_t *iosvc,
 void io_service_remove_job(io_service_t *iosvc,
                            int fd, io_svc_op_t op);
 
+# ifdef IO_SERVICE_STATS
+/**
+ * Print event loop histograms (nanoseconds):
+ * time blocked in epoll_wait, events per wakeup (up to 64 are fetched
+ * at once), loop iteration duration and per-job callback duration keyed
+ * by job function.
+ * \param [in] buckets print non-empty buckets too
+ */
+void io_service_stats_dump(io_service_t *iosvc, FILE *f, bool buckets);
+void io_service_stats_reset(io_service_t *iosvc);
+
+/**
+ * Dump stats to stderr whenever \c signo is caught.
+ * The signal is blocked and awaited with signalfd within the IO service.
+ * \return \c true on success
+ */
+bool io_service_stats_dump_on_signal(io_service_t *iosvc, int signo);
+# endif
+
 #endif /* _IO_SERVICE_H_ */
\ No newline at end of file
@@ -0,0 +1,155 @@
+#ifndef _LOCKFREE_QUEUE_H_
+# define _LOCKFREE_QUEUE_H_
+
+/** \file lockfree-queue.h
+ * Bounded lock-free queues for passing work between threads.
+ *
+ * \c spsc_queue_t is a single-producer single-consumer ring.
+ * \c mpsc_queue_t is a multi-producer single-consumer ring
+ * (per-cell sequence numbers, producers claim cells with CAS).
+ *
+ * Elements are copied in and out, element size is set at init.
+ * Capacity is rounded up to a power of two.
+ * Indices owned by different sides live on different cache lines.
+ *
+ * \c queue_waker_t is an eventfd to wake the consumer running
+ * within an IO service:
+ * \code
+ * producer:                        consumer job on waker fd:
+ *   spsc_queue_push(q, &el);         queue_waker_consume(w);
+ *   queue_waker_signal(w);           for (;;) {
+ *                                        while (spsc_queue_pop(q, &el))
+ *                                            handle(&el);
+ *                                        queue_waker_prepare_sleep(w);
+ *                                        if (spsc_queue_empty(q))
+ *                                            break;
+ *                                        queue_waker_cancel_sleep(w);
+ *                                    }
+ * \endcode
+ */
+
+# include "io-service.h"
+
+# include <stddef.h>
+# include <stdbool.h>
+# include <stdatomic.h>
+
+# define LOCKFREE_CACHE_LINE        (64)
+
+typedef struct spsc_queue {
+    /* consumer side */
+    _Alignas(LOCKFREE_CACHE_LINE) atomic_size_t head;
+    /** consumer's copy of tail */
+    size_t tail_cache;
+
+    /* producer side */
+    _Alignas(LOCKFREE_CACHE_LINE) atomic_size_t tail;
+    /** producer's copy of head */
+    size_t head_cache;
+
+    /* read only after init */
+    _Alignas(LOCKFREE_CACHE_LINE) unsigned char *data;
+    size_t element_size;
+    size_t mask;
+} spsc_queue_t;
+
+typedef struct mpsc_queue {
+    /* consumer side */
+    _Alignas(LOCKFREE_CACHE_LINE) atomic_size_t head;
+
+    /* producers side */
+    _Alignas(LOCKFREE_CACHE_LINE) atomic_size_t tail;
+
+    /* read only after init */
+    _Alignas(LOCKFREE_CACHE_LINE) unsigned char *cells;
+    size_t element_size;
+    /** cell is sequence number followed by element */
+    size_t cell_size;
+    size_t mask;
+} mpsc_queue_t;
+
+typedef struct queue_waker {
+    int fd;
+    /** consumer is about to sleep or sleeps */
+    _Alignas(LOCKFREE_CACHE_LINE) atomic_bool sleeping;
+} queue_waker_t;
+
+/**** SPSC queue ****/
+bool spsc_queue_init(spsc_queue_t *q, size_t element_size, size_t capacity);
+void spsc_queue_deinit(spsc_queue_t *q);
+size_t spsc_queue_capacity(const spsc_queue_t *q);
+/** Approximate when called concurrently */
+size_t spsc_queue_count(spsc_queue_t *q);
+bool spsc_queue_empty(spsc_queue_t *q);
+
+/** \return \c false if the queue is full */
+bool spsc_queue_push(spsc_queue_t *q, const void *el);
+/** \return \c false if the queue is empty */
+bool spsc_queue_pop(spsc_queue_t *q, void *out);
+/**
+ * Push up to \c count elements with a single index update.
+ * \return number of elements pushed
+ */
+size_t spsc_queue_push_n(spsc_queue_t *q, const void *src, size_t count);
+/**
+ * Pop up to \c count elements with a single index update.
+ * \return number of elements popped
+ */
+size_t spsc_queue_pop_n(spsc_queue_t *q, void *dst, size_t count);
+
+/**** MPSC queue ****/
+bool mpsc_queue_init(mpsc_queue_t *q, size_t element_size, size_t capacity);
+void mpsc_queue_deinit(mpsc_queue_t *q);
+size_t mpsc_queue_capacity(const mpsc_queue_t *q);
+/** Approximate when called concurrently */
+size_t mpsc_queue_count(mpsc_queue_t *q);
+/** Consumer only. Claimed but not yet published cells count as empty */
+bool mpsc_queue_empty(mpsc_queue_t *q);
+
+/** Any thread. \return \c false if the queue is full */
+bool mpsc_queue_push(mpsc_queue_t *q, const void *el);
+/**
+ * Any thread. Claims up to \c count consecutive cells with a single CAS.
+ * \return number of elements pushed
+ */
+size_t mpsc_queue_push_n(mpsc_queue_t *q, const void *src, size_t count);
+/** Consumer only. \return \c false if the queue is empty */
+bool mpsc_queue_pop(mpsc_queue_t *q, void *out);
+/**
+ * Consumer only. Pops published elements up to \c count.
+ * \return number of elements popped
+ */
+size_t mpsc_queue_pop_n(mpsc_queue_t *q, void *dst, size_t count);
+
+/**** Consumer wakeup ****/
+bool queue_waker_init(queue_waker_t *w);
+void queue_waker_deinit(queue_waker_t *w);
+
+/**
+ * Post consumer job on waker's fd to IO service.
+ * Job is persistent and called whenever producers signal.
+ */
+void queue_waker_post(queue_waker_t *w, io_service_t *iosvc,
+                      iosvc_job_function_t job, void *ctx);
+void queue_waker_remove(queue_waker_t *w, io_service_t *iosvc);
+
+/**
+ * Producer side, after push.
+ * Writes to eventfd only if consumer went to sleep.
+ */
+void queue_waker_signal(queue_waker_t *w);
+
+/** Consumer side, clears eventfd counter. */
+void queue_waker_consume(queue_waker_t *w);
+
+/**
+ * Consumer side, when drained.
+ * Queue must be checked once more after this call, producers that pushed
+ * before the flag was raised don't signal.
+ */
+void queue_waker_prepare_sleep(queue_waker_t *w);
+
+/** Consumer side, queue turned out not empty after prepare */
+void queue_waker_cancel_sleep(queue_waker_t *w);
+
+#endif /* _LOCKFREE_QUEUE_H_ */
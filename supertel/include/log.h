@@ -1,26 +1,195 @@
 #ifndef _LOG_H_
 # define _LOG_H_
 
+/** \file log.h
+ * Logging facility.
+ *
+ * Messages below \c LOG_COMPILE_LEVEL are dropped at compile time,
+ * their arguments are not evaluated.
+ *
+ * A logging call doesn't format anything. It stores a binary record
+ * (format string address, timestamp and arguments) to the calling
+ * thread's lock-free ring. Records are formatted and written to stderr
+ * by the drainer thread (see \c log_async_start) or by \c log_flush.
+ * Without running drainer the record is flushed in place.
+ * Fatal messages are always flushed before the call returns.
+ *
+ * Strings are copied into the record (up to \c LOG_MAX_STRING_LEN bytes),
+ * so volatile buffers (\c inet_ntoa, \c strerror) are safe to pass.
+ */
+
 # include <stdio.h>
+# include <stdint.h>
+# include <stddef.h>
+# include <stdbool.h>
+
+# define LOG_LEVEL_DEBUG    0
+# define LOG_LEVEL_INFO     1
+# define LOG_LEVEL_WARN     2
+# define LOG_LEVEL_ERROR    3
+# define LOG_LEVEL_FATAL    4
+
+# ifndef LOG_COMPILE_LEVEL
+#  define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+# endif
+
+/** record is printed without level and timestamp prefix */
+# define LOG_RAW            0x80
+
+/** per-thread ring size, power of two */
+# define LOG_RING_SIZE      (1 << 16)
+# define LOG_MAX_STRING_LEN (256)
+# define LOG_MAX_ARGS       (16)
+
+typedef enum log_arg_type {
+    LOG_ARG_SIGNED      = 0,
+    LOG_ARG_UNSIGNED    = 1,
+    LOG_ARG_DOUBLE      = 2,
+    LOG_ARG_STRING      = 3,
+    LOG_ARG_POINTER     = 4
+} log_arg_type_t;
+
+typedef struct log_arg {
+    uint8_t type;
+    /** size of original argument, used to truncate unsigned conversions */
+    uint8_t size;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const void *p;
+        const char *s;
+    } v;
+} log_arg_t;
+
+static inline
+log_arg_t log_arg_signed(long long v, size_t size) {
+    log_arg_t a = { .type = LOG_ARG_SIGNED, .size = size, .v.i = v };
+    return a;
+}
+
+static inline
+log_arg_t log_arg_unsigned(unsigned long long v, size_t size) {
+    log_arg_t a = { .type = LOG_ARG_UNSIGNED, .size = size, .v.u = v };
+    return a;
+}
 
-# define LOG_LEVEL_DEBUG    "[debug]  "
-# define LOG_LEVEL_INFO     "[info]   "
-# define LOG_LEVEL_WARN     "[warn]   "
-# define LOG_LEVEL_ERROR    "[error]  "
-# define LOG_LEVEL_FATAL    "[fatal]  "
+static inline
+log_arg_t log_arg_double(double v, size_t size) {
+    log_arg_t a = { .type = LOG_ARG_DOUBLE, .size = size, .v.d = v };
+    return a;
+}
 
-# define LOG(level, msg, ...)                     \
-do {                                              \
-    fprintf(stderr, level "[%10d] ", time(NULL)); \
-    fprintf(stderr, msg, __VA_ARGS__);            \
+static inline
+log_arg_t log_arg_string(const char *v, size_t size) {
+    log_arg_t a = { .type = LOG_ARG_STRING, .size = size, .v.s = v };
+    return a;
+}
+
+/* uint8_t buffers hold text as well */
+static inline
+log_arg_t log_arg_ustring(const unsigned char *v, size_t size) {
+    return log_arg_string((const char *)v, size);
+}
+
+static inline
+log_arg_t log_arg_pointer(const void *v, size_t size) {
+    log_arg_t a = { .type = LOG_ARG_POINTER, .size = size, .v.p = v };
+    return a;
+}
+
+# define LOG_ARG(x)                                 \
+_Generic((x),                                       \
+    _Bool:                  log_arg_unsigned,       \
+    char:                   log_arg_signed,         \
+    signed char:            log_arg_signed,         \
+    unsigned char:          log_arg_unsigned,       \
+    short:                  log_arg_signed,         \
+    unsigned short:         log_arg_unsigned,       \
+    int:                    log_arg_signed,         \
+    unsigned int:           log_arg_unsigned,       \
+    long:                   log_arg_signed,         \
+    unsigned long:          log_arg_unsigned,       \
+    long long:              log_arg_signed,         \
+    unsigned long long:     log_arg_unsigned,       \
+    float:                  log_arg_double,         \
+    double:                 log_arg_double,         \
+    char *:                 log_arg_string,         \
+    const char *:           log_arg_string,         \
+    unsigned char *:        log_arg_ustring,        \
+    const unsigned char *:  log_arg_ustring,        \
+    default:                log_arg_pointer         \
+)((x), sizeof(x))
+
+/* argument list mapping, up to LOG_MAX_ARGS arguments */
+# define LOG_CAT_(a, b)     a##b
+# define LOG_CAT(a, b)      LOG_CAT_(a, b)
+# define LOG_NARG_(_1, _2, _3, _4, _5, _6, _7, _8,                          \
+                   _9, _10, _11, _12, _13, _14, _15, _16, N, ...) N
+# define LOG_NARG(...)                                                      \
+    LOG_NARG_(__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9,                   \
+              8, 7, 6, 5, 4, 3, 2, 1, 0)
+# define LOG_MAP_1(x)       LOG_ARG(x)
+# define LOG_MAP_2(x, ...)  LOG_ARG(x), LOG_MAP_1(__VA_ARGS__)
+# define LOG_MAP_3(x, ...)  LOG_ARG(x), LOG_MAP_2(__VA_ARGS__)
+# define LOG_MAP_4(x, ...)  LOG_ARG(x), LOG_MAP_3(__VA_ARGS__)
+# define LOG_MAP_5(x, ...)  LOG_ARG(x), LOG_MAP_4(__VA_ARGS__)
+# define LOG_MAP_6(x, ...)  LOG_ARG(x), LOG_MAP_5(__VA_ARGS__)
+# define LOG_MAP_7(x, ...)  LOG_ARG(x), LOG_MAP_6(__VA_ARGS__)
+# define LOG_MAP_8(x, ...)  LOG_ARG(x), LOG_MAP_7(__VA_ARGS__)
+# define LOG_MAP_9(x, ...)  LOG_ARG(x), LOG_MAP_8(__VA_ARGS__)
+# define LOG_MAP_10(x, ...) LOG_ARG(x), LOG_MAP_9(__VA_ARGS__)
+# define LOG_MAP_11(x, ...) LOG_ARG(x), LOG_MAP_10(__VA_ARGS__)
+# define LOG_MAP_12(x, ...) LOG_ARG(x), LOG_MAP_11(__VA_ARGS__)
+# define LOG_MAP_13(x, ...) LOG_ARG(x), LOG_MAP_12(__VA_ARGS__)
+# define LOG_MAP_14(x, ...) LOG_ARG(x), LOG_MAP_13(__VA_ARGS__)
+# define LOG_MAP_15(x, ...) LOG_ARG(x), LOG_MAP_14(__VA_ARGS__)
+# define LOG_MAP_16(x, ...) LOG_ARG(x), LOG_MAP_15(__VA_ARGS__)
+# define LOG_ARGS(...)                                                      \
+    LOG_CAT(LOG_MAP_, LOG_NARG(__VA_ARGS__))(__VA_ARGS__)
+
+# define LOG(level, msg, ...)                                               \
+do {                                                                        \
+    if ((level) >= LOG_COMPILE_LEVEL) {                                     \
+        const log_arg_t _log_args[] = { LOG_ARGS(__VA_ARGS__) };            \
+        log_record((level), (msg), _log_args,                               \
+                   sizeof(_log_args) / sizeof(_log_args[0]));               \
+    }                                                                       \
 } while (0)
 
-# define LOG_MSG(level, msg)                      \
-do {                                              \
-    fprintf(stderr, level "[%10d] ", time(NULL)); \
-    fprintf(stderr, msg);                         \
+# define LOG_MSG(level, msg)                                                \
+do {                                                                        \
+    if ((level) >= LOG_COMPILE_LEVEL)                                       \
+        log_record((level), (msg), NULL, 0);                                \
 } while (0)
 
-# define LOG_LN()           fprintf(stderr, "\n")
+# define LOG_LN()           log_record(LOG_RAW, "\n", NULL, 0)
+
+/**
+ * Store a record to calling thread's ring.
+ * \param [in] level message level, optionally or'ed with \c LOG_RAW
+ * \param [in] fmt \c printf-like format string with static storage
+ * \param [in] args arguments
+ * \param [in] nargs arguments count
+ */
+void log_record(int level, const char *fmt,
+                const log_arg_t *args, size_t nargs);
+
+/**
+ * Format and write all pending records of all threads.
+ */
+void log_flush(void);
+
+/**
+ * Start background drainer thread.
+ * Pending records are flushed at exit.
+ * \return \c true on success, \c false on failure
+ */
+bool log_async_start(void);
+
+/**
+ * Stop background drainer thread and flush pending records.
+ */
+void log_async_stop(void);
 
-#endif /* _LOG_H_ */
\ No newline at end of file
+#endif /* _LOG_H_ */
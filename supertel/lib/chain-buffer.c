@@ -0,0 +1,484 @@
+#include "chain-buffer.h"
+#include "containers.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+static
+cbuf_segment_t *segment_alloc(size_t size, size_t headroom) {
+    cbuf_segment_t *seg = malloc(sizeof(cbuf_segment_t) + size);
+
+    if (!seg)
+        return NULL;
+
+    seg->refcount = 1;
+    seg->size = size;
+    seg->begin = seg->end = headroom < size ? headroom : 0;
+    seg->data = (uint8_t *)(seg + 1);
+
+    return seg;
+}
+
+static inline
+void segment_release(cbuf_segment_t *seg) {
+    assert(seg && seg->refcount);
+
+    if (--seg->refcount)
+        return;
+
+    /* adopted memory lives apart from the segment header */
+    if (seg->data != (uint8_t *)(seg + 1))
+        free(seg->data);
+
+    free(seg);
+}
+
+static inline
+cbuf_slice_t *tail_slice(chain_buffer_t *cb) {
+    return (cbuf_slice_t *)deque_back(&cb->slices);
+}
+
+/* free bytes at the end of tail slice which this chain may write to */
+static inline
+size_t tail_spare(chain_buffer_t *cb) {
+    cbuf_slice_t *sl = tail_slice(cb);
+
+    if (!sl || sl->offset + sl->len != sl->seg->end)
+        return 0;
+
+    return sl->seg->size - sl->seg->end;
+}
+
+static
+cbuf_slice_t *push_segment(chain_buffer_t *cb, size_t size) {
+    cbuf_segment_t *seg;
+    cbuf_slice_t *sl;
+
+    seg = segment_alloc(
+        size,
+        deque_count(&cb->slices) ? 0 : CHAIN_BUFFER_HEADROOM
+    );
+
+    if (!seg)
+        return NULL;
+
+    sl = (cbuf_slice_t *)deque_push_back(&cb->slices);
+    sl->seg = seg;
+    sl->offset = seg->end;
+    sl->len = 0;
+
+    return sl;
+}
+
+/**************** API ****************/
+void chain_buffer_init(chain_buffer_t *cb, size_t segment_size) {
+    assert(cb);
+
+    deque_init(&cb->slices, sizeof(cbuf_slice_t), 0);
+    cb->length = 0;
+    cb->segment_size = segment_size ? segment_size : CHAIN_BUFFER_SEGMENT_SIZE;
+}
+
+void chain_buffer_deinit(chain_buffer_t *cb) {
+    assert(cb);
+
+    chain_buffer_consume(cb, cb->length);
+    deque_deinit(&cb->slices);
+}
+
+size_t chain_buffer_length(const chain_buffer_t *cb) {
+    return cb ? cb->length : 0;
+}
+
+bool chain_buffer_append(chain_buffer_t *cb, const void *d, size_t len) {
+    size_t spare, chunk;
+    cbuf_slice_t *sl;
+
+    assert(cb && (d || !len));
+
+    while (len) {
+        spare = tail_spare(cb);
+
+        if (spare)
+            sl = tail_slice(cb);
+        else {
+            sl = push_segment(cb, len > cb->segment_size
+                                  ? len : cb->segment_size);
+            if (!sl)
+                return false;
+
+            spare = sl->seg->size - sl->seg->end;
+        }
+
+        chunk = spare < len ? spare : len;
+
+        memcpy(sl->seg->data + sl->seg->end, d, chunk);
+        sl->seg->end += chunk;
+        sl->len += chunk;
+        cb->length += chunk;
+
+        d = (const uint8_t *)d + chunk;
+        len -= chunk;
+    }
+
+    return true;
+}
+
+void *chain_buffer_append_space(chain_buffer_t *cb, size_t len) {
+    cbuf_slice_t *sl;
+    void *space;
+
+    assert(cb);
+
+    if (tail_spare(cb) >= len)
+        sl = tail_slice(cb);
+    else {
+        sl = push_segment(cb, len > cb->segment_size ? len : cb->segment_size);
+        if (!sl)
+            return NULL;
+    }
+
+    space = sl->seg->data + sl->seg->end;
+    sl->seg->end += len;
+    sl->len += len;
+    cb->length += len;
+
+    return space;
+}
+
+bool chain_buffer_prepend(chain_buffer_t *cb, const void *d, size_t len) {
+    cbuf_slice_t *sl;
+    cbuf_segment_t *seg;
+
+    assert(cb && (d || !len));
+
+    if (!len)
+        return true;
+
+    sl = (cbuf_slice_t *)deque_front(&cb->slices);
+
+    /* use headroom if nobody else references bytes before the slice */
+    if (sl && sl->offset == sl->seg->begin && sl->seg->begin >= len) {
+        sl->seg->begin -= len;
+        sl->offset -= len;
+        sl->len += len;
+        memcpy(sl->seg->data + sl->offset, d, len);
+        cb->length += len;
+
+        return true;
+    }
+
+    seg = segment_alloc(len, 0);
+
+    if (!seg)
+        return false;
+
+    memcpy(seg->data, d, len);
+    seg->end = len;
+
+    sl = (cbuf_slice_t *)deque_push_front(&cb->slices);
+    sl->seg = seg;
+    sl->offset = 0;
+    sl->len = len;
+    cb->length += len;
+
+    return true;
+}
+
+bool chain_buffer_adopt(chain_buffer_t *cb, void *mem, size_t len) {
+    cbuf_segment_t *seg;
+    cbuf_slice_t *sl;
+
+    assert(cb);
+
+    if (!len) {
+        free(mem);
+        return true;
+    }
+
+    seg = malloc(sizeof(*seg));
+
+    if (!seg)
+        return false;
+
+    seg->refcount = 1;
+    seg->size = seg->end = len;
+    seg->begin = 0;
+    seg->data = mem;
+
+    sl = (cbuf_slice_t *)deque_push_back(&cb->slices);
+    sl->seg = seg;
+    sl->offset = 0;
+    sl->len = len;
+    cb->length += len;
+
+    return true;
+}
+
+void chain_buffer_append_chain(chain_buffer_t *dst, chain_buffer_t *src) {
+    cbuf_slice_t sl;
+
+    assert(dst && src);
+
+    while (deque_pop_front(&src->slices, &sl))
+        *(cbuf_slice_t *)deque_push_back(&dst->slices) = sl;
+
+    dst->length += src->length;
+    src->length = 0;
+}
+
+bool chain_buffer_split(chain_buffer_t *cb, size_t at, chain_buffer_t *head) {
+    cbuf_slice_t *sl, *hsl;
+
+    assert(cb && head);
+
+    if (at > cb->length)
+        return false;
+
+    while (at) {
+        sl = (cbuf_slice_t *)deque_front(&cb->slices);
+
+        if (sl->len <= at) {
+            at -= sl->len;
+            cb->length -= sl->len;
+            head->length += sl->len;
+
+            hsl = (cbuf_slice_t *)deque_push_back(&head->slices);
+            deque_pop_front(&cb->slices, hsl);
+            continue;
+        }
+
+        /* boundary segment is shared by both chains */
+        ++sl->seg->refcount;
+
+        hsl = (cbuf_slice_t *)deque_push_back(&head->slices);
+        hsl->seg = sl->seg;
+        hsl->offset = sl->offset;
+        hsl->len = at;
+
+        sl->offset += at;
+        sl->len -= at;
+
+        cb->length -= at;
+        head->length += at;
+        at = 0;
+    }
+
+    return true;
+}
+
+size_t chain_buffer_consume(chain_buffer_t *cb, size_t len) {
+    size_t consumed = 0;
+    cbuf_slice_t *sl;
+
+    assert(cb);
+
+    while (len && deque_count(&cb->slices)) {
+        sl = (cbuf_slice_t *)deque_front(&cb->slices);
+
+        if (sl->len <= len) {
+            len -= sl->len;
+            consumed += sl->len;
+            segment_release(sl->seg);
+            deque_pop_front(&cb->slices, NULL);
+            continue;
+        }
+
+        sl->offset += len;
+        sl->len -= len;
+        consumed += len;
+        len = 0;
+    }
+
+    cb->length -= consumed;
+
+    return consumed;
+}
+
+size_t chain_buffer_copy_out(const chain_buffer_t *cb, size_t offset,
+                             void *dst, size_t len) {
+    size_t idx, chunk, copied = 0;
+    const cbuf_slice_t *sl;
+
+    assert(cb && (dst || !len));
+
+    for (idx = 0; idx < deque_count(&cb->slices) && len; ++idx) {
+        sl = (const cbuf_slice_t *)deque_get((deque_t *)&cb->slices, idx);
+
+        if (offset >= sl->len) {
+            offset -= sl->len;
+            continue;
+        }
+
+        chunk = sl->len - offset;
+        if (chunk > len)
+            chunk = len;
+
+        memcpy((uint8_t *)dst + copied, sl->seg->data + sl->offset + offset,
+               chunk);
+
+        copied += chunk;
+        len -= chunk;
+        offset = 0;
+    }
+
+    return copied;
+}
+
+const void *chain_buffer_contiguous(const chain_buffer_t *cb, size_t len) {
+    const cbuf_slice_t *sl;
+
+    assert(cb);
+
+    sl = (const cbuf_slice_t *)deque_front((deque_t *)&cb->slices);
+
+    if (!sl || sl->len < len)
+        return NULL;
+
+    return sl->seg->data + sl->offset;
+}
+
+int chain_buffer_iovec(const chain_buffer_t *cb,
+                       struct iovec *iov, int max_iov) {
+    int idx, count;
+    const cbuf_slice_t *sl;
+
+    assert(cb && (iov || !max_iov));
+
+    count = deque_count(&cb->slices) < (size_t)max_iov
+            ? (int)deque_count(&cb->slices) : max_iov;
+
+    for (idx = 0; idx < count; ++idx) {
+        sl = (const cbuf_slice_t *)deque_get((deque_t *)&cb->slices, idx);
+        iov[idx].iov_base = sl->seg->data + sl->offset;
+        iov[idx].iov_len = sl->len;
+    }
+
+    return count;
+}
+
+ssize_t chain_buffer_writev(int fd, chain_buffer_t *cb) {
+    struct iovec iov[CHAIN_BUFFER_MAX_IOV];
+    int count;
+    ssize_t wrote;
+
+    assert(cb);
+
+    count = chain_buffer_iovec(cb, iov, CHAIN_BUFFER_MAX_IOV);
+
+    if (!count)
+        return 0;
+
+    wrote = writev(fd, iov, count);
+
+    if (wrote > 0)
+        chain_buffer_consume(cb, wrote);
+
+    return wrote;
+}
+
+ssize_t chain_buffer_sendmsg(int fd, chain_buffer_t *cb, int flags) {
+    struct iovec iov[CHAIN_BUFFER_MAX_IOV];
+    struct msghdr msg;
+    ssize_t sent;
+
+    assert(cb);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = chain_buffer_iovec(cb, iov, CHAIN_BUFFER_MAX_IOV);
+
+    if (!msg.msg_iovlen)
+        return 0;
+
+    sent = sendmsg(fd, &msg, flags);
+
+    if (sent > 0)
+        chain_buffer_consume(cb, sent);
+
+    return sent;
+}
+
+ssize_t chain_buffer_readv(int fd, chain_buffer_t *cb, size_t max) {
+    struct iovec iov[2];
+    int count = 0;
+    size_t spare, rest;
+    ssize_t bytes_read, in_tail;
+    cbuf_slice_t *tail = NULL;
+    cbuf_segment_t *fresh = NULL;
+    cbuf_slice_t *sl;
+
+    assert(cb);
+
+    if (!max)
+        return 0;
+
+    spare = tail_spare(cb);
+
+    if (spare > max)
+        spare = max;
+
+    if (spare) {
+        tail = tail_slice(cb);
+        iov[count].iov_base = tail->seg->data + tail->seg->end;
+        iov[count].iov_len = spare;
+        ++count;
+    }
+
+    rest = max - spare;
+
+    if (rest) {
+        fresh = segment_alloc(rest > cb->segment_size
+                              ? cb->segment_size : rest, 0);
+
+        if (!fresh && !count) {
+            errno = ENOMEM;
+            return -1;
+        }
+
+        if (fresh) {
+            iov[count].iov_base = fresh->data;
+            iov[count].iov_len = fresh->size;
+            ++count;
+        }
+    }
+
+    bytes_read = readv(fd, iov, count);
+
+    if (bytes_read <= 0) {
+        if (fresh)
+            segment_release(fresh);
+
+        return bytes_read;
+    }
+
+    in_tail = (size_t)bytes_read < spare ? bytes_read : (ssize_t)spare;
+
+    if (in_tail) {
+        tail->seg->end += in_tail;
+        tail->len += in_tail;
+    }
+
+    if (fresh) {
+        if (bytes_read > in_tail) {
+            fresh->end = bytes_read - in_tail;
+
+            sl = (cbuf_slice_t *)deque_push_back(&cb->slices);
+            sl->seg = fresh;
+            sl->offset = 0;
+            sl->len = fresh->end;
+        }
+        else
+            segment_release(fresh);
+    }
+
+    cb->length += bytes_read;
+
+    return bytes_read;
+}
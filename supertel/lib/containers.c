@@ -20,46 +20,89 @@ static const void const *POST_BACK_PTR = &_POST_BACK;
 
 typedef bool (*reallocer_func)(buffer_t *b, size_t newsize);
 
+static inline
+bool is_inline(const buffer_t *b) {
+    return b->inline_data && b->data == b->inline_data;
+}
+
+/* set allocated size to rs moving data between inline storage and heap */
 static
-bool realloc_shrinkable(buffer_t *b, size_t newsize) {
+bool resize_storage(buffer_t *b, size_t rs) {
+    size_t keep = b->user_size < rs ? b->user_size : rs;
     void *d;
-    assert(b);
-    d = realloc(b->data, newsize);
 
-    if (d) {
-        b->user_size = b->real_size = newsize;
-        b->data = d;
+    if (rs < b->reserved)
+        rs = b->reserved;
+
+    if (b->inline_data && rs <= b->inline_size) {
+        if (!is_inline(b)) {
+            memcpy(b->inline_data, b->data, keep);
+            free(b->data);
+            b->data = b->inline_data;
+        }
+
+        b->real_size = b->inline_size;
+        return true;
+    }
+
+    if (!rs) {
+        free(b->data);
+        b->data = NULL;
+        b->real_size = 0;
+        return true;
     }
 
+    if (is_inline(b)) {
+        d = malloc(rs);
+
+        if (d)
+            memcpy(d, b->data, keep);
+    }
+    else
+        d = realloc(b->data, rs);
+
+    if (!d)
+        return false;
+
+    b->data = d;
+    b->real_size = rs;
+
+    return true;
+}
+
+static
+bool realloc_shrinkable(buffer_t *b, size_t newsize) {
+    bool ret;
+
+    assert(b);
+
+    ret = resize_storage(b, newsize);
+
+    if (ret)
+        b->user_size = newsize;
+
     if (b->offset > newsize)
         b->offset = newsize;
 
-    return !!d;
+    return ret;
 }
 
 static
 bool realloc_nonshrinkable(buffer_t *b, size_t newsize) {
-    void *d;
+    bool ret = true;
 
     assert(b);
 
-    if (newsize < b->real_size) {
-        b->user_size = newsize;
-        return true;
-    }
+    if (newsize > b->real_size)
+        ret = resize_storage(b, newsize);
 
-    d = realloc(b->data, newsize);
-
-    if (d) {
+    if (ret)
         b->user_size = newsize;
-        b->real_size = newsize;
-        b->data = d;
-    }
 
     if (b->offset > newsize)
         b->offset = newsize;
 
-    return !!d;
+    return ret;
 }
 
 static
@@ -69,7 +112,7 @@ bool realloc_economic(buffer_t *b, size_t newsize) {
     size_t lesser = b->real_size / 2;
     size_t greater = b->real_size * 2;
     size_t rs;
-    void *d;
+    bool ret;
 
     if (newsize < b->real_size / 4)
         rs = lesser;
@@ -88,18 +131,15 @@ bool realloc_economic(buffer_t *b, size_t newsize) {
         return true;
     }
 
-    d = realloc(b->data, rs);
+    ret = resize_storage(b, rs);
 
-    if (d) {
+    if (ret)
         b->user_size = newsize;
-        b->real_size = rs;
-        b->data = d;
-    }
 
     if (b->offset > newsize)
         b->offset = newsize;
 
-    return !!d;
+    return ret;
 }
 
 static const reallocer_func reallocer[buffer_policy_max] = {
@@ -116,6 +156,24 @@ void buffer_init(buffer_t *b, size_t size, enum buffer_policy pol) {
     b->real_size = b->user_size = size;
     b->data = size ? malloc(b->user_size) : NULL;
     b->offset = 0;
+    b->inline_data = NULL;
+    b->inline_size = 0;
+    b->reserved = 0;
+}
+
+void buffer_init_inline(buffer_t *b,
+                        void *storage, size_t storage_size,
+                        enum buffer_policy pol) {
+    assert(b && pol < buffer_policy_max && (storage || !storage_size));
+
+    b->pol = pol;
+    b->user_size = 0;
+    b->real_size = storage_size;
+    b->data = storage;
+    b->offset = 0;
+    b->inline_data = storage;
+    b->inline_size = storage_size;
+    b->reserved = 0;
 }
 
 bool buffer_realloc(buffer_t *b, size_t newsize) {
@@ -123,13 +181,34 @@ bool buffer_realloc(buffer_t *b, size_t newsize) {
     return reallocer[b->pol](b, newsize);
 }
 
+bool buffer_reserve(buffer_t *b, size_t capacity) {
+    assert(b);
+
+    if (capacity > b->real_size && !resize_storage(b, capacity))
+        return false;
+
+    b->reserved = capacity;
+
+    return true;
+}
+
+bool buffer_shrink_to_fit(buffer_t *b) {
+    assert(b);
+
+    b->reserved = 0;
+
+    return resize_storage(b, b->user_size);
+}
+
 void buffer_deinit(buffer_t *b) {
     assert(b);
 
-    if (b->data)
+    if (b->data && !is_inline(b))
         free(b->data);
 
+    b->data = NULL;
     b->user_size = b->real_size = 0;
+    b->reserved = 0;
 }
 
 /***************************** VECTOR *****************************/
@@ -140,6 +219,24 @@ void vector_init(vector_t *v, size_t size, size_t count) {
     buffer_init(&v->data, size * count, bp_economic);
 }
 
+void vector_init_inline(vector_t *v, size_t size,
+                        void *storage, size_t storage_count) {
+    assert(v);
+    v->element_size = size;
+    v->count = 0;
+    buffer_init_inline(&v->data, storage, size * storage_count, bp_economic);
+}
+
+bool vector_reserve(vector_t *v, size_t count) {
+    assert(v);
+    return buffer_reserve(&v->data, count * v->element_size);
+}
+
+bool vector_shrink_to_fit(vector_t *v) {
+    assert(v);
+    return buffer_shrink_to_fit(&v->data);
+}
+
 void vector_remove(vector_t *v, size_t idx) {
     size_t shifting;
     void *newpos;
@@ -196,16 +293,18 @@ void *vector_insert(vector_t *v, size_t idx) {
     assert(v);
     assert(idx <= v->count);
 
-    newelement = v->data.data + v->element_size * idx;
-    newpos = newelement + v->element_size;
     shifting = v->element_size * (v->count - idx);
 
     ++v->count;
 
-    realloced = buffer_realloc(&v->data, v->element_size * (v->count + 1));
+    realloced = buffer_realloc(&v->data, v->element_size * v->count);
 
     assert(realloced);
 
+    /* data may have moved */
+    newelement = v->data.data + v->element_size * idx;
+    newpos = newelement + v->element_size;
+
     memmove(newpos, newelement, shifting);
 
     return newelement;
@@ -226,6 +325,22 @@ void *vector_append(vector_t *v) {
     return d;
 }
 
+void *vector_append_n(vector_t *v, size_t count) {
+    assert(v);
+
+    size_t filled = v->element_size * v->count;
+    void *d;
+    bool realloc_ret = buffer_realloc(&v->data,
+                                      filled + count * v->element_size);
+
+    assert(realloc_ret);
+
+    d = v->data.data + filled;
+    v->count += count;
+
+    return d;
+}
+
 void *vector_prepend(vector_t *v) {
     assert(v);
 
@@ -532,3 +647,224 @@ list_element_t *list_prev(list_t *l, list_element_t *el) {
             ? l->back : el->prev);
     return prev;
 }
+
+/***************************** DEQUE *****************************/
+static inline
+size_t deque_round_capacity(size_t capacity) {
+    size_t c = 1;
+
+    while (c < capacity)
+        c <<= 1;
+
+    return c;
+}
+
+static inline
+void *deque_slot(const deque_t *d, size_t idx) {
+    return d->data + ((d->head + idx) & (d->capacity - 1)) * d->element_size;
+}
+
+/* copy count elements starting from logical index idx to dst */
+static
+void deque_copy_out(const deque_t *d, size_t idx, void *dst, size_t count) {
+    size_t first = (d->head + idx) & (d->capacity - 1);
+    size_t chunk = d->capacity - first;
+
+    if (chunk > count)
+        chunk = count;
+
+    memcpy(dst, d->data + first * d->element_size, chunk * d->element_size);
+    memcpy(dst + chunk * d->element_size, d->data,
+           (count - chunk) * d->element_size);
+}
+
+/* copy count elements from src to logical index idx onwards */
+static
+void deque_copy_in(deque_t *d, size_t idx, const void *src, size_t count) {
+    size_t first = (d->head + idx) & (d->capacity - 1);
+    size_t chunk = d->capacity - first;
+
+    if (chunk > count)
+        chunk = count;
+
+    memcpy(d->data + first * d->element_size, src, chunk * d->element_size);
+    memcpy(d->data, src + chunk * d->element_size,
+           (count - chunk) * d->element_size);
+}
+
+void deque_init(deque_t *d, size_t size, size_t capacity) {
+    assert(d && size);
+
+    d->element_size = size;
+    d->head = 0;
+    d->count = 0;
+    d->capacity = 0;
+    d->data = NULL;
+
+    if (capacity)
+        deque_reserve(d, capacity);
+}
+
+void deque_deinit(deque_t *d) {
+    assert(d);
+
+    if (d->data)
+        free(d->data);
+
+    d->data = NULL;
+    d->capacity = d->count = d->head = 0;
+}
+
+bool deque_reserve(deque_t *d, size_t capacity) {
+    size_t newcap;
+    void *newdata;
+
+    assert(d);
+
+    if (capacity <= d->capacity)
+        return true;
+
+    newcap = deque_round_capacity(capacity);
+    newdata = malloc(newcap * d->element_size);
+
+    if (!newdata)
+        return false;
+
+    /* linearize contents so that head is at zero */
+    if (d->count)
+        deque_copy_out(d, 0, newdata, d->count);
+
+    if (d->data)
+        free(d->data);
+
+    d->data = newdata;
+    d->capacity = newcap;
+    d->head = 0;
+
+    return true;
+}
+
+void deque_clear(deque_t *d) {
+    assert(d);
+
+    d->head = d->count = 0;
+}
+
+size_t deque_count(const deque_t *d) {
+    return d ? d->count : 0;
+}
+
+void *deque_push_back(deque_t *d) {
+    bool reserved;
+    void *slot;
+
+    assert(d);
+
+    if (d->count == d->capacity) {
+        reserved = deque_reserve(d, d->capacity ? d->capacity * 2 : 1);
+        assert(reserved);
+    }
+
+    slot = deque_slot(d, d->count);
+    ++d->count;
+
+    return slot;
+}
+
+void *deque_push_front(deque_t *d) {
+    bool reserved;
+
+    assert(d);
+
+    if (d->count == d->capacity) {
+        reserved = deque_reserve(d, d->capacity ? d->capacity * 2 : 1);
+        assert(reserved);
+    }
+
+    d->head = (d->head - 1) & (d->capacity - 1);
+    ++d->count;
+
+    return d->data + d->head * d->element_size;
+}
+
+bool deque_pop_back(deque_t *d, void *out) {
+    assert(d);
+
+    if (!d->count)
+        return false;
+
+    --d->count;
+
+    if (out)
+        memcpy(out, deque_slot(d, d->count), d->element_size);
+
+    return true;
+}
+
+bool deque_pop_front(deque_t *d, void *out) {
+    assert(d);
+
+    if (!d->count)
+        return false;
+
+    if (out)
+        memcpy(out, d->data + d->head * d->element_size, d->element_size);
+
+    d->head = (d->head + 1) & (d->capacity - 1);
+    --d->count;
+
+    return true;
+}
+
+size_t deque_push_back_n(deque_t *d, const void *src, size_t count) {
+    assert(d && (src || !count));
+
+    if (!count)
+        return 0;
+
+    if (d->count + count > d->capacity &&
+        !deque_reserve(d, d->count + count))
+        return 0;
+
+    deque_copy_in(d, d->count, src, count);
+    d->count += count;
+
+    return count;
+}
+
+size_t deque_pop_front_n(deque_t *d, void *dst, size_t count) {
+    assert(d);
+
+    if (count > d->count)
+        count = d->count;
+
+    if (!count)
+        return 0;
+
+    if (dst)
+        deque_copy_out(d, 0, dst, count);
+
+    d->head = (d->head + count) & (d->capacity - 1);
+    d->count -= count;
+
+    return count;
+}
+
+void *deque_front(deque_t *d) {
+    assert(d);
+
+    return d->count ? d->data + d->head * d->element_size : NULL;
+}
+
+void *deque_back(deque_t *d) {
+    assert(d);
+
+    return d->count ? deque_slot(d, d->count - 1) : NULL;
+}
+
+void *deque_get(deque_t *d, size_t idx) {
+    assert(d);
+    assert(d->count > idx);
+
+    return deque_slot(d, idx);
+}
@@ -89,9 +89,15 @@ void hash_map_remove(hash_map_t *hm, hash_t h) {
 
     assert(hm);
 
-    hmn = avl_tree_remove_get_data(&hm->tree, h);
+    hmn = hash_map_get(hm, h);
 
+    if (!hmn)
+        return;
+
+    /* node data is inplace, so it is purged before the node is freed */
     list_purge(&hmn->data_list);
+
+    avl_tree_remove(&hm->tree, h);
 }
 
 hash_map_node_t *hash_map_next(hash_map_t *hm, hash_map_node_t *hmn) {
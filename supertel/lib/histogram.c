@@ -0,0 +1,117 @@
+#include "histogram.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+static inline
+int msb_index(uint64_t v) {
+    return 63 - __builtin_clzll(v);
+}
+
+/**************** API ****************/
+size_t histogram_bucket_index(uint64_t value) {
+    int shift;
+
+    if (value < 2 * HISTOGRAM_SUB_BUCKETS)
+        return value;
+
+    shift = msb_index(value) - HISTOGRAM_SUB_BITS;
+
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS +
+           (value >> shift) - HISTOGRAM_SUB_BUCKETS;
+}
+
+uint64_t histogram_bucket_low(size_t idx) {
+    size_t shift;
+
+    assert(idx < HISTOGRAM_BUCKETS);
+
+    if (idx < 2 * HISTOGRAM_SUB_BUCKETS)
+        return idx;
+
+    shift = idx / HISTOGRAM_SUB_BUCKETS - 1;
+
+    return (uint64_t)(HISTOGRAM_SUB_BUCKETS + idx % HISTOGRAM_SUB_BUCKETS)
+           << shift;
+}
+
+void histogram_reset(histogram_t *h) {
+    assert(h);
+
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void histogram_record(histogram_t *h, uint64_t value) {
+    assert(h);
+
+    ++h->buckets[histogram_bucket_index(value)];
+    ++h->count;
+    h->sum += value;
+
+    if (value < h->min)
+        h->min = value;
+
+    if (value > h->max)
+        h->max = value;
+}
+
+uint64_t histogram_quantile(const histogram_t *h, double q) {
+    uint64_t rank, seen = 0, high;
+    size_t idx;
+
+    assert(h);
+
+    if (!h->count)
+        return 0;
+
+    rank = (uint64_t)(q * h->count);
+
+    if (rank >= h->count)
+        rank = h->count - 1;
+
+    for (idx = 0; idx < HISTOGRAM_BUCKETS; ++idx) {
+        seen += h->buckets[idx];
+
+        if (seen > rank) {
+            high = idx + 1 < HISTOGRAM_BUCKETS
+                   ? histogram_bucket_low(idx + 1) - 1 : UINT64_MAX;
+
+            return high < h->max ? high : h->max;
+        }
+    }
+
+    return h->max;
+}
+
+void histogram_print(const histogram_t *h, FILE *f,
+                     const char *name, int buckets) {
+    size_t idx;
+
+    assert(h && f);
+
+    fprintf(f, "%-32s count %10llu min %10llu mean %10llu "
+               "p50 %10llu p90 %10llu p99 %10llu p99.9 %10llu max %10llu\n",
+            name ? name : "",
+            (unsigned long long)h->count,
+            (unsigned long long)(h->count ? h->min : 0),
+            (unsigned long long)(h->count ? h->sum / h->count : 0),
+            (unsigned long long)histogram_quantile(h, 0.5),
+            (unsigned long long)histogram_quantile(h, 0.9),
+            (unsigned long long)histogram_quantile(h, 0.99),
+            (unsigned long long)histogram_quantile(h, 0.999),
+            (unsigned long long)h->max);
+
+    if (!buckets)
+        return;
+
+    for (idx = 0; idx < HISTOGRAM_BUCKETS; ++idx)
+        if (h->buckets[idx])
+            fprintf(f, "    [%10llu, %10llu] %10llu\n",
+                    (unsigned long long)histogram_bucket_low(idx),
+                    (unsigned long long)(idx + 1 < HISTOGRAM_BUCKETS
+                                         ? histogram_bucket_low(idx + 1) - 1
+                                         : UINT64_MAX),
+                    (unsigned long long)h->buckets[idx]);
+}
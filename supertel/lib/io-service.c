@@ -1,3 +1,8 @@
+#ifdef IO_SERVICE_STATS
+/* dladdr */
+# define _GNU_SOURCE
+#endif
+
 #include "io-service.h"
 
 #include <stdbool.h>
@@ -11,6 +16,17 @@
 #include <sys/eventfd.h>
 #include <sys/epoll.h>
 
+#ifdef IO_SERVICE_STATS
+# include "histogram.h"
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <signal.h>
+# include <time.h>
+# include <dlfcn.h>
+# include <sys/signalfd.h>
+#endif
+
 typedef struct job {
     iosvc_job_function_t job;
     void *ctx;
@@ -23,6 +39,9 @@ typedef struct lookup_job_element {
     job_t job[IO_SVC_OP_COUNT];
 } lookup_job_element_t;
 
+/* events fetched with a single epoll_wait */
+#define MAX_EVENTS_PER_WAKEUP   (64)
+
 static const int OP_FLAGS[IO_SVC_OP_COUNT] = {
     [IO_SVC_OP_READ] = EPOLLIN,
     [IO_SVC_OP_WRITE] = EPOLLOUT
@@ -40,6 +59,114 @@ eventfd_t svc_notified(int fd) {
     return v;
 }
 
+#ifdef IO_SERVICE_STATS
+typedef struct job_stats {
+    iosvc_job_function_t job;
+    histogram_t duration;
+} job_stats_t;
+
+struct io_service_stats {
+    histogram_t epoll_wait;
+    histogram_t events_per_wakeup;
+    histogram_t iteration;
+    /* vector of job_stats_t */
+    vector_t jobs;
+    /* index of last job looked up, jobs tend to repeat */
+    size_t last_job;
+    int signal_fd;
+};
+
+static inline
+uint64_t stats_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static
+void stats_init(io_service_t *iosvc) {
+    iosvc->stats = malloc(sizeof(*iosvc->stats));
+    assert(iosvc->stats);
+
+    vector_init(&iosvc->stats->jobs, sizeof(job_stats_t), 0);
+    iosvc->stats->signal_fd = -1;
+
+    io_service_stats_reset(iosvc);
+}
+
+static
+void stats_deinit(io_service_t *iosvc) {
+    if (iosvc->stats->signal_fd >= 0)
+        close(iosvc->stats->signal_fd);
+
+    vector_deinit(&iosvc->stats->jobs);
+    free(iosvc->stats);
+    iosvc->stats = NULL;
+}
+
+static
+void stats_job(io_service_t *iosvc, iosvc_job_function_t job, uint64_t ns) {
+    struct io_service_stats *st = iosvc->stats;
+    job_stats_t *js = NULL;
+    size_t idx;
+
+    if (st->last_job < vector_count(&st->jobs)) {
+        js = vector_get(&st->jobs, st->last_job);
+
+        if (js->job != job)
+            js = NULL;
+    }
+
+    for (idx = 0; !js && idx < vector_count(&st->jobs); ++idx) {
+        js = vector_get(&st->jobs, idx);
+
+        if (js->job != job)
+            js = NULL;
+        else
+            st->last_job = idx;
+    }
+
+    if (!js) {
+        st->last_job = vector_count(&st->jobs);
+        js = vector_append(&st->jobs);
+        js->job = job;
+        histogram_reset(&js->duration);
+    }
+
+    histogram_record(&js->duration, ns);
+}
+
+static
+void stats_signal_caught(int fd, io_svc_op_t op, void *ctx) {
+    io_service_t *iosvc = ctx;
+    struct signalfd_siginfo si;
+
+    if (read(fd, &si, sizeof(si)) != sizeof(si))
+        return;
+
+    io_service_stats_dump(iosvc, stderr, false);
+}
+
+# define STATS_VAR(decl)                    decl
+# define STATS_NOW(var)                     (var) = stats_now()
+# define STATS_RECORD(iosvc, hist, value)   \
+    histogram_record(&(iosvc)->stats->hist, (value))
+# define STATS_JOB(iosvc, job, ns)          stats_job((iosvc), (job), (ns))
+# define STATS_ITERATION_END(iosvc, woke_at, now)                \
+    do {                                                        \
+        if (woke_at)                                            \
+            STATS_RECORD(iosvc, iteration, (now) - (woke_at));  \
+    } while (0)
+#else
+# define STATS_VAR(decl)
+# define STATS_NOW(var)
+# define STATS_RECORD(iosvc, hist, value)
+# define STATS_JOB(iosvc, job, ns)
+# define STATS_ITERATION_END(iosvc, woke_at, now)
+#endif
+
 void io_service_init(io_service_t *iosvc) {
     int r;
 
@@ -64,6 +191,10 @@ void io_service_init(io_service_t *iosvc) {
 
     assert(0 == epoll_ctl(iosvc->epoll_fd, EPOLL_CTL_ADD,
                           iosvc->event_fd, &iosvc->event_fd_event));
+
+#ifdef IO_SERVICE_STATS
+    stats_init(iosvc);
+#endif
 }
 
 void io_service_deinit(io_service_t *iosvc) {
@@ -73,6 +204,10 @@ void io_service_deinit(io_service_t *iosvc) {
     close(iosvc->epoll_fd);
 
     list_purge(&iosvc->lookup_table);
+
+#ifdef IO_SERVICE_STATS
+    stats_deinit(iosvc);
+#endif
 }
 
 void io_service_stop(io_service_t *iosvc, bool wait_pending) {
@@ -145,14 +280,16 @@ void io_service_remove_job(io_service_t *iosvc,
 
 void io_service_run(io_service_t *iosvc) {
     volatile bool *running;
-    struct epoll_event event;
-    int r, fd;
+    struct epoll_event events[MAX_EVENTS_PER_WAKEUP], *event;
+    int r, idx_event, fd;
     ssize_t idx;
     io_svc_op_t op;
     lookup_job_element_t *lje, *prev_lje;
     list_element_t *le, *prev_le;
     iosvc_job_function_t job;
     void *ctx;
+    STATS_VAR(uint64_t woke_at = 0);
+    STATS_VAR(uint64_t now);
 
     assert(iosvc);
 
@@ -167,80 +304,174 @@ void io_service_run(io_service_t *iosvc) {
     *running = true;
 
     while (*running) {
-        r = epoll_wait(iosvc->epoll_fd, &event, 1, -1);
+        /* previous iteration ends here whatever way it went */
+        STATS_NOW(now);
+        STATS_ITERATION_END(iosvc, woke_at, now);
+
+        r = epoll_wait(iosvc->epoll_fd, events, MAX_EVENTS_PER_WAKEUP, -1);
+
+        STATS_NOW(woke_at);
+        STATS_RECORD(iosvc, epoll_wait, woke_at - now);
 
         if (r < 0)
             continue;
 
-        fd = event.data.fd;
+        STATS_RECORD(iosvc, events_per_wakeup, r);
 
-        if (fd == iosvc->event_fd) {
-            svc_notified(fd);
+        /* a job may stop the service, the rest of events is dropped then */
+        for (idx_event = 0; idx_event < r && *running; ++idx_event) {
+            event = &events[idx_event];
+            fd = event->data.fd;
 
-            if ((list_size(&iosvc->lookup_table) == 0) && (iosvc->allow_new == false))
-                *running = false;
+            if (fd == iosvc->event_fd) {
+                svc_notified(fd);
 
-            for (le = list_begin(&iosvc->lookup_table); le;) {
-                lje = (lookup_job_element_t *)le->data;
+                if ((list_size(&iosvc->lookup_table) == 0) && (iosvc->allow_new == false))
+                    *running = false;
 
-                if (lje->event.events == 0) {
-                    epoll_ctl(iosvc->epoll_fd, EPOLL_CTL_DEL, lje->fd, NULL);
-                    le = list_remove_and_advance(&iosvc->lookup_table, le);
-                    continue;
-                }
+                for (le = list_begin(&iosvc->lookup_table); le;) {
+                    lje = (lookup_job_element_t *)le->data;
 
-                if (epoll_ctl(iosvc->epoll_fd, EPOLL_CTL_MOD, lje->fd, &lje->event))
-                    if (errno == ENOENT)
-                        epoll_ctl(iosvc->epoll_fd, EPOLL_CTL_ADD, lje->fd, &lje->event);
+                    if (lje->event.events == 0) {
+                        epoll_ctl(iosvc->epoll_fd, EPOLL_CTL_DEL, lje->fd, NULL);
+                        le = list_remove_and_advance(&iosvc->lookup_table, le);
+                        continue;
+                    }
 
-                le = list_next(&iosvc->lookup_table, le);
-            }
+                    if (epoll_ctl(iosvc->epoll_fd, EPOLL_CTL_MOD, lje->fd, &lje->event))
+                        if (errno == ENOENT)
+                            epoll_ctl(iosvc->epoll_fd, EPOLL_CTL_ADD, lje->fd, &lje->event);
 
-            continue;
-        }
+                    le = list_next(&iosvc->lookup_table, le);
+                }
 
-        for (op = 0; op < IO_SVC_OP_COUNT; ++op) {
-            if (!(event.events & OP_FLAGS[op]))
                 continue;
+            }
 
-            for (le = list_begin(&iosvc->lookup_table); le;
-                 le = list_next(&iosvc->lookup_table, le)) {
-                lje = (lookup_job_element_t *)le->data;
-                if (lje->fd == fd) {
-                    if (lje->job[op].job != NULL) break;
-                    else {
-                        lje = NULL;
-                        break;
+            for (op = 0; op < IO_SVC_OP_COUNT; ++op) {
+                if (!(event->events & OP_FLAGS[op]))
+                    continue;
+
+                for (le = list_begin(&iosvc->lookup_table); le;
+                     le = list_next(&iosvc->lookup_table, le)) {
+                    lje = (lookup_job_element_t *)le->data;
+                    if (lje->fd == fd) {
+                        if (lje->job[op].job != NULL) break;
+                        else {
+                            lje = NULL;
+                            break;
+                        }
                     }
                 }
-            }
 
-            if (le) {
-                lje = (lookup_job_element_t *)le->data;
-                job = lje->job[op].job;
-                ctx = lje->job[op].ctx;
+                if (le) {
+                    lje = (lookup_job_element_t *)le->data;
+                    job = lje->job[op].job;
+                    ctx = lje->job[op].ctx;
 
-                if (lje->job[op].oneshot) {
-                    lje->job[op].ctx = lje->job[op].job = NULL;
-                    lje->event.events &= ~OP_FLAGS[op];
+                    if (lje->job[op].oneshot) {
+                        lje->job[op].ctx = lje->job[op].job = NULL;
+                        lje->event.events &= ~OP_FLAGS[op];
 
-                    if (lje->event.events == 0) {
-                        epoll_ctl(iosvc->epoll_fd, EPOLL_CTL_DEL, lje->fd, NULL);
-                        list_remove_and_advance(&iosvc->lookup_table, le);
+                        if (lje->event.events == 0) {
+                            epoll_ctl(iosvc->epoll_fd, EPOLL_CTL_DEL, lje->fd, NULL);
+                            list_remove_and_advance(&iosvc->lookup_table, le);
+                        }
                     }
-                }
 
-                if (job)
-                    (*job)(fd, op, ctx);
-                else {
-                    if (le)
-                        epoll_ctl(iosvc->epoll_fd,
-                                  EPOLL_CTL_MOD, lje->fd, &lje->event);
-                    else
-                        epoll_ctl(iosvc->epoll_fd,
-                                  EPOLL_CTL_DEL, fd, NULL);
-                }
-            } /* if (lje) */
-        }   /* for (op = 0; op < IO_SVC_OP_COUNT; ++op) */
+                    if (job) {
+                        STATS_NOW(now);
+                        (*job)(fd, op, ctx);
+                        STATS_JOB(iosvc, job, stats_now() - now);
+                    }
+                    else {
+                        if (le)
+                            epoll_ctl(iosvc->epoll_fd,
+                                      EPOLL_CTL_MOD, lje->fd, &lje->event);
+                        else
+                            epoll_ctl(iosvc->epoll_fd,
+                                      EPOLL_CTL_DEL, fd, NULL);
+                    }
+                } /* if (lje) */
+            }   /* for (op = 0; op < IO_SVC_OP_COUNT; ++op) */
+        }   /* for (idx_event = 0; idx_event < r && *running; ++idx_event) */
     }   /* while (*running) */
 }
+
+#ifdef IO_SERVICE_STATS
+void io_service_stats_reset(io_service_t *iosvc) {
+    struct io_service_stats *st;
+
+    assert(iosvc && iosvc->stats);
+
+    st = iosvc->stats;
+
+    histogram_reset(&st->epoll_wait);
+    histogram_reset(&st->events_per_wakeup);
+    histogram_reset(&st->iteration);
+    vector_remove_range(&st->jobs, 0, vector_count(&st->jobs));
+    st->last_job = 0;
+}
+
+void io_service_stats_dump(io_service_t *iosvc, FILE *f, bool buckets) {
+    struct io_service_stats *st;
+    job_stats_t *js;
+    Dl_info info;
+    char name[64];
+    size_t idx;
+
+    assert(iosvc && iosvc->stats && f);
+
+    st = iosvc->stats;
+
+    fprintf(f, "IO service %p stats (ns):\n", (void *)iosvc);
+    histogram_print(&st->epoll_wait, f, "epoll_wait", buckets);
+    histogram_print(&st->events_per_wakeup, f, "events per wakeup (count)",
+                    buckets);
+    histogram_print(&st->iteration, f, "loop iteration", buckets);
+
+    for (idx = 0; idx < vector_count(&st->jobs); ++idx) {
+        js = vector_get(&st->jobs, idx);
+
+        /* static functions are named only if symbols are exported */
+        if (dladdr((void *)js->job, &info) && info.dli_sname)
+            snprintf(name, sizeof(name), "job %s", info.dli_sname);
+        else
+            snprintf(name, sizeof(name), "job %p", (void *)js->job);
+
+        histogram_print(&js->duration, f, name, buckets);
+    }
+
+    fflush(f);
+}
+
+bool io_service_stats_dump_on_signal(io_service_t *iosvc, int signo) {
+    sigset_t sigset;
+    int fd;
+
+    assert(iosvc && iosvc->stats);
+
+    if (iosvc->stats->signal_fd >= 0)
+        return false;
+
+    if (sigemptyset(&sigset) < 0 || sigaddset(&sigset, signo) < 0)
+        return false;
+
+    if (sigprocmask(SIG_BLOCK, &sigset, NULL) < 0)
+        return false;
+
+    fd = signalfd(-1, &sigset, SFD_CLOEXEC);
+
+    if (fd < 0) {
+        sigprocmask(SIG_UNBLOCK, &sigset, NULL);
+        return false;
+    }
+
+    iosvc->stats->signal_fd = fd;
+
+    io_service_post_job(iosvc, fd, IO_SVC_OP_READ, !IOSVC_JOB_ONESHOT,
+                        stats_signal_caught, iosvc);
+
+    return true;
+}
+#endif
@@ -0,0 +1,364 @@
+#include "lockfree-queue.h"
+#include "io-service.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+static
+size_t round_capacity(size_t capacity) {
+    size_t c = 1;
+
+    while (c < capacity)
+        c <<= 1;
+
+    return c;
+}
+
+static inline
+atomic_size_t *cell_seq(const mpsc_queue_t *q, size_t pos) {
+    return (atomic_size_t *)(q->cells + (pos & q->mask) * q->cell_size);
+}
+
+static inline
+void *cell_data(const mpsc_queue_t *q, size_t pos) {
+    return q->cells + (pos & q->mask) * q->cell_size + sizeof(atomic_size_t);
+}
+
+/* copy count elements to ring starting at index, wrapping if needed */
+static
+void ring_copy_in(unsigned char *data, size_t mask, size_t element_size,
+                  size_t idx, const void *src, size_t count) {
+    size_t first = mask + 1 - (idx & mask);
+
+    if (first > count)
+        first = count;
+
+    memcpy(data + (idx & mask) * element_size, src, first * element_size);
+    memcpy(data, (const unsigned char *)src + first * element_size,
+           (count - first) * element_size);
+}
+
+static
+void ring_copy_out(const unsigned char *data, size_t mask,
+                   size_t element_size, size_t idx, void *dst, size_t count) {
+    size_t first = mask + 1 - (idx & mask);
+
+    if (first > count)
+        first = count;
+
+    memcpy(dst, data + (idx & mask) * element_size, first * element_size);
+    memcpy((unsigned char *)dst + first * element_size, data,
+           (count - first) * element_size);
+}
+
+/**************** SPSC ****************/
+bool spsc_queue_init(spsc_queue_t *q, size_t element_size, size_t capacity) {
+    assert(q && element_size && capacity);
+
+    capacity = round_capacity(capacity);
+
+    q->data = malloc(capacity * element_size);
+
+    if (!q->data)
+        return false;
+
+    q->element_size = element_size;
+    q->mask = capacity - 1;
+
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    q->head_cache = q->tail_cache = 0;
+
+    return true;
+}
+
+void spsc_queue_deinit(spsc_queue_t *q) {
+    assert(q);
+
+    free(q->data);
+    q->data = NULL;
+}
+
+size_t spsc_queue_capacity(const spsc_queue_t *q) {
+    return q->mask + 1;
+}
+
+size_t spsc_queue_count(spsc_queue_t *q) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+    return tail - head;
+}
+
+bool spsc_queue_empty(spsc_queue_t *q) {
+    return !spsc_queue_count(q);
+}
+
+size_t spsc_queue_push_n(spsc_queue_t *q, const void *src, size_t count) {
+    size_t tail, space;
+
+    assert(q && (src || !count));
+
+    tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    space = q->mask + 1 - (tail - q->head_cache);
+
+    /* refresh consumer index only when cached one says there is no room */
+    if (space < count) {
+        q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+        space = q->mask + 1 - (tail - q->head_cache);
+    }
+
+    if (count > space)
+        count = space;
+
+    if (!count)
+        return 0;
+
+    ring_copy_in(q->data, q->mask, q->element_size, tail, src, count);
+
+    atomic_store_explicit(&q->tail, tail + count, memory_order_release);
+
+    return count;
+}
+
+size_t spsc_queue_pop_n(spsc_queue_t *q, void *dst, size_t count) {
+    size_t head, avail;
+
+    assert(q && (dst || !count));
+
+    head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    avail = q->tail_cache - head;
+
+    if (avail < count) {
+        q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+        avail = q->tail_cache - head;
+    }
+
+    if (count > avail)
+        count = avail;
+
+    if (!count)
+        return 0;
+
+    ring_copy_out(q->data, q->mask, q->element_size, head, dst, count);
+
+    atomic_store_explicit(&q->head, head + count, memory_order_release);
+
+    return count;
+}
+
+bool spsc_queue_push(spsc_queue_t *q, const void *el) {
+    return spsc_queue_push_n(q, el, 1) == 1;
+}
+
+bool spsc_queue_pop(spsc_queue_t *q, void *out) {
+    return spsc_queue_pop_n(q, out, 1) == 1;
+}
+
+/**************** MPSC ****************/
+bool mpsc_queue_init(mpsc_queue_t *q, size_t element_size, size_t capacity) {
+    size_t idx;
+
+    assert(q && element_size && capacity);
+
+    capacity = round_capacity(capacity);
+
+    /* keep sequence numbers aligned */
+    q->cell_size = (sizeof(atomic_size_t) + element_size +
+                    _Alignof(atomic_size_t) - 1) &
+                   ~(_Alignof(atomic_size_t) - 1);
+    q->cells = malloc(capacity * q->cell_size);
+
+    if (!q->cells)
+        return false;
+
+    q->element_size = element_size;
+    q->mask = capacity - 1;
+
+    /* cell is free for position pos when its sequence equals pos */
+    for (idx = 0; idx < capacity; ++idx)
+        atomic_init(cell_seq(q, idx), idx);
+
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+
+    return true;
+}
+
+void mpsc_queue_deinit(mpsc_queue_t *q) {
+    assert(q);
+
+    free(q->cells);
+    q->cells = NULL;
+}
+
+size_t mpsc_queue_capacity(const mpsc_queue_t *q) {
+    return q->mask + 1;
+}
+
+size_t mpsc_queue_count(mpsc_queue_t *q) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+    return tail > head ? tail - head : 0;
+}
+
+bool mpsc_queue_empty(mpsc_queue_t *q) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    /* claimed but not yet published cells count as empty */
+    return atomic_load_explicit(cell_seq(q, head), memory_order_acquire)
+           != head + 1;
+}
+
+size_t mpsc_queue_push_n(mpsc_queue_t *q, const void *src, size_t count) {
+    size_t pos, head, space, idx;
+
+    assert(q && (src || !count));
+
+    if (!count)
+        return 0;
+
+    pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    for (;;) {
+        /* head is advanced after cells are released, so space is
+         * never overestimated */
+        head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+        /* stale tail, consumer went further already */
+        if ((ptrdiff_t)(pos - head) < 0) {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+            continue;
+        }
+
+        space = q->mask + 1 - (pos - head);
+
+        if (!space)
+            return 0;
+
+        if (count > space)
+            count = space;
+
+        if (atomic_compare_exchange_weak_explicit(
+                &q->tail, &pos, pos + count,
+                memory_order_relaxed, memory_order_relaxed))
+            break;
+    }
+
+    for (idx = 0; idx < count; ++idx) {
+        /* consumer releases cells in order, the check is for sanity */
+        assert(atomic_load_explicit(cell_seq(q, pos + idx),
+                                    memory_order_acquire) == pos + idx);
+
+        memcpy(cell_data(q, pos + idx),
+               (const unsigned char *)src + idx * q->element_size,
+               q->element_size);
+
+        atomic_store_explicit(cell_seq(q, pos + idx), pos + idx + 1,
+                              memory_order_release);
+    }
+
+    return count;
+}
+
+size_t mpsc_queue_pop_n(mpsc_queue_t *q, void *dst, size_t count) {
+    size_t head, idx;
+
+    assert(q && (dst || !count));
+
+    head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    for (idx = 0; idx < count; ++idx) {
+        if (atomic_load_explicit(cell_seq(q, head + idx), memory_order_acquire)
+            != head + idx + 1)
+            break;
+
+        memcpy((unsigned char *)dst + idx * q->element_size,
+               cell_data(q, head + idx), q->element_size);
+
+        atomic_store_explicit(cell_seq(q, head + idx),
+                              head + idx + q->mask + 1,
+                              memory_order_release);
+    }
+
+    if (idx)
+        atomic_store_explicit(&q->head, head + idx, memory_order_release);
+
+    return idx;
+}
+
+bool mpsc_queue_push(mpsc_queue_t *q, const void *el) {
+    return mpsc_queue_push_n(q, el, 1) == 1;
+}
+
+bool mpsc_queue_pop(mpsc_queue_t *q, void *out) {
+    return mpsc_queue_pop_n(q, out, 1) == 1;
+}
+
+/**************** waker ****************/
+bool queue_waker_init(queue_waker_t *w) {
+    assert(w);
+
+    w->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    /* consumer isn't running yet, first push has to wake it */
+    atomic_init(&w->sleeping, true);
+
+    return w->fd >= 0;
+}
+
+void queue_waker_deinit(queue_waker_t *w) {
+    assert(w);
+
+    if (w->fd >= 0)
+        close(w->fd);
+
+    w->fd = -1;
+}
+
+void queue_waker_post(queue_waker_t *w, io_service_t *iosvc,
+                      iosvc_job_function_t job, void *ctx) {
+    assert(w && iosvc && job);
+
+    io_service_post_job(iosvc, w->fd, IO_SVC_OP_READ, !IOSVC_JOB_ONESHOT,
+                        job, ctx);
+}
+
+void queue_waker_remove(queue_waker_t *w, io_service_t *iosvc) {
+    assert(w && iosvc);
+
+    io_service_remove_job(iosvc, w->fd, IO_SVC_OP_READ);
+}
+
+void queue_waker_signal(queue_waker_t *w) {
+    /* pairs with the fence in queue_waker_prepare_sleep:
+     * either the consumer sees pushed element or we see the flag */
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (!atomic_load_explicit(&w->sleeping, memory_order_relaxed))
+        return;
+
+    if (atomic_exchange_explicit(&w->sleeping, false, memory_order_acq_rel))
+        eventfd_write(w->fd, 1);
+}
+
+void queue_waker_consume(queue_waker_t *w) {
+    eventfd_t v;
+
+    eventfd_read(w->fd, &v);
+}
+
+void queue_waker_prepare_sleep(queue_waker_t *w) {
+    atomic_store_explicit(&w->sleeping, true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void queue_waker_cancel_sleep(queue_waker_t *w) {
+    atomic_store_explicit(&w->sleeping, false, memory_order_relaxed);
+}
@@ -0,0 +1,574 @@
+#include "log.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+
+#define LOG_CACHE_LINE          (64)
+#define LOG_RING_MASK           (LOG_RING_SIZE - 1)
+#define LOG_DRAIN_PERIOD_NSEC   (5 * 1000000)
+#define LOG_OUTPUT_SIZE         (1 << 16)
+/* room for a single formatted conversion */
+#define LOG_CONVERSION_SIZE     (LOG_MAX_STRING_LEN + 64)
+
+#define ALIGN8(x)               (((x) + 7) & ~((size_t)7))
+
+/**
+ * Per-thread single-producer single-consumer ring.
+ * Producer is the owner thread, consumer is whoever holds drain_lock.
+ */
+typedef struct log_ring {
+    _Alignas(LOG_CACHE_LINE) atomic_size_t head;
+    _Alignas(LOG_CACHE_LINE) atomic_size_t tail;
+    _Alignas(LOG_CACHE_LINE) atomic_size_t dropped;
+    /** owner thread has gone, the ring may be claimed by another one */
+    atomic_bool dead;
+    struct log_ring *next;
+    _Alignas(LOG_CACHE_LINE) uint8_t data[LOG_RING_SIZE];
+} log_ring_t;
+
+/**
+ * Record layout in ring:
+ * header, nargs * log_arg_t, string arguments (each '\0'-terminated).
+ * Total size is multiple of 8.
+ * Wrap padding is a header with \c pad set, only size and pad are valid.
+ */
+typedef struct log_record_header {
+    uint32_t size;
+    uint16_t nargs;
+    uint8_t level;
+    uint8_t pad;
+    const char *fmt;
+    struct timespec ts;
+} log_record_header_t;
+
+typedef struct log_output {
+    char data[LOG_OUTPUT_SIZE];
+    size_t len;
+} log_output_t;
+
+static const char *LEVEL_NAMES[] = {
+    [LOG_LEVEL_DEBUG]   = "[debug]  ",
+    [LOG_LEVEL_INFO]    = "[info]   ",
+    [LOG_LEVEL_WARN]    = "[warn]   ",
+    [LOG_LEVEL_ERROR]   = "[error]  ",
+    [LOG_LEVEL_FATAL]   = "[fatal]  "
+};
+
+static _Atomic(log_ring_t *) rings = NULL;
+static __thread log_ring_t *tls_ring = NULL;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ring_key;
+
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static log_output_t output;
+
+static pthread_t drainer;
+static atomic_bool drainer_running = false;
+static atomic_bool drainer_stop = false;
+static bool atexit_registered = false;
+
+/**************** rings ****************/
+static
+void ring_release(void *ring) {
+    atomic_store_explicit(&((log_ring_t *)ring)->dead, true,
+                          memory_order_release);
+}
+
+static
+void ring_key_create(void) {
+    pthread_key_create(&ring_key, ring_release);
+}
+
+static
+log_ring_t *ring_acquire(void) {
+    log_ring_t *r;
+    bool dead;
+
+    pthread_once(&key_once, ring_key_create);
+
+    /* reuse ring of a finished thread */
+    for (r = atomic_load_explicit(&rings, memory_order_acquire); r; r = r->next) {
+        dead = true;
+        if (atomic_compare_exchange_strong(&r->dead, &dead, false))
+            break;
+    }
+
+    if (!r) {
+        r = aligned_alloc(LOG_CACHE_LINE, sizeof(*r));
+
+        if (!r)
+            return NULL;
+
+        atomic_init(&r->head, 0);
+        atomic_init(&r->tail, 0);
+        atomic_init(&r->dropped, 0);
+        atomic_init(&r->dead, false);
+
+        r->next = atomic_load_explicit(&rings, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(
+                &rings, &r->next, r,
+                memory_order_release, memory_order_relaxed));
+    }
+
+    pthread_setspecific(ring_key, r);
+
+    return r;
+}
+
+/**************** formatting ****************/
+static
+void output_write(log_output_t *out) {
+    size_t off = 0;
+    ssize_t wrote;
+
+    while (off < out->len) {
+        wrote = write(STDERR_FILENO, out->data + off, out->len - off);
+
+        if (wrote <= 0)
+            break;
+
+        off += wrote;
+    }
+
+    out->len = 0;
+}
+
+static
+void output_append(log_output_t *out, const char *d, size_t len) {
+    if (out->len + len > sizeof(out->data))
+        output_write(out);
+
+    if (len > sizeof(out->data))
+        len = sizeof(out->data);
+
+    memcpy(out->data + out->len, d, len);
+    out->len += len;
+}
+
+static
+void output_printf(log_output_t *out, const char *spec, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static
+void output_printf(log_output_t *out, const char *spec, ...) {
+    va_list ap;
+    int len;
+
+    if (sizeof(out->data) - out->len < LOG_CONVERSION_SIZE)
+        output_write(out);
+
+    va_start(ap, spec);
+    len = vsnprintf(out->data + out->len, sizeof(out->data) - out->len,
+                    spec, ap);
+    va_end(ap);
+
+    if (len < 0)
+        return;
+
+    if ((size_t)len >= sizeof(out->data) - out->len)
+        len = sizeof(out->data) - out->len - 1;
+
+    out->len += len;
+}
+
+static inline
+int64_t arg_signed(const log_arg_t *a) {
+    switch (a->type) {
+        case LOG_ARG_DOUBLE:
+            return (int64_t)a->v.d;
+        case LOG_ARG_STRING:
+        case LOG_ARG_POINTER:
+            return (int64_t)(intptr_t)a->v.p;
+        default:
+            break;
+    }
+
+    if (!a->size || a->size >= sizeof(int64_t))
+        return a->v.i;
+
+    /* unsigned ones narrower than int are promoted to int keeping value */
+    if (LOG_ARG_SIGNED != a->type && a->size < sizeof(int))
+        return a->v.u & ((UINT64_C(1) << (8 * a->size)) - 1);
+
+    return (int64_t)(a->v.u << (64 - 8 * a->size)) >> (64 - 8 * a->size);
+}
+
+static inline
+uint64_t arg_unsigned(const log_arg_t *a) {
+    switch (a->type) {
+        case LOG_ARG_DOUBLE:
+            return (uint64_t)a->v.d;
+        case LOG_ARG_STRING:
+        case LOG_ARG_POINTER:
+            return (uint64_t)(uintptr_t)a->v.p;
+        default:
+            break;
+    }
+
+    if (a->size && a->size < sizeof(uint64_t))
+        return a->v.u & ((UINT64_C(1) << (8 * a->size)) - 1);
+
+    return a->v.u;
+}
+
+static inline
+double arg_double(const log_arg_t *a) {
+    switch (a->type) {
+        case LOG_ARG_DOUBLE:
+            return a->v.d;
+        case LOG_ARG_UNSIGNED:
+            return (double)a->v.u;
+        default:
+            return (double)arg_signed(a);
+    }
+}
+
+static
+void format_message(log_output_t *out, const char *fmt,
+                    const log_arg_t *args, size_t nargs,
+                    const char *strings) {
+    static const log_arg_t MISSING = { .type = LOG_ARG_SIGNED, .v.i = 0 };
+    char spec[32];
+    size_t sl, ai = 0;
+    const char *run;
+    const log_arg_t *a;
+    const char **arg_strings = NULL;
+    const char *str_ptrs[LOG_MAX_ARGS];
+    char conv;
+
+    /* locate inlined strings */
+    for (ai = 0; ai < nargs; ++ai)
+        if (args[ai].type == LOG_ARG_STRING) {
+            str_ptrs[ai] = args[ai].v.u ? strings : NULL;
+            strings += args[ai].v.u;
+        }
+
+    arg_strings = str_ptrs;
+    ai = 0;
+
+#define NEXT_ARG() (ai < nargs ? &args[ai++] : (++ai, &MISSING))
+
+    while (*fmt) {
+        if (*fmt != '%') {
+            for (run = fmt; *fmt && *fmt != '%'; ++fmt);
+            output_append(out, run, fmt - run);
+            continue;
+        }
+
+        run = fmt++;
+
+        if (*fmt == '%') {
+            output_append(out, "%", 1);
+            ++fmt;
+            continue;
+        }
+
+        sl = 0;
+        spec[sl++] = '%';
+
+        /* flags */
+        while (*fmt && strchr("-+ #0'", *fmt) && sl < 8)
+            spec[sl++] = *fmt++;
+
+        /* width */
+        if (*fmt == '*') {
+            ++fmt;
+            sl += snprintf(spec + sl, sizeof(spec) - sl, "%d",
+                           (int)arg_signed(NEXT_ARG()));
+        }
+        else
+            while (*fmt >= '0' && *fmt <= '9' && sl < 16)
+                spec[sl++] = *fmt++;
+
+        /* precision */
+        if (*fmt == '.') {
+            spec[sl++] = *fmt++;
+
+            if (*fmt == '*') {
+                ++fmt;
+                sl += snprintf(spec + sl, sizeof(spec) - sl, "%d",
+                               (int)arg_signed(NEXT_ARG()));
+            }
+            else
+                while (*fmt >= '0' && *fmt <= '9' && sl < 24)
+                    spec[sl++] = *fmt++;
+        }
+
+        /* length modifiers are replaced with our own */
+        while (*fmt && strchr("hlLqjzt", *fmt))
+            ++fmt;
+
+        conv = *fmt;
+
+        if (!conv) {
+            output_append(out, run, fmt - run);
+            break;
+        }
+
+        ++fmt;
+
+        switch (conv) {
+            case 'd':
+            case 'i':
+                spec[sl++] = 'l';
+                spec[sl++] = 'l';
+                spec[sl++] = conv;
+                spec[sl] = '\0';
+                output_printf(out, spec, (long long)arg_signed(NEXT_ARG()));
+                break;
+
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                spec[sl++] = 'l';
+                spec[sl++] = 'l';
+                spec[sl++] = conv;
+                spec[sl] = '\0';
+                output_printf(out, spec,
+                              (unsigned long long)arg_unsigned(NEXT_ARG()));
+                break;
+
+            case 'c':
+                spec[sl++] = conv;
+                spec[sl] = '\0';
+                output_printf(out, spec, (int)arg_signed(NEXT_ARG()));
+                break;
+
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                spec[sl++] = conv;
+                spec[sl] = '\0';
+                output_printf(out, spec, arg_double(NEXT_ARG()));
+                break;
+
+            case 's':
+                spec[sl++] = conv;
+                spec[sl] = '\0';
+                a = NEXT_ARG();
+                output_printf(out, spec,
+                              a->type == LOG_ARG_STRING && arg_strings[ai - 1]
+                              ? arg_strings[ai - 1] : "(null)");
+                break;
+
+            case 'p':
+                spec[sl++] = conv;
+                spec[sl] = '\0';
+                output_printf(out, spec,
+                              (void *)(uintptr_t)arg_unsigned(NEXT_ARG()));
+                break;
+
+            case 'n':
+                NEXT_ARG();
+                break;
+
+            default:
+                output_append(out, run, fmt - run);
+                break;
+        }
+    }
+
+#undef NEXT_ARG
+}
+
+static
+void format_record(log_output_t *out, const log_record_header_t *h) {
+    const log_arg_t *args = (const log_arg_t *)(h + 1);
+    int level = h->level & ~LOG_RAW;
+
+    if (!(h->level & LOG_RAW))
+        output_printf(out, "%s[%10ld.%03ld] ",
+                      LEVEL_NAMES[level],
+                      (long)h->ts.tv_sec, (long)(h->ts.tv_nsec / 1000000));
+
+    format_message(out, h->fmt, args, h->nargs,
+                   (const char *)(args + h->nargs));
+}
+
+static
+void drain_ring(log_ring_t *r, log_output_t *out) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    size_t dropped;
+    const log_record_header_t *h;
+
+    while (tail != head) {
+        h = (const log_record_header_t *)(r->data + (tail & LOG_RING_MASK));
+
+        if (!h->pad)
+            format_record(out, h);
+
+        tail += h->size;
+    }
+
+    atomic_store_explicit(&r->tail, tail, memory_order_release);
+
+    dropped = atomic_exchange_explicit(&r->dropped, 0, memory_order_relaxed);
+
+    if (dropped)
+        output_printf(out, "%s%zu log records dropped\n",
+                      LEVEL_NAMES[LOG_LEVEL_WARN], dropped);
+}
+
+static
+void *drainer_routine(void *unused) {
+    struct timespec period = { 0, LOG_DRAIN_PERIOD_NSEC };
+
+    while (!atomic_load(&drainer_stop)) {
+        log_flush();
+        nanosleep(&period, NULL);
+    }
+
+    return NULL;
+}
+
+/**************** API ****************/
+void log_record(int level, const char *fmt,
+                const log_arg_t *args, size_t nargs) {
+    log_ring_t *r = tls_ring;
+    log_record_header_t *h;
+    log_arg_t *rargs;
+    uint8_t *strings;
+    size_t str_len[LOG_MAX_ARGS];
+    size_t need, total, head, tail, pos, contiguous, idx;
+
+    if (!r) {
+        r = tls_ring = ring_acquire();
+
+        if (!r)
+            return;
+    }
+
+    if (nargs > LOG_MAX_ARGS)
+        nargs = LOG_MAX_ARGS;
+
+    need = sizeof(*h) + nargs * sizeof(*args);
+
+    for (idx = 0; idx < nargs; ++idx)
+        if (args[idx].type == LOG_ARG_STRING) {
+            str_len[idx] = args[idx].v.s
+                           ? strnlen(args[idx].v.s, LOG_MAX_STRING_LEN - 1) + 1
+                           : 0;
+            need += str_len[idx];
+        }
+
+    need = ALIGN8(need);
+
+    head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+    pos = head & LOG_RING_MASK;
+    contiguous = LOG_RING_SIZE - pos;
+    total = contiguous < need ? contiguous + need : need;
+
+    if (head + total - tail > LOG_RING_SIZE) {
+        atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    if (contiguous < need) {
+        h = (log_record_header_t *)(r->data + pos);
+        h->size = contiguous;
+        h->pad = 1;
+        pos = 0;
+    }
+
+    h = (log_record_header_t *)(r->data + pos);
+    h->size = need;
+    h->nargs = nargs;
+    h->level = level;
+    h->pad = 0;
+    h->fmt = fmt;
+    clock_gettime(CLOCK_REALTIME_COARSE, &h->ts);
+
+    rargs = (log_arg_t *)(h + 1);
+    strings = (uint8_t *)(rargs + nargs);
+
+    for (idx = 0; idx < nargs; ++idx) {
+        rargs[idx] = args[idx];
+
+        if (args[idx].type != LOG_ARG_STRING)
+            continue;
+
+        /* string value is replaced with its inlined length */
+        rargs[idx].v.u = str_len[idx];
+
+        if (!str_len[idx])
+            continue;
+
+        memcpy(strings, args[idx].v.s, str_len[idx] - 1);
+        strings[str_len[idx] - 1] = '\0';
+        strings += str_len[idx];
+    }
+
+    atomic_store_explicit(&r->head, head + total, memory_order_release);
+
+    if (!atomic_load_explicit(&drainer_running, memory_order_relaxed) ||
+        (level & ~LOG_RAW) >= LOG_LEVEL_FATAL)
+        log_flush();
+}
+
+void log_flush(void) {
+    log_ring_t *r;
+
+    pthread_mutex_lock(&drain_lock);
+
+    for (r = atomic_load_explicit(&rings, memory_order_acquire); r; r = r->next)
+        drain_ring(r, &output);
+
+    output_write(&output);
+
+    pthread_mutex_unlock(&drain_lock);
+}
+
+bool log_async_start(void) {
+    sigset_t all, old;
+    int ret;
+
+    if (atomic_load(&drainer_running))
+        return true;
+
+    atomic_store(&drainer_stop, false);
+
+    /* drainer must not take signals awaited with signalfd by the caller */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    ret = pthread_create(&drainer, NULL, drainer_routine, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (ret)
+        return false;
+
+    atomic_store(&drainer_running, true);
+
+    if (!atexit_registered)
+        atexit_registered = !atexit(log_async_stop);
+
+    return true;
+}
+
+void log_async_stop(void) {
+    if (atomic_load(&drainer_running)) {
+        atomic_store(&drainer_stop, true);
+        pthread_join(drainer, NULL);
+        atomic_store(&drainer_running, false);
+    }
+
+    log_flush();
+}
@@ -0,0 +1,120 @@
+#ifndef _HISTORY_H_
+# define _HISTORY_H_
+
+/** \file history.h
+ * Master's per-cycle history.
+ *
+ * History is a file holding a header and a ring of \c capacity records,
+ * the master maps it shared and appends a record at every cycle end.
+ * Readers map the same file read-only and read any of the last
+ * \c capacity records without system calls and without locking.
+ *
+ * Every record is guarded by its own sequence number: record number
+ * \c n (counting from 0 since the file was created) is being written
+ * while the sequence is <tt>2 * n + 1</tt> and is complete once it is
+ * <tt>2 * n + 2</tt>. Header's \c head is the number of complete records.
+ * Reader copies record out and checks the sequence both before and
+ * after the copy, mismatch means the writer has overwritten it.
+ *
+ * File outlives the master: reopened with the same capacity it is
+ * appended to, otherwise it is recreated empty.
+ *
+ * Single writer.
+ */
+
+# include <stddef.h>
+# include <stdint.h>
+# include <stdbool.h>
+# include <stdatomic.h>
+
+# define HISTORY_CACHE_LINE             (64)
+# define HISTORY_MAGIC                  (0x48545053u) /* "SPTH" */
+# define HISTORY_VERSION                (1)
+/** A day of cycles */
+# define HISTORY_DEFAULT_CAPACITY       (86400)
+
+/** Aggregates of a master's cycle */
+typedef struct history_sample {
+    /** cycle end, seconds since the Epoch */
+    int64_t timestamp;
+    /** master's request cycle, restarts with master */
+    uint32_t cycle;
+    /** distinct slaves answered within the cycle */
+    uint32_t answered;
+    /** slaves registered */
+    uint32_t slaves;
+    /** slaves accounted, sub-masters report their whole groups */
+    uint64_t count;
+    int64_t sum_temperature;
+    uint64_t sum_illumination;
+    /** over registered slaves, sub-master's group counts as its mean */
+    int32_t min_temperature;
+    int32_t max_temperature;
+    uint32_t min_illumination;
+    uint32_t max_illumination;
+    int8_t avg_temperature;
+    uint8_t avg_illumination;
+    uint8_t brightness;
+} history_sample_t;
+
+typedef struct history_record {
+    _Atomic uint64_t seq;
+    history_sample_t sample;
+} history_record_t;
+
+/** Lives at the beginning of the file */
+typedef struct history_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t capacity;
+
+    /** number of complete records ever written */
+    _Alignas(HISTORY_CACHE_LINE) _Atomic uint64_t head;
+} history_header_t;
+
+struct history;
+typedef struct history history_t;
+
+struct history {
+    void *base;
+    size_t map_size;
+
+    history_header_t *hdr;
+    history_record_t *records;
+    uint64_t capacity;
+};
+
+/**
+ * Open history for appending, create or recreate it if needed.
+ * \param [in] path file path
+ * \param [in] capacity number of records kept
+ * \return \c false on failure, \c errno is set
+ */
+bool history_open(history_t *h, const char *path, size_t capacity);
+/**
+ * Map history for reading.
+ * \return \c false on failure or if the file is not a history,
+ *         \c errno is set
+ */
+bool history_map(history_t *h, const char *path);
+void history_close(history_t *h);
+
+/** Append a record, the oldest one is overwritten once ring is full */
+void history_append(history_t *h, const history_sample_t *sample);
+
+/** Number of complete records ever written */
+uint64_t history_head(const history_t *h);
+/**
+ * Read a record.
+ * \param [in] n record number, counting from 0
+ * \param [out] sample record's contents
+ * \return \c false if the record is not written yet or overwritten
+ *
+ * Records from <tt>head - capacity</tt> to <tt>head - 1</tt> can be read
+ * unless the writer is faster than the reader.
+ */
+bool history_read(const history_t *h, uint64_t n, history_sample_t *sample);
+
+#endif /* _HISTORY_H_ */
@@ -3,13 +3,33 @@
 
 # include "io-service.h"
 # include "timer.h"
-# include "avl-tree.h"
+# include "slave-table.h"
+# include "udp-batch.h"
+# include "containers.h"
+# include "readings-dist.h"
 
 # include <stdint.h>
 # include <netinet/in.h>
 
+/**
+ * Registry snapshot is broadcast to standbys every that many cycles.
+ * Off by default: a delta holds every slave answered, and every slave
+ * receives and applies it, which costs O(N^2) per snapshot.
+ */
+# define MASTER_SNAPSHOT_PERIOD_CYCLES  (0)
+/** Every that many snapshots is full, deltas go in between */
+# define MASTER_SNAPSHOT_FULL_EVERY     (12)
+/** Slaves not heard for that many cycles are expired */
+# define MASTER_EXPIRY_CYCLES           (6)
+/** Expiry is clamped to that many cycles, a day of 5 s cycles */
+# define MASTER_MAX_EXPIRY_CYCLES       (17280)
+/** Responses are received with that many sockets and threads at most */
+# define MASTER_MAX_SHARDS              (64)
+
 struct master;
 typedef struct master master_t;
+struct master_shard;
+struct history;
 
 struct master {
     io_service_t *iosvc;
@@ -17,8 +37,10 @@ struct master {
 
     /** slaves' parameters sum to use to calculate average */
     struct {
-        int32_t temperature;
-        uint32_t illumination;
+        int64_t temperature;
+        uint64_t illumination;
+        /** slaves accounted, sub-masters report their whole groups */
+        uint64_t count;
     } sum;
 
     /** calculated averages and it's timestamp */
@@ -28,17 +50,149 @@ struct master {
         time_t timestamp;
     } avg;
 
-    /** slaves' lookup tree */
-    avl_tree_t slaves;
+    /** responses are aggregated into one info broadcast per cycle */
+    struct {
+        tmr_t tmr;
+        uint32_t window_msec;
+        /** broadcast as soon as every registered slave answered */
+        bool early;
+        bool collecting;
+        /** number of requests sent */
+        uint32_t cycle;
+        /** distinct slaves answered within current cycle */
+        size_t answered;
+    } aggr;
+
+    /** registry replication to slaves standing by for takeover */
+    struct {
+        /** cycles between snapshots, \c 0 disables replication */
+        uint32_t period;
+        /** number of snapshots sent */
+        uint32_t seq;
+    } snapshot;
+
+    /** liveness expiry of slaves not heard for a while */
+    struct {
+        /** cycles a slave may stay silent for, \c 0 disables expiry */
+        uint32_t cycles;
+        /** addresses expired since last snapshot, replicated as removals */
+        vector_t removed;
+        /** number of slaves expired */
+        uint64_t expired;
+    } expiry;
+
+    /** distribution of registered slaves' readings */
+    readings_dist_t dist;
+    /** distribution broadcast after info */
+    struct {
+        bool enabled;
+        /** last one broadcast, sent again only once quantiles change */
+        pr_stats_t sent;
+    } stats;
+
+    /** slaves' registry */
+    slave_table_t slaves;
+    /** registry is presized for that many slaves */
+    size_t expected_slaves;
+
+    /**
+     * Info broadcasts come from upper tier and are relayed by uplink,
+     * own ones are not sent
+     */
+    bool quiet;
+    /** info broadcasts are also relayed to the tier below through it */
+    master_t *relay;
+    /** every cycle's aggregates are appended to it, may be \c NULL */
+    struct history *history;
 
     struct sockaddr local_addr;
     struct sockaddr_in bcast_addr;
+    /** tier group port, host byte order */
+    uint16_t port;
     int udp_socket;
+
+    /** datagrams sent while acting on received batch */
+    udp_tx_t tx;
+    /** standalone master's receive batch */
+    udp_rx_t rx;
+
+    /**
+     * Receive shards, see master-shard.h. \c NULL while responses are
+     * received with \c udp_socket alone.
+     */
+    struct master_shard *shards;
+    size_t shard_count;
 };
 
+/**
+ * Initialize standalone master.
+ * \param [in] port tier group port to poll slaves at
+ * \param [in] fan_in number of slaves expected to answer at once,
+ *                    sizes socket's receive buffer and slaves' registry
+ */
 bool master_init(master_t *m, io_service_t *iosvc,
-                 const char *iface);
+                 const char *iface, uint16_t port, size_t fan_in);
+/**
+ * Initialize standalone master receiving responses with \c shards
+ * sockets bound with \c SO_REUSEPORT, each but the first served by its
+ * own thread. Slaves are spread over shards by address.
+ * \param [in] shards number of sockets, \c 1 is the same as
+ *                    \c master_init
+ *
+ * Responses are accounted in shards and merged at cycle end, so info
+ * is not sent early.
+ */
+bool master_init_shards(master_t *m, io_service_t *iosvc,
+                        const char *iface, uint16_t port, size_t fan_in,
+                        size_t shards);
+/**
+ * Initialize standalone master over already bound UDP socket,
+ * e.g. simulated one.
+ * \param [in] udp_socket socket bound to \c port, master takes it over
+ * \param [in] local_addr own address, datagrams from it are discarded
+ * \param [in] bcast_addr address to broadcast to, port is set to \c port
+ */
+bool master_init_socket(master_t *m, io_service_t *iosvc, int udp_socket,
+                        const struct sockaddr *local_addr,
+                        const struct sockaddr *bcast_addr,
+                        uint16_t port, size_t fan_in);
 void master_deinit(master_t *m);
+
+/**
+ * Set aggregation window.
+ * \param [in] window_msec time after request to collect responses for,
+ *                         clamped to [1, request period)
+ * \param [in] early broadcast info once every known slave has answered
+ *                   without waiting for the window to end
+ */
+void master_set_aggregation(master_t *m, uint32_t window_msec, bool early);
+/**
+ * Set registry replication period.
+ * \param [in] period_cycles request cycles between snapshots,
+ *                           \c 0 disables replication
+ */
+void master_set_replication(master_t *m, uint32_t period_cycles);
+/**
+ * Set liveness expiry.
+ * \param [in] cycles request cycles a slave may stay silent for before it
+ *                    is removed from registry and sums, \c 0 disables
+ *                    expiry, clamped to \c MASTER_MAX_EXPIRY_CYCLES
+ */
+void master_set_expiry(master_t *m, uint32_t cycles);
+/**
+ * Enable broadcast of readings' distribution.
+ * \param [in] enabled send \c PR_STATS every cycle its quantiles change
+ */
+void master_set_stats(master_t *m, bool enabled);
+/**
+ * Set history to append every cycle's aggregates to.
+ * \param [in] h history opened for appending, \c NULL to stop recording,
+ *               it is not closed by master
+ */
+void master_set_history(master_t *m, struct history *h);
+/** Post jobs to IO service, reset slaves' master and start polling */
+void master_post_jobs(master_t *m);
+/** Post jobs and run IO service */
 void master_run(master_t *m);
 
 #endif /* _MASTER_H_ */
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef _PHI_DETECTOR_H_
+# define _PHI_DETECTOR_H_
+
+/** \file phi-detector.h
+ * Accrual failure detector (phi-accrual).
+ *
+ * Heartbeat inter-arrival times are kept in a sliding window and taken
+ * as normally distributed. Suspicion level
+ * <tt>phi(t) = -log10(P(next heartbeat comes later than t))</tt>
+ * grows with time since the last heartbeat. The peer is suspected once
+ * phi crosses the threshold, e.g. phi = 8 means a chance of 10^-8 that
+ * the heartbeat is merely late.
+ *
+ * Since phi depends on time only, the moment it crosses the threshold is
+ * computed once per heartbeat and no polling is required.
+ */
+
+# include <stddef.h>
+# include <stdint.h>
+# include <stdbool.h>
+
+# define PHI_DETECTOR_WINDOW            (32)
+/** Detector gives no deadline with fewer intervals observed */
+# define PHI_DETECTOR_MIN_SAMPLES       (3)
+/** Keeps perfectly regular heartbeats from giving zero deviation */
+# define PHI_DETECTOR_MIN_STDDEV_MSEC   (100.0)
+# define PHI_DETECTOR_DEFAULT_THRESHOLD (8.0)
+
+typedef struct phi_detector {
+    /** inter-arrival times, msec */
+    double intervals[PHI_DETECTOR_WINDOW];
+    size_t count;
+    size_t next;
+    double sum;
+    double sum_sq;
+
+    /** last heartbeat, monotonic msec */
+    uint64_t last;
+    bool has_last;
+
+    double threshold;
+    /** normalized deviation where phi reaches the threshold */
+    double y_threshold;
+} phi_detector_t;
+
+void phi_detector_init(phi_detector_t *d, double threshold);
+/** Forget history, e.g. when peer changed */
+void phi_detector_reset(phi_detector_t *d);
+
+void phi_detector_heartbeat(phi_detector_t *d, uint64_t now);
+
+/** \return mean inter-arrival time, msec, \c 0 if unknown */
+double phi_detector_mean(const phi_detector_t *d);
+/** \return current suspicion level, \c 0 if unknown */
+double phi_detector_phi(const phi_detector_t *d, uint64_t now);
+
+/**
+ * Time left until suspicion crosses the threshold.
+ * \param [in] now monotonic msec
+ * \param [out] msec time left, \c 0 if already crossed
+ * \return \c false if there is not enough history to tell
+ */
+bool phi_detector_deadline(const phi_detector_t *d, uint64_t now,
+                           uint64_t *msec);
+
+/** Monotonic clock, msec */
+uint64_t phi_detector_now(void);
+
+#endif /* _PHI_DETECTOR_H_ */
@@ -3,11 +3,18 @@
 
 # include <stdint.h>
 # include <stddef.h>
+# include <stdbool.h>
 
 # define PKD __attribute__((packed))
 
 # define UDP_PORT                       12345
 # define UDP_PORT_STR                   "12345"
+/**
+ * Tier group port. Group \c 0 is the top tier.
+ * Every group is polled by its own master and elects it on its own.
+ */
+# define UDP_GROUP_PORT(g)              (UDP_PORT + (g))
+# define UDP_MAX_GROUP                  (1000)
 
 # define MASTER_REQUEST_TIMEOUT_MSEC    (5000)
 # define MASTER_GONE_TIMEOUT_MSEC       (MASTER_REQUEST_TIMEOUT_MSEC * 2)
@@ -20,6 +27,10 @@ enum {
     PR_MSG          = 0x02,
     PR_VOTE         = 0x03,
     PR_RESET_MASTER = 0x04,
+    PR_AGGREGATE    = 0x05,
+    PR_READINGS     = 0x06,
+    PR_SNAPSHOT     = 0x07,
+    PR_STATS        = 0x08,
     PR_COUNT
 };
 
@@ -56,9 +67,121 @@ typedef struct PKD pr_reset_master {
     /* empty */
 } pr_reset_master_t;
 
-# define PR_MAX_SIZE (sizeof(pr_msg_t))
+/** Response of sub-master: sums over slaves of its group */
+typedef struct PKD pr_aggregate {
+    pr_signature_t s;
+    int32_t temperature;
+    uint32_t illumination;
+    uint32_t count;
+} pr_aggregate_t;
+
+/** Readings per \c pr_readings_t, keeps datagram within 1 KiB */
+# define PR_READINGS_MAX                (128)
+
+typedef struct PKD pr_reading {
+    /** slave's IPv4 address, host byte order as master keys slaves */
+    uint32_t id;
+    int8_t temperature;
+    uint8_t illumination;
+} pr_reading_t;
+
+/**
+ * Readings of many slaves batched by sub-master or gateway.
+ * Only \c count readings are sent, see \c PR_READINGS_SIZE.
+ */
+typedef struct PKD pr_readings {
+    pr_signature_t s;
+    uint8_t count;
+    pr_reading_t readings[PR_READINGS_MAX];
+} pr_readings_t;
+
+# define PR_READINGS_SIZE(n)    \
+    (offsetof(pr_readings_t, readings) + (n) * sizeof(pr_reading_t))
+
+/** Entries per \c pr_snapshot_t, keeps datagram within 1 KiB */
+# define PR_SNAPSHOT_MAX                (48)
+
+enum {
+    /** snapshot carries whole registry, replica starts over */
+    PR_SNAPSHOT_FULL    = 0x01,
+    /** last datagram of snapshot */
+    PR_SNAPSHOT_LAST    = 0x02
+};
+
+typedef struct PKD pr_snapshot_entry {
+    /** slave's IPv4 address, host byte order */
+    uint32_t id;
+    int32_t temperature;
+    uint32_t illumination;
+    /** slaves accounted, \c 0 if slave is no longer registered */
+    uint32_t count;
+} pr_snapshot_entry_t;
+
+/**
+ * Part of master's registry snapshot replicated to standbys.
+ * Full snapshot carries every slave, delta one carries only slaves
+ * changed since previous snapshot. Snapshot spans datagrams numbered
+ * with \c part, only \c count entries are sent, see \c PR_SNAPSHOT_SIZE.
+ */
+typedef struct PKD pr_snapshot {
+    pr_signature_t s;
+    uint8_t flags;
+    uint8_t count;
+    uint16_t part;
+    /** snapshot number, delta applies on top of previous one */
+    uint32_t seq;
+    pr_snapshot_entry_t entries[PR_SNAPSHOT_MAX];
+} pr_snapshot_t;
+
+# define PR_SNAPSHOT_SIZE(n)    \
+    (offsetof(pr_snapshot_t, entries) + (n) * sizeof(pr_snapshot_entry_t))
+
+enum {
+    PR_STATS_MIN        = 0,
+    PR_STATS_P10,
+    PR_STATS_MEDIAN,
+    PR_STATS_P90,
+    PR_STATS_MAX,
+    PR_STATS_QUANTILES
+};
+
+/**
+ * Info message's companion: distribution of readings over registered
+ * slaves, which a few broken sensors don't skew as much as averages.
+ */
+typedef struct PKD pr_stats {
+    pr_signature_t s;
+    /** slaves accounted */
+    uint32_t count;
+    uint32_t date_time;
+    /** quantiles in order of \c PR_STATS_* */
+    int8_t temperature[PR_STATS_QUANTILES];
+    uint8_t illumination[PR_STATS_QUANTILES];
+} pr_stats_t;
+
+typedef union pr_any {
+    pr_request_t request;
+    pr_response_t response;
+    pr_msg_t msg;
+    pr_vote_t vote;
+    pr_reset_master_t reset_master;
+    pr_aggregate_t aggregate;
+    pr_readings_t readings;
+    pr_snapshot_t snapshot;
+    pr_stats_t stats;
+} pr_any_t;
+
+# define PR_MAX_SIZE (sizeof(pr_any_t))
 # define PR_MIN_SIZE (sizeof(pr_request_t))
 
+/** Minimal size for variable sized packets */
 const extern size_t PR_STRUCT_EXPECTED_SIZE[PR_COUNT];
 
+/**
+ * Check datagram size against its signature.
+ * \param [in] packet datagram, signature is known to be valid
+ * \param [in] len datagram size, at least \c PR_MIN_SIZE
+ */
+bool pr_size_valid(const pr_signature_t *packet, size_t len);
+
 #endif /* _PROTOCL_H_ */
\ No newline at end of file
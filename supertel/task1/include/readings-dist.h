@@ -0,0 +1,42 @@
+#ifndef _READINGS_DIST_H_
+# define _READINGS_DIST_H_
+
+/** \file readings-dist.h
+ * Distribution of slaves' readings.
+ *
+ * Counting histograms over 8-bit temperature and illumination domains.
+ * Slave is added and removed in O(1), quantiles are found with a pass
+ * over 256 bins regardless of slave count. Sub-master's group is counted
+ * \c count times at its mean.
+ */
+
+# include "slave-table.h"
+# include "protocol.h"
+
+# include <stdint.h>
+
+# define READINGS_DIST_BINS             (256)
+
+typedef struct readings_dist {
+    /** temperature \c t is counted in bin <tt>t + 128</tt> */
+    uint64_t temperature[READINGS_DIST_BINS];
+    uint64_t illumination[READINGS_DIST_BINS];
+    /** slaves accounted */
+    uint64_t count;
+} readings_dist_t;
+
+void readings_dist_clear(readings_dist_t *d);
+void readings_dist_add(readings_dist_t *d, const slave_description_t *sd);
+/** Remove slave exactly as it was added */
+void readings_dist_remove(readings_dist_t *d, const slave_description_t *sd);
+/** Add every slave of \c other */
+void readings_dist_merge(readings_dist_t *d, const readings_dist_t *other);
+
+/**
+ * Fill quantiles of stats message.
+ * \param [out] stats \c count and \c PR_STATS_QUANTILES values of both
+ *                    readings are filled, zeros if distribution is empty
+ */
+void readings_dist_fill_stats(const readings_dist_t *d, pr_stats_t *stats);
+
+#endif /* _READINGS_DIST_H_ */
@@ -0,0 +1,178 @@
+#ifndef _SIM_MEDIUM_H_
+# define _SIM_MEDIUM_H_
+
+/** \file sim-medium.h
+ * Simulated broadcast medium over loopback.
+ *
+ * Node \c i owns a socket bound to its real address <tt>127.1.0.0 + i + 1</tt>
+ * and is known to its peers by the alias <tt>127.2.0.0 + i + 1</tt>.
+ * Nothing is bound to aliases or to the broadcast address
+ * <tt>127.3.255.255</tt>, so whatever nodes send lands at the medium's
+ * wildcard socket. The medium learns the destination with \c IP_PKTINFO,
+ * loses, delays or cuts off the datagram and delivers it to the real
+ * addresses of recipients with the sender's alias as source address.
+ * Unicast passes the medium just as broadcast does.
+ *
+ * The medium watches the traffic, no node is instrumented:
+ *  - poll cycle lasts from master's request till its next one, every
+ *    started node reachable from the master is expected to answer;
+ *    cycle's completion time is that of the last answer, its coverage
+ *    is the share of expected nodes answered;
+ *  - convergence after an event (start, crash, partition) is reached once
+ *    every side of the network has a cycle started after the event
+ *    answered by a quorum of its nodes.
+ */
+
+# include "io-service.h"
+# include "timer.h"
+# include "histogram.h"
+# include "protocol.h"
+
+# include <stddef.h>
+# include <stdint.h>
+# include <stdbool.h>
+# include <stdio.h>
+# include <netinet/in.h>
+
+# define SIM_MAX_NODES                  (65534)
+/** Kept off tier group ports to not mix with real traffic */
+# define SIM_DEFAULT_PORT               (UDP_PORT + UDP_MAX_GROUP + 1)
+/** Partition splits nodes into halves by index */
+# define SIM_PARTITIONS                 (2)
+# define SIM_MAX_EVENTS                 (16)
+# define SIM_DEFAULT_QUORUM             (0.9)
+
+typedef struct sim_config {
+    size_t nodes;
+    /** port every node and the medium are bound to, host byte order */
+    uint16_t port;
+    /** chance to lose a datagram on its way to a single recipient */
+    double loss;
+    uint32_t latency_msec;
+    /** extra latency, uniform within <tt>[0, jitter_msec]</tt> */
+    uint32_t jitter_msec;
+    /** share of expected nodes to answer for convergence */
+    double quorum;
+    uint64_t seed;
+} sim_config_t;
+
+typedef struct sim_node {
+    /** datagrams sent by the node */
+    uint64_t sent;
+    /** datagrams delivered to the node */
+    uint64_t received;
+    uint8_t partition;
+    /** node has announced itself, i.e. it has started */
+    bool up;
+    /** node's traffic is dropped both ways */
+    bool crashed;
+    /** id of the poll cycle the node answered last */
+    uint64_t answered;
+
+    /** poll cycle the node runs as master, \c id is \c 0 for none */
+    struct {
+        uint64_t id;
+        uint64_t started_at;
+        uint64_t last_answer_at;
+        size_t expected;
+        size_t answered;
+        bool quorum;
+        bool closed;
+    } cycle;
+} sim_node_t;
+
+/** Datagram shared by recipients of a broadcast */
+typedef struct sim_payload {
+    size_t refs;
+    size_t len;
+    uint8_t data[PR_MAX_SIZE];
+} sim_payload_t;
+
+typedef struct sim_delivery {
+    /** monotonic msec */
+    uint64_t due;
+    uint32_t from;
+    uint32_t to;
+    sim_payload_t *payload;
+} sim_delivery_t;
+
+typedef struct sim_event {
+    char name[32];
+    /** monotonic msec */
+    uint64_t at;
+    bool converged;
+    uint64_t converged_in;
+} sim_event_t;
+
+typedef struct sim_medium {
+    io_service_t *iosvc;
+    sim_config_t cfg;
+    int udp_socket;
+
+    sim_node_t *nodes;
+
+    /** min-heap of delayed deliveries by due time */
+    sim_delivery_t *queue;
+    size_t queued;
+    size_t capacity;
+    tmr_t delivery_tmr;
+    /** due time the timer is armed for, \c 0 if disarmed */
+    uint64_t armed_for;
+
+    uint64_t rng;
+    uint64_t started_at;
+    uint64_t last_cycle_id;
+    /** node which sent the latest request, \c -1 if none yet */
+    long master;
+    uint64_t master_changes;
+    uint64_t votes;
+
+    sim_event_t events[SIM_MAX_EVENTS];
+    size_t event_count;
+    /** partitions still to complete a cycle after the latest event */
+    bool pending[SIM_PARTITIONS];
+
+    /** msec from request to the last answer */
+    histogram_t cycle_completion;
+    /** percent of expected nodes answered */
+    histogram_t cycle_coverage;
+    /** cycles every expected node answered */
+    uint64_t cycles_complete;
+    /** cycles closed by master's next request before that */
+    uint64_t cycles_partial;
+
+    uint64_t delivered;
+    uint64_t lost;
+    /** not delivered due to crash or partition */
+    uint64_t cut_off;
+} sim_medium_t;
+
+/**
+ * Allocate node's socket bound to its real address and announce the node
+ * to the medium.
+ * \param [in] idx node index
+ * \param [in] port port to bind to
+ * \param [out] local_addr node's alias, the address peers know it by
+ * \param [out] bcast_addr medium's broadcast address
+ * \return socket FD or \c -1 on failure
+ */
+int sim_node_socket(size_t idx, uint16_t port,
+                    struct sockaddr *local_addr,
+                    struct sockaddr *bcast_addr);
+
+bool sim_medium_init(sim_medium_t *m, io_service_t *iosvc,
+                     const sim_config_t *cfg);
+void sim_medium_deinit(sim_medium_t *m);
+/** Post jobs to IO service */
+void sim_medium_start(sim_medium_t *m);
+
+/** Drop node's traffic from now on */
+void sim_medium_crash(sim_medium_t *m, size_t idx);
+/** Split nodes into halves or join them back */
+void sim_medium_partition(sim_medium_t *m, bool split);
+/** Start waiting for convergence after \c name event */
+void sim_medium_mark(sim_medium_t *m, const char *name);
+
+void sim_medium_report(const sim_medium_t *m, FILE *f);
+
+#endif /* _SIM_MEDIUM_H_ */
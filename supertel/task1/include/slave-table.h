@@ -0,0 +1,110 @@
+#ifndef _SLAVE_TABLE_H_
+# define _SLAVE_TABLE_H_
+
+/** \file slave-table.h
+ * Master's slave registry.
+ *
+ * Open addressing hash table keyed by IPv4 address with linear probing
+ * and slave descriptions stored inline, one allocation for the whole
+ * table. Removal shifts the following cluster back instead of leaving
+ * tombstones, so lookups never scan deleted entries.
+ *
+ * Capacity is a power of two, load factor is kept at or below 3/4.
+ *
+ * Entries are also linked into a recency list by table index: an entry
+ * added or touched becomes the newest one. Links follow entries moved
+ * by removal and growth, so the oldest entries are reached in O(1) each.
+ */
+
+# include <stddef.h>
+# include <stdint.h>
+# include <stdbool.h>
+
+# define SLAVE_TABLE_MIN_CAPACITY       (16)
+/** No entry in recency list */
+# define SLAVE_TABLE_NIL                (UINT32_MAX)
+
+/**
+ * Readings of a slave, or sums over \c count slaves of sub-master's group.
+ */
+typedef struct slave_description {
+    int32_t temperature;
+    uint32_t illumination;
+    uint32_t count;
+    /** master's request cycle the slave last answered */
+    uint32_t cycle;
+    /** master's cycle the slave was last heard in, within window or not */
+    uint32_t seen;
+    /** changed since master's last registry snapshot */
+    bool dirty;
+} slave_description_t;
+
+typedef struct slave_table_entry {
+    /** host byte order */
+    uint32_t ip;
+    bool used;
+    slave_description_t sd;
+    /** neighbours in recency list, indices of entries */
+    uint32_t older;
+    uint32_t newer;
+} slave_table_entry_t;
+
+typedef struct slave_table {
+    slave_table_entry_t *entries;
+    size_t capacity;
+    size_t count;
+    /** log2(capacity) */
+    unsigned int bits;
+    /** ends of recency list */
+    uint32_t oldest;
+    uint32_t newest;
+} slave_table_t;
+
+/**
+ * Allocate table able to hold \c expected slaves without growing.
+ * \return \c false on allocation failure
+ */
+bool slave_table_init(slave_table_t *t, size_t expected);
+void slave_table_deinit(slave_table_t *t);
+/** Remove every slave, capacity is kept */
+void slave_table_clear(slave_table_t *t);
+size_t slave_table_count(const slave_table_t *t);
+
+slave_description_t *slave_table_get(slave_table_t *t, uint32_t ip);
+
+/**
+ * Get slave's description, add zero one if absent.
+ * \param [out] added set to \c true if the slave was added, may be NULL
+ * \return description or \c NULL if table failed to grow
+ */
+slave_description_t *slave_table_add_or_get(slave_table_t *t, uint32_t ip,
+                                            bool *added);
+
+/**
+ * Remove slave.
+ * \param [out] sd removed description, may be NULL
+ * \return \c false if there is no such slave
+ */
+bool slave_table_remove(slave_table_t *t, uint32_t ip,
+                        slave_description_t *sd);
+
+/**
+ * Make slave the newest one in recency list.
+ * \param [in] sd description returned by the table
+ */
+void slave_table_touch(slave_table_t *t, slave_description_t *sd);
+
+/** Least recently added or touched slave, \c NULL if table is empty */
+slave_table_entry_t *slave_table_oldest(slave_table_t *t);
+
+/**
+ * Iterate over slaves in no particular order.
+ * \param [in] prev previous entry or \c NULL to start
+ * \return next used entry or \c NULL at the end
+ *
+ * Table must not be changed while iterating.
+ */
+slave_table_entry_t *slave_table_next(slave_table_t *t,
+                                      slave_table_entry_t *prev);
+
+#endif /* _SLAVE_TABLE_H_ */
@@ -4,6 +4,8 @@
 # include "io-service.h"
 # include "timer.h"
 # include "master.h"
+# include "phi-detector.h"
+# include "histogram.h"
 
 # include <netinet/in.h>
 
@@ -19,6 +21,14 @@ typedef enum {
                                  so won't answer votes*/
 } slave_state_t;
 
+typedef enum {
+    SLAVE_ELECTION_TOURS    = 0x00, /**< vote at once, every tour
+                                         waits out the poll */
+    SLAVE_ELECTION_DELAYED          /**< vote after delay which is shorter
+                                         for higher vote, stay silent
+                                         once outvoted */
+} slave_election_t;
+
 struct slave {
     io_service_t *iosvc;
     tmr_t master_gone_tmr;
@@ -26,24 +36,124 @@ struct slave {
     tmr_t mastering_tmr;
 
     slave_state_t state;
+    slave_election_t election;
 
+    /** vote of current poll, sent or scheduled */
     uint32_t vote_sent;
     uint32_t max_vote_per_poll;
 
     uint8_t illumination;
     int8_t temperature;
 
+    /** learns master's request period, suspects master when it's late */
+    phi_detector_t detector;
+    /** master the detector has learned */
+    struct in_addr master_addr;
+    /** lower addressed master heard while mastering, yielded to if heard
+        again */
+    struct in_addr rival;
+    /** how late master was when suspected, msec after expected request */
+    histogram_t detection;
+
     struct sockaddr local_addr;
     struct sockaddr_in bcast_addr;
+    /**
+     * Master learned from its requests and info messages, reports go
+     * there. Address is \c INADDR_NONE while unknown, reports are
+     * broadcast then.
+     */
+    struct sockaddr_in report_addr;
+    /** tier group port, host byte order */
+    uint16_t port;
+    const char *iface;
 
     int udp_socket;
 
+    udp_rx_t rx;
+    udp_tx_t tx;
+
     master_t master;
+
+    /** master's registry replicated for warm takeover */
+    struct {
+        slave_table_t slaves;
+        /** snapshot being or last applied */
+        uint32_t seq;
+        /** snapshot datagram expected next */
+        uint16_t next_part;
+        /** nothing lost since last full snapshot */
+        bool valid;
+        /** last datagram of the snapshot applied */
+        bool complete;
+    } replica;
+
+    /**
+     * Sub-master which this slave reports for to upper tier.
+     * Its aggregate is sent instead of own readings, info messages
+     * are relayed to its group.
+     */
+    master_t *source;
+    /**
+     * Report source's slaves one by one with \c PR_READINGS
+     * instead of a single aggregate. Passed on to own uplink.
+     */
+    bool readings;
+    /** upper tier port to report to while mastering, \c 0 for none */
+    uint16_t uplink_port;
+    /** reports upwards while this slave masters its group */
+    slave_t *uplink;
 };
 
+/**
+ * Initialize slave.
+ * \param [in] port tier group port to take part in
+ */
 bool slave_init(slave_t *sl, io_service_t *iosvc,
-                const char *iface);
+                const char *iface, uint16_t port);
+
+/**
+ * Initialize slave over already bound UDP socket, e.g. simulated one.
+ * \param [in] udp_socket socket bound to \c port, slave takes it over
+ * \param [in] local_addr own address, datagrams from it are discarded
+ * \param [in] bcast_addr address to broadcast to, port is set to \c port
+ * \param [in] port tier group port to take part in
+ *
+ * Slave initialized so has no interface and can't report to upper tier.
+ */
+bool slave_init_socket(slave_t *sl, io_service_t *iosvc, int udp_socket,
+                       const struct sockaddr *local_addr,
+                       const struct sockaddr *bcast_addr, uint16_t port);
 void slave_deinit(slave_t *sl);
+
+/**
+ * Make the slave report for sub-master \c source.
+ * Source stops sending own info messages, relayed ones come instead.
+ * \param [in] readings report every slave of source instead of aggregate
+ */
+void slave_set_source(slave_t *sl, master_t *source, bool readings);
+/**
+ * Report to upper tier at \c port once elected master of own tier.
+ * \param [in] readings as for \c slave_set_source
+ */
+void slave_set_uplink(slave_t *sl, uint16_t port, bool readings);
+
+/**
+ * Set suspicion level to start election at.
+ * Default is \c PHI_DETECTOR_DEFAULT_THRESHOLD.
+ */
+void slave_set_phi_threshold(slave_t *sl, double threshold);
+
+/**
+ * Set election mode. Default is \c SLAVE_ELECTION_TOURS.
+ * With delayed election slave which follows live master ignores votes,
+ * elected slave answers them with master reset as standalone master does
+ * instead of stepping down.
+ */
+void slave_set_election(slave_t *sl, slave_election_t election);
+
+/** Post jobs to IO service */
+void slave_start(slave_t *sl);
+/** Start and run IO service */
 void slave_run(slave_t *sl);
 
 #endif /* _SLAVE_H_ */
\ No newline at end of file
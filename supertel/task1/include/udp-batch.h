@@ -0,0 +1,98 @@
+#ifndef _UDP_BATCH_H_
+# define _UDP_BATCH_H_
+
+/** \file udp-batch.h
+ * Batched datagram I/O.
+ *
+ * \c udp_rx_t drains up to \c UDP_BATCH_SIZE datagrams with a single
+ * \c recvmmsg, validates them against protocol and hands valid ones
+ * to a handler one by one.
+ *
+ * \c udp_tx_t collects datagrams sent between \c udp_tx_begin and
+ * \c udp_tx_flush and sends them with \c sendmmsg. Outside of such
+ * scope datagrams are sent right away.
+ */
+
+# include "protocol.h"
+
+# include <stddef.h>
+# include <stdint.h>
+# include <stdbool.h>
+# include <sys/socket.h>
+# include <netinet/in.h>
+
+# define UDP_BATCH_SIZE             (64)
+
+/**
+ * Handler of valid datagram.
+ * \param [in] ctx context passed to \c udp_rx_drain
+ * \param [in] packet datagram contents
+ * \param [in] fd socket it came from
+ * \param [in] remote_addr sender
+ */
+typedef void (*udp_rx_handler_t)(void *ctx, const pr_signature_t *packet,
+                                 int fd,
+                                 const struct sockaddr_in *remote_addr);
+
+typedef struct udp_rx {
+    struct mmsghdr msgs[UDP_BATCH_SIZE];
+    struct iovec iov[UDP_BATCH_SIZE];
+    struct sockaddr_in addrs[UDP_BATCH_SIZE];
+    /** indices of datagrams passed validation */
+    uint8_t valid[UDP_BATCH_SIZE];
+    uint8_t buffers[UDP_BATCH_SIZE][PR_MAX_SIZE];
+    /** datagrams received so far, valid or not */
+    uint64_t received;
+} udp_rx_t;
+
+typedef struct udp_tx {
+    struct mmsghdr msgs[UDP_BATCH_SIZE];
+    struct iovec iov[UDP_BATCH_SIZE];
+    struct sockaddr_in addrs[UDP_BATCH_SIZE];
+    uint8_t buffers[UDP_BATCH_SIZE][PR_MAX_SIZE];
+    size_t count;
+    bool batching;
+    /** datagrams sent so far */
+    uint64_t sent;
+} udp_tx_t;
+
+void udp_rx_init(udp_rx_t *rx);
+
+/**
+ * Receive pending datagrams with single \c recvmmsg and act on valid ones.
+ * \param [in] rx receive batch
+ * \param [in] fd UDP socket
+ * \param [in] local_addr own address, datagrams from it are discarded
+ * \param [in] handler called for every valid datagram in arrival order
+ * \param [in] ctx handler context
+ * \return number of datagrams received (valid or not),
+ *         \c 0 if there were none
+ *
+ * Datagrams with unknown signature, of size not matching the signature
+ * or truncated are discarded. Socket error is fatal.
+ */
+int udp_rx_drain(udp_rx_t *rx, int fd, const struct sockaddr *local_addr,
+                 udp_rx_handler_t handler, void *ctx);
+
+void udp_tx_init(udp_tx_t *tx);
+
+/** Start collecting datagrams instead of sending them one by one */
+void udp_tx_begin(udp_tx_t *tx);
+
+/**
+ * Send datagram or queue it while within batching scope.
+ * \param [in] tx transmit batch
+ * \param [in] fd UDP socket to send with
+ * \param [in] d datagram, up to \c PR_MAX_SIZE bytes
+ * \param [in] len datagram length
+ * \param [in] addr destination
+ *
+ * Full batch is flushed with \c fd right away.
+ */
+void udp_tx_send(udp_tx_t *tx, int fd, const void *d, size_t len,
+                 const struct sockaddr_in *addr);
+
+/** Send queued datagrams with \c sendmmsg and leave batching scope */
+void udp_tx_flush(udp_tx_t *tx, int fd);
+
+#endif /* _UDP_BATCH_H_ */
@@ -2,6 +2,7 @@
 #include "log.h"
 
 #include <errno.h>
+#include <limits.h>
 #include <netdb.h>
 #include <string.h>
 #include <unistd.h>
@@ -10,6 +11,7 @@
 #include <net/if.h>
 #include <sys/ioctl.h>
 #include <sys/signalfd.h>
+#include <linux/filter.h>
 
 static
 void signal_caught(int fd, io_svc_op_t op, io_service_t *iosvc) {
@@ -24,11 +26,12 @@ void signal_caught(int fd, io_svc_op_t op, io_service_t *iosvc) {
     close(fd);
 }
 
-int allocate_udp_broadcasting_socket(const char *iface,
-                                     uint16_t local_port,
-                                     struct sockaddr *local_addr) {
+static
+int allocate_socket(const char *iface, uint16_t local_port,
+                    struct sockaddr *local_addr, bool reuse_port) {
     static const int BROADCAST = 1;
     static const int REUSE_ADDR = 1;
+    static const int REUSE_PORT = 1;
 
     size_t len;
     int sfd, ret;
@@ -54,12 +57,11 @@ int allocate_udp_broadcasting_socket(const char *iface,
         return -1;
     }
 
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(local_port);
-    addr.sin_family = AF_INET;
-    if (bind(sfd, (const struct sockaddr *)&addr, sizeof(addr))) {
+    if (reuse_port &&
+        0 != setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT,
+                        &REUSE_PORT, sizeof(REUSE_PORT))) {
         LOG(LOG_LEVEL_WARN,
-            "Can't bind: %s\n",
+            "Can't set socket option (SO_REUSEPORT): %s\n",
             strerror(errno));
 
         shutdown(sfd, SHUT_RDWR);
@@ -82,6 +84,20 @@ int allocate_udp_broadcasting_socket(const char *iface,
         return -1;
     }
 
+    /* binding to device after bind drops socket out of SO_REUSEPORT group */
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(local_port);
+    addr.sin_family = AF_INET;
+    if (bind(sfd, (const struct sockaddr *)&addr, sizeof(addr))) {
+        LOG(LOG_LEVEL_WARN,
+            "Can't bind: %s\n",
+            strerror(errno));
+
+        shutdown(sfd, SHUT_RDWR);
+        close(sfd);
+        return -1;
+    }
+
     ret = setsockopt(sfd,
                      SOL_SOCKET, SO_BROADCAST,
                      &BROADCAST, sizeof(BROADCAST));
@@ -115,6 +131,70 @@ int allocate_udp_broadcasting_socket(const char *iface,
     return sfd;
 }
 
+int allocate_udp_broadcasting_socket(const char *iface,
+                                     uint16_t local_port,
+                                     struct sockaddr *local_addr) {
+    return allocate_socket(iface, local_port, local_addr, false);
+}
+
+int allocate_udp_reuseport_socket(const char *iface,
+                                  uint16_t local_port,
+                                  struct sockaddr *local_addr) {
+    return allocate_socket(iface, local_port, local_addr, true);
+}
+
+bool steer_udp_by_source(int sfd, size_t count) {
+    /* network header is reached with negative offset from UDP one */
+    struct sock_filter code[] = {
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_NET_OFF + 12 },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)count },
+        { BPF_RET | BPF_A, 0, 0, 0 },
+    };
+    struct sock_fprog prog = {
+        .len = sizeof(code) / sizeof(code[0]),
+        .filter = code,
+    };
+
+    if (setsockopt(sfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                   &prog, sizeof(prog))) {
+        LOG(LOG_LEVEL_WARN,
+            "Can't set socket option (SO_ATTACH_REUSEPORT_CBPF): %s\n",
+            strerror(errno));
+
+        return false;
+    }
+
+    return true;
+}
+
+bool set_udp_receive_buffer(int sfd, size_t fan_in) {
+    size_t wanted = fan_in * UDP_DATAGRAM_TRUESIZE;
+    int size = wanted > INT_MAX / 2 ? INT_MAX / 2 : (int)wanted;
+    socklen_t len = sizeof(size);
+    int ret;
+
+    ret = setsockopt(sfd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size));
+
+    if (ret != 0)
+        ret = setsockopt(sfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    if (ret != 0) {
+        LOG(LOG_LEVEL_WARN,
+            "Can't set socket option (SO_RCVBUF): %s\n",
+            strerror(errno));
+
+        return false;
+    }
+
+    /* kernel doubles the value and caps it with rmem_max if not forced */
+    if (0 == getsockopt(sfd, SOL_SOCKET, SO_RCVBUF, &size, &len))
+        LOG(LOG_LEVEL_DEBUG,
+            "Receive buffer: %d bytes for fan-in of %zu\n",
+            size, fan_in);
+
+    return true;
+}
+
 int fetch_broadcast_addr(int sfd, const char *iface, struct sockaddr *braddr) {
     struct ifreq ifreq;
     int ret;
@@ -4,6 +4,16 @@
 # include "io-service.h"
 # include <stdint.h>
 
+# include <stddef.h>
+
+/** Default number of peers expected to send at the same moment */
+# define UDP_DEFAULT_FAN_IN             (1024)
+/**
+ * Receive buffer space consumed by a small datagram.
+ * Kernel accounts socket buffer memory along with its bookkeeping.
+ */
+# define UDP_DATAGRAM_TRUESIZE          (1024)
+
 struct addrinfo;
 struct sockaddr;
 
@@ -17,6 +27,37 @@ int allocate_udp_broadcasting_socket(const char *iface,
                                      uint16_t local_port,
                                      struct sockaddr *local_addr);
 
+/**
+ * Allocate UDP socket with broadcasting enabled, joining others bound
+ * to the same port with \c SO_REUSEPORT.
+ * Parameters are as for \c allocate_udp_broadcasting_socket.
+ */
+int allocate_udp_reuseport_socket(const char *iface,
+                                  uint16_t local_port,
+                                  struct sockaddr *local_addr);
+
+/**
+ * Make \c SO_REUSEPORT group deliver unicast datagram to the socket
+ * number <tt>source address % count</tt> in bind order.
+ * \param [in] sfd any socket of the group
+ * \param [in] count number of sockets in the group
+ * \return \c true on success, \c false on failure
+ *
+ * Broadcast datagrams still reach every socket of the group.
+ */
+bool steer_udp_by_source(int sfd, size_t count);
+
+/**
+ * Size socket's receive buffer to hold a datagram from every peer.
+ * \param [in] sfd socket FD
+ * \param [in] fan_in number of peers which may send simultaneously
+ * \return \c true on success, \c false on failure
+ *
+ * \c SO_RCVBUFFORCE is tried first to exceed \c net.core.rmem_max,
+ * it requires the same privileges as binding to an interface.
+ */
+bool set_udp_receive_buffer(int sfd, size_t fan_in);
+
 /**
  * Fetch broadcast address
  * \param [in] sfd socket FD
@@ -0,0 +1,116 @@
+#include "history.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+/** Follow mode polls head that often */
+#define FOLLOW_POLL_MSEC            (100)
+
+static
+void print_usage(const char *self) {
+    printf("usage: %s [-n <records>] [-f] <history file>\n", self);
+    printf("  -n  print that many last records (default 10, 0 for all)\n");
+    printf("  -f  keep printing records as master appends them\n");
+}
+
+static
+void print_sample(uint64_t n, const history_sample_t *s) {
+    char date[32];
+    time_t t = s->timestamp;
+    struct tm tm;
+
+    strftime(date, sizeof(date), "%F %T", localtime_r(&t, &tm));
+
+    printf("%llu %s cycle %u: %u of %u answered, N = %llu, "
+           "T = %d [%d, %d], IL = %u [%u, %u], B = %u\n",
+           (unsigned long long)n, date, (unsigned int)s->cycle,
+           (unsigned int)s->answered, (unsigned int)s->slaves,
+           (unsigned long long)s->count,
+           (int)s->avg_temperature,
+           (int)s->min_temperature, (int)s->max_temperature,
+           (unsigned int)s->avg_illumination,
+           (unsigned int)s->min_illumination,
+           (unsigned int)s->max_illumination,
+           (unsigned int)s->brightness);
+}
+
+/* print records from n up to head, return the next one to print */
+static
+uint64_t print_since(const history_t *h, uint64_t n) {
+    history_sample_t sample;
+    uint64_t head = history_head(h);
+
+    for (; n < head; ++n) {
+        /* overwritten under our feet, skip to the oldest one kept */
+        if (head - n > h->capacity || !history_read(h, n, &sample)) {
+            fprintf(stderr, "record %llu is overwritten\n",
+                    (unsigned long long)n);
+            head = history_head(h);
+            n = head > h->capacity ? head - h->capacity : 0;
+            continue;
+        }
+
+        print_sample(n, &sample);
+    }
+
+    fflush(stdout);
+
+    return n;
+}
+
+int main(int argc, char **argv) {
+    history_t history;
+    unsigned long long last = 10;
+    bool follow = false;
+    uint64_t head, n;
+    struct timespec poll = {
+        .tv_sec = FOLLOW_POLL_MSEC / 1000,
+        .tv_nsec = (FOLLOW_POLL_MSEC % 1000) * 1000000
+    };
+    int opt;
+
+    while (-1 != (opt = getopt(argc, argv, "n:fh"))) {
+        switch (opt) {
+            case 'n':
+                last = strtoull(optarg, NULL, 10);
+                break;
+            case 'f':
+                follow = true;
+                break;
+            default:
+                print_usage(argv[0]);
+                exit(opt == 'h' ? 0 : 2);
+        }
+    }
+
+    if (optind >= argc) {
+        print_usage(argv[0]);
+        exit(0);
+    }
+
+    if (!history_map(&history, argv[optind])) {
+        fprintf(stderr, "Can't map history %s: %s\n",
+                argv[optind], strerror(errno));
+
+        exit(1);
+    }
+
+    if (!last || last > history.capacity)
+        last = history.capacity;
+
+    head = history_head(&history);
+    n = print_since(&history, head > last ? head - last : 0);
+
+    while (follow) {
+        nanosleep(&poll, NULL);
+        n = print_since(&history, n);
+    }
+
+    history_close(&history);
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include "history.h"
+
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**************** private ****************/
+static inline
+size_t file_size(uint64_t capacity) {
+    return sizeof(history_header_t) + capacity * sizeof(history_record_t);
+}
+
+static
+bool header_valid(const history_header_t *hdr, size_t size) {
+    return hdr->magic == HISTORY_MAGIC &&
+           hdr->version == HISTORY_VERSION &&
+           hdr->record_size == sizeof(history_record_t) &&
+           hdr->capacity &&
+           file_size(hdr->capacity) == size;
+}
+
+static
+bool map(history_t *h, int fd, size_t size, int prot) {
+    h->base = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+
+    if (MAP_FAILED == h->base) {
+        h->base = NULL;
+        return false;
+    }
+
+    h->map_size = size;
+    h->hdr = h->base;
+    h->records = (history_record_t *)(h->hdr + 1);
+
+    return true;
+}
+
+/* truncate away old contents, zeroed sequences mean nothing is written */
+static
+bool recreate(int fd, size_t capacity) {
+    history_header_t hdr;
+
+    if (ftruncate(fd, 0) || ftruncate(fd, file_size(capacity)))
+        return false;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = HISTORY_MAGIC;
+    hdr.version = HISTORY_VERSION;
+    hdr.record_size = sizeof(history_record_t);
+    hdr.capacity = capacity;
+
+    return sizeof(hdr) == pwrite(fd, &hdr, sizeof(hdr), 0);
+}
+
+/**************** API ****************/
+bool history_open(history_t *h, const char *path, size_t capacity) {
+    struct stat st;
+    history_header_t hdr;
+    int fd, err;
+
+    assert(h && path && capacity);
+
+    memset(h, 0, sizeof(*h));
+
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st))
+        goto fail;
+
+    if (!(sizeof(hdr) == pread(fd, &hdr, sizeof(hdr), 0) &&
+          header_valid(&hdr, st.st_size) && hdr.capacity == capacity) &&
+        !recreate(fd, capacity))
+        goto fail;
+
+    if (!map(h, fd, file_size(capacity), PROT_READ | PROT_WRITE))
+        goto fail;
+
+    close(fd);
+
+    h->capacity = capacity;
+
+    return true;
+
+fail:
+    err = errno;
+    close(fd);
+    errno = err;
+
+    return false;
+}
+
+bool history_map(history_t *h, const char *path) {
+    struct stat st;
+    int fd, err;
+
+    assert(h && path);
+
+    memset(h, 0, sizeof(*h));
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st))
+        goto fail;
+
+    if ((size_t)st.st_size < sizeof(history_header_t)) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    if (!map(h, fd, st.st_size, PROT_READ))
+        goto fail;
+
+    close(fd);
+
+    if (!header_valid(h->hdr, h->map_size)) {
+        history_close(h);
+        errno = EINVAL;
+
+        return false;
+    }
+
+    h->capacity = h->hdr->capacity;
+
+    return true;
+
+fail:
+    err = errno;
+    close(fd);
+    errno = err;
+
+    return false;
+}
+
+void history_close(history_t *h) {
+    if (h->base)
+        munmap(h->base, h->map_size);
+
+    h->base = NULL;
+    h->hdr = NULL;
+    h->records = NULL;
+}
+
+void history_append(history_t *h, const history_sample_t *sample) {
+    uint64_t n = atomic_load_explicit(&h->hdr->head, memory_order_relaxed);
+    history_record_t *r = &h->records[n % h->capacity];
+
+    /* odd sequence turns readers of the previous occupant away */
+    atomic_store_explicit(&r->seq, 2 * n + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    memcpy(&r->sample, sample, sizeof(*sample));
+
+    atomic_store_explicit(&r->seq, 2 * n + 2, memory_order_release);
+    atomic_store_explicit(&h->hdr->head, n + 1, memory_order_release);
+}
+
+uint64_t history_head(const history_t *h) {
+    return atomic_load_explicit(&h->hdr->head, memory_order_acquire);
+}
+
+bool history_read(const history_t *h, uint64_t n, history_sample_t *sample) {
+    history_record_t *r = &h->records[n % h->capacity];
+    uint64_t seq = atomic_load_explicit(&r->seq, memory_order_acquire);
+
+    if (seq != 2 * n + 2)
+        return false;
+
+    memcpy(sample, &r->sample, sizeof(*sample));
+
+    /* the copy is not reordered after the second check */
+    atomic_thread_fence(memory_order_acquire);
+
+    return seq == atomic_load_explicit(&r->seq, memory_order_relaxed);
+}
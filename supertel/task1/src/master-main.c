@@ -1,24 +1,159 @@
 #include "master.h"
+#include "slave.h"
+#include "history.h"
 #include "io-service.h"
 #include "common.h"
 #include "log.h"
+#include "protocol.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+
+static
+void print_usage(const char *self) {
+    printf("usage: %s [-w <window msec>] [-e] [-g <group>] [-u <group>] [-r] "
+           "[-s <cycles>] [-t <threads>] [-x <cycles>] [-p] "
+           "[-H <file> [-c <records>]] "
+           "<interface> [<expected slaves number>]\n", self);
+    printf("  -w  aggregate responses for that long after request "
+           "(default %d)\n", MASTER_RESPONSE_TIMEOUT_MSEC);
+    printf("  -e  send info as soon as every known slave answered\n");
+    printf("  -g  tier group to master (default 0, the top tier)\n");
+    printf("  -u  tier group to report aggregates to "
+           "(default 0 for sub-masters)\n");
+    printf("  -r  report readings of every slave instead of aggregate\n");
+    printf("  -s  broadcast registry to standbys every that many cycles, "
+           "0 to disable (default %d),\n"
+           "      every slave receives it, use for small groups only\n",
+           MASTER_SNAPSHOT_PERIOD_CYCLES);
+    printf("  -t  receive responses with that many sockets and threads, "
+           "up to %d (default 1, -e is ignored if more)\n",
+           MASTER_MAX_SHARDS);
+    printf("  -x  expire slaves not heard for that many cycles, "
+           "up to %d, 0 to disable (default %d)\n",
+           MASTER_MAX_EXPIRY_CYCLES, MASTER_EXPIRY_CYCLES);
+    printf("  -p  broadcast median, p10, p90, min and max of readings "
+           "after info\n");
+    printf("  -H  append every cycle's aggregates to history file\n");
+    printf("  -c  number of cycles history keeps (default %d)\n",
+           HISTORY_DEFAULT_CAPACITY);
+}
+
+static
+bool parse_group(const char *s, long *group) {
+    char *end;
+
+    *group = strtol(s, &end, 10);
+
+    return *s && !*end && *group >= 0 && *group <= UDP_MAX_GROUP;
+}
 
 int main(int argc, char **argv) {
     master_t master;
+    slave_t uplink;
     io_service_t iosvc;
     char *interface = NULL;
+    size_t fan_in = UDP_DEFAULT_FAN_IN;
+    uint32_t window_msec = MASTER_RESPONSE_TIMEOUT_MSEC;
+    bool early = false;
+    long group = 0, uplink_group = -1;
+    bool readings = false;
+    uint32_t snapshot_period = MASTER_SNAPSHOT_PERIOD_CYCLES;
+    unsigned long shards = 1;
+    unsigned long expiry = MASTER_EXPIRY_CYCLES;
+    bool stats = false;
+    const char *history_path = NULL;
+    size_t history_capacity = HISTORY_DEFAULT_CAPACITY;
+    history_t history;
+    int opt;
+
+    while (-1 != (opt = getopt(argc, argv, "w:eg:u:rs:t:x:pH:c:h"))) {
+        switch (opt) {
+            case 'w':
+                window_msec = strtoul(optarg, NULL, 10);
+                break;
+            case 'e':
+                early = true;
+                break;
+            case 'g':
+                if (parse_group(optarg, &group))
+                    break;
+
+                print_usage(argv[0]);
+                exit(2);
+            case 'u':
+                if (parse_group(optarg, &uplink_group))
+                    break;
+
+                print_usage(argv[0]);
+                exit(2);
+            case 'r':
+                readings = true;
+                break;
+            case 's':
+                snapshot_period = strtoul(optarg, NULL, 10);
+                break;
+            case 't':
+                shards = strtoul(optarg, NULL, 10);
+
+                if (shards && shards <= MASTER_MAX_SHARDS)
+                    break;
+
+                print_usage(argv[0]);
+                exit(2);
+            case 'x':
+                expiry = strtoul(optarg, NULL, 10);
 
-    if (argc < 2) {
-        printf("usage: %s <interface>\n", argv[0]);
+                if (expiry <= MASTER_MAX_EXPIRY_CYCLES)
+                    break;
+
+                print_usage(argv[0]);
+                exit(2);
+            case 'p':
+                stats = true;
+                break;
+            case 'H':
+                history_path = optarg;
+                break;
+            case 'c':
+                history_capacity = strtoull(optarg, NULL, 10);
+
+                if (history_capacity)
+                    break;
+
+                print_usage(argv[0]);
+                exit(2);
+            default:
+                print_usage(argv[0]);
+                exit(opt == 'h' ? 0 : 2);
+        }
+    }
+
+    if (optind >= argc) {
+        print_usage(argv[0]);
         exit(0);
     }
 
-    interface = argv[1];
+    interface = argv[optind];
+
+    if (optind + 1 < argc)
+        fan_in = strtoull(argv[optind + 1], NULL, 10);
+
+    if (!fan_in)
+        fan_in = UDP_DEFAULT_FAN_IN;
+
+    if (uplink_group < 0 && group > 0)
+        uplink_group = 0;
+
+    if (uplink_group == group) {
+        print_usage(argv[0]);
+        exit(2);
+    }
+
+    log_async_start();
 
     io_service_init(&iosvc);
 
@@ -29,16 +164,55 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
-    if (!master_init(&master, &iosvc, interface)) {
+    if (!master_init_shards(&master, &iosvc, interface,
+                            UDP_GROUP_PORT(group), fan_in, shards)) {
         LOG_MSG(LOG_LEVEL_FATAL, "Can't initialize master\n");
 
         exit(1);
     }
 
+    master_set_aggregation(&master, window_msec, early);
+    master_set_replication(&master, snapshot_period);
+    master_set_stats(&master, stats);
+
+    master_set_expiry(&master, expiry);
+
+    if (history_path) {
+        if (!history_open(&history, history_path, history_capacity)) {
+            LOG(LOG_LEVEL_FATAL, "Can't open history %s: %s\n",
+                history_path, strerror(errno));
+
+            exit(1);
+        }
+
+        master_set_history(&master, &history);
+    }
+
+    if (uplink_group >= 0) {
+        if (!slave_init(&uplink, &iosvc, interface,
+                        UDP_GROUP_PORT(uplink_group))) {
+            LOG_MSG(LOG_LEVEL_FATAL, "Can't initialize uplink\n");
+
+            exit(1);
+        }
+
+        slave_set_source(&uplink, &master, readings);
+        slave_start(&uplink);
+    }
+
     master_run(&master);
 
+    if (uplink_group >= 0)
+        slave_deinit(&uplink);
+
     master_deinit(&master);
+
+    if (history_path)
+        history_close(&history);
+
     io_service_deinit(&iosvc);
 
+    log_async_stop();
+
     return 0;
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "master-private.h"
+#include "master-shard.h"
 #include "protocol.h"
+#include "history.h"
 #include "log.h"
 
 #include <stdio.h>
@@ -12,17 +14,111 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+static
+void send_info_message(master_t *m, uint8_t brightness, int fd);
+static
+void send_snapshot(master_t *m);
+static
+void send_stats(master_t *m);
+static
+void record_history(master_t *m, uint8_t brightness);
+static
+void expire_slaves(master_t *m);
+
+static
+void finish_cycle(master_t *m) {
+    bool changed;
+    uint8_t brightness;
+
+    m->aggr.collecting = false;
+
+    if (m->shards)
+        master_shards_merge(m);
+
+    expire_slaves(m);
+
+    LOG(LOG_LEVEL_DEBUG,
+        "Cycle %u finished: %zu of %zu slaves answered\n",
+        (unsigned int)m->aggr.cycle, m->aggr.answered,
+        slave_table_count(&m->slaves));
+
+    changed = master_calculate_averages(m);
+    brightness = master_calculate_brightenss(m);
+
+    if (changed)
+        send_info_message(m, brightness, m->udp_socket);
+
+    if (m->stats.enabled)
+        send_stats(m);
+
+    if (m->history)
+        record_history(m, brightness);
+
+    if (m->snapshot.period && !(m->aggr.cycle % m->snapshot.period))
+        send_snapshot(m);
+}
+
+/*
+ * update slave, averages and info msg wait for the cycle end,
+ * late responses are accounted in the next one
+ */
+static
+void account_response(master_t *m, uint32_t ip,
+                      const slave_description_t *sd) {
+    slave_description_t *registered = master_update_slave(m, ip, sd);
+
+    if (!registered || !m->aggr.collecting)
+        return;
+
+    if (registered->cycle != m->aggr.cycle) {
+        registered->cycle = m->aggr.cycle;
+        ++m->aggr.answered;
+    }
+
+    if (m->aggr.early &&
+        m->aggr.answered == slave_table_count(&m->slaves)) {
+        timer_cancel(&m->aggr.tmr);
+        finish_cycle(m);
+    }
+}
+
+static
+void window_timeout(master_t *m) {
+    if (m->aggr.collecting)
+        finish_cycle(m);
+}
+
 static
 void timeout(master_t *m) {
     pr_request_t request;
     request.s.s = PR_REQUEST;
 
+    /* previous window can't outlive the period, but anyway */
+    if (m->aggr.collecting) {
+        timer_cancel(&m->aggr.tmr);
+        finish_cycle(m);
+    }
+
+    ++m->aggr.cycle;
+    m->aggr.answered = 0;
+    m->aggr.collecting = true;
+
+    if (m->shards)
+        master_shards_begin_cycle(m);
+
+    timer_set_deadline(
+        &m->aggr.tmr,
+        m->aggr.window_msec / 1000,
+        (m->aggr.window_msec % 1000) * 1000000,
+        (tmr_job_t)window_timeout, m
+    );
+
     LOG(LOG_LEVEL_DEBUG,
         "Querying slaves: %s\n",
         inet_ntoa(m->bcast_addr.sin_addr));
 
-    sendto(m->udp_socket, &request, sizeof(request), 0,
-           (struct sockaddr *)&m->bcast_addr, sizeof(m->bcast_addr));
+    udp_tx_send(&m->tx, m->udp_socket, &request, sizeof(request),
+                &m->bcast_addr);
 }
 
 static
@@ -30,8 +126,8 @@ void reset_master(master_t *m) {
     pr_reset_master_t reset;
     reset.s.s = PR_RESET_MASTER;
 
-    sendto(m->udp_socket, &reset, sizeof(reset), 0,
-           (struct sockaddr *)&m->bcast_addr, sizeof(m->bcast_addr));
+    udp_tx_send(&m->tx, m->udp_socket, &reset, sizeof(reset),
+                &m->bcast_addr);
 }
 
 static
@@ -44,27 +140,276 @@ void send_info_message(master_t *m, uint8_t brightness, int fd) {
     snprintf((char *)msg.text, sizeof(msg.text), "%d", (int)m->avg.temperature);
     /*msg.text[sizeof(msg.text) - 1] = '\0';*/
 
-    sendto(m->udp_socket, &msg, sizeof(msg), 0,
-           (struct sockaddr *)&m->bcast_addr, sizeof(m->bcast_addr));
+    if (!m->quiet)
+        udp_tx_send(&m->tx, m->udp_socket, &msg, sizeof(msg),
+                    &m->bcast_addr);
+
+    if (m->relay)
+        master_relay_info(m->relay, &msg);
 }
 
-void
+/* like info, stats is sent only if changed */
+static
+void send_stats(master_t *m) {
+    pr_stats_t stats;
+
+    stats.s.s = PR_STATS;
+    readings_dist_fill_stats(&m->dist, &stats);
+
+    if (!memcmp(stats.temperature, m->stats.sent.temperature,
+                sizeof(stats.temperature)) &&
+        !memcmp(stats.illumination, m->stats.sent.illumination,
+                sizeof(stats.illumination)))
+        return;
+
+    stats.date_time = time(NULL);
+    m->stats.sent = stats;
+
+    LOG(LOG_LEVEL_DEBUG,
+        "    Median: T = %d [%d, %d], IL = %u [%u, %u]\n",
+        (int)stats.temperature[PR_STATS_MEDIAN],
+        (int)stats.temperature[PR_STATS_P10],
+        (int)stats.temperature[PR_STATS_P90],
+        (unsigned int)stats.illumination[PR_STATS_MEDIAN],
+        (unsigned int)stats.illumination[PR_STATS_P10],
+        (unsigned int)stats.illumination[PR_STATS_P90]);
+
+    if (!m->quiet)
+        udp_tx_send(&m->tx, m->udp_socket, &stats, sizeof(stats),
+                    &m->bcast_addr);
+
+    if (m->relay)
+        master_relay_stats(m->relay, &stats);
+}
+
+static
+void send_snapshot_part(master_t *m, pr_snapshot_t *snapshot) {
+    udp_tx_send(&m->tx, m->udp_socket, snapshot,
+                PR_SNAPSHOT_SIZE(snapshot->count), &m->bcast_addr);
+
+    ++snapshot->part;
+    snapshot->count = 0;
+    snapshot->flags &= ~PR_SNAPSHOT_FULL;
+}
+
+static
+void add_snapshot_entry(master_t *m, pr_snapshot_t *snapshot, uint32_t ip,
+                        const slave_description_t *sd) {
+    pr_snapshot_entry_t *e;
+
+    if (snapshot->count == PR_SNAPSHOT_MAX)
+        send_snapshot_part(m, snapshot);
+
+    e = &snapshot->entries[snapshot->count++];
+
+    /* own readings are registered for zero address */
+    e->id = ip ? ip : ntohl(
+        ((const struct sockaddr_in *)&m->local_addr)->sin_addr.s_addr);
+    e->temperature = sd->temperature;
+    e->illumination = sd->illumination;
+    e->count = sd->count;
+}
+
+/*
+ * Full snapshot restarts replicas, deltas carry slaves changed or expired
+ * since previous snapshot only. Nothing is sent if nothing changed.
+ */
+void send_snapshot(master_t *m) {
+    pr_snapshot_t snapshot;
+    slave_table_entry_t *te;
+    /* zero count removes slave from replica */
+    const slave_description_t removed = { 0 };
+    uint32_t *ip;
+    bool full = !(m->snapshot.seq % MASTER_SNAPSHOT_FULL_EVERY);
+    size_t sent = 0;
+
+    snapshot.s.s = PR_SNAPSHOT;
+    snapshot.flags = full ? PR_SNAPSHOT_FULL : 0;
+    snapshot.count = 0;
+    snapshot.part = 0;
+    snapshot.seq = m->snapshot.seq;
+
+    /*
+     * full snapshot doesn't carry expired slaves anyway, removals go
+     * first for slaves which came back to be added again
+     */
+    for (ip = vector_begin(&m->expiry.removed);
+         !full && ip != vector_end(&m->expiry.removed); ++ip) {
+        add_snapshot_entry(m, &snapshot, *ip, &removed);
+        ++sent;
+    }
+
+    vector_remove_range(&m->expiry.removed, 0,
+                        vector_count(&m->expiry.removed));
+
+    for (te = slave_table_next(&m->slaves, NULL); te;
+         te = slave_table_next(&m->slaves, te)) {
+        if (!full && !te->sd.dirty)
+            continue;
+
+        te->sd.dirty = false;
+
+        add_snapshot_entry(m, &snapshot, te->ip, &te->sd);
+        ++sent;
+    }
+
+    if (!full && !sent)
+        return;
+
+    snapshot.flags |= PR_SNAPSHOT_LAST;
+    send_snapshot_part(m, &snapshot);
+
+    LOG(LOG_LEVEL_DEBUG,
+        "Snapshot %u sent: %s, %zu slaves\n",
+        (unsigned int)m->snapshot.seq, full ? "full" : "delta", sent);
+
+    ++m->snapshot.seq;
+}
+
+/* min and max are not maintained incrementally, registry is scanned */
+static
+void record_history(master_t *m, uint8_t brightness) {
+    history_sample_t sample;
+    slave_table_entry_t *e;
+    int32_t temperature;
+    uint32_t illumination;
+    bool first = true;
+
+    memset(&sample, 0, sizeof(sample));
+
+    sample.timestamp = time(NULL);
+    sample.cycle = m->aggr.cycle;
+    sample.answered = m->aggr.answered;
+    sample.slaves = slave_table_count(&m->slaves);
+    sample.count = m->sum.count;
+    sample.sum_temperature = m->sum.temperature;
+    sample.sum_illumination = m->sum.illumination;
+    sample.avg_temperature = m->avg.temperature;
+    sample.avg_illumination = m->avg.illumination;
+    sample.brightness = brightness;
+
+    for (e = slave_table_next(&m->slaves, NULL); e;
+         e = slave_table_next(&m->slaves, e)) {
+        if (!e->sd.count)
+            continue;
+
+        temperature = e->sd.temperature / (int32_t)e->sd.count;
+        illumination = e->sd.illumination / e->sd.count;
+
+        if (first || temperature < sample.min_temperature)
+            sample.min_temperature = temperature;
+        if (first || temperature > sample.max_temperature)
+            sample.max_temperature = temperature;
+        if (first || illumination < sample.min_illumination)
+            sample.min_illumination = illumination;
+        if (first || illumination > sample.max_illumination)
+            sample.max_illumination = illumination;
+
+        first = false;
+    }
+
+    history_append(m->history, &sample);
+}
+
+static
+void remove_slave(master_t *m, uint32_t ip) {
+    slave_description_t sd;
+
+    if (!slave_table_remove(&m->slaves, ip, &sd))
+        return;
+
+    m->sum.temperature -= sd.temperature;
+    m->sum.illumination -= sd.illumination;
+    m->sum.count -= sd.count;
+    readings_dist_remove(&m->dist, &sd);
+
+    if (m->shards)
+        master_shards_remove(m, ip);
+
+    if (m->snapshot.period)
+        *(uint32_t *)vector_append(&m->expiry.removed) = ip;
+
+    ++m->expiry.expired;
+}
+
+/*
+ * Registry's recency list is ordered by cycle heard in, only stale
+ * slaves and the first fresh one are visited. Shards' slaves are merged
+ * a cycle late and may sit ahead of older ones, which are expired a
+ * cycle later then.
+ */
+static
+void expire_slaves(master_t *m) {
+    slave_table_entry_t *e;
+    uint32_t gen;
+    uint64_t expired = m->expiry.expired;
+
+    if (!m->expiry.cycles || m->aggr.cycle < m->expiry.cycles)
+        return;
+
+    gen = m->aggr.cycle - m->expiry.cycles;
+
+    while ((e = slave_table_oldest(&m->slaves)) && e->sd.seen <= gen)
+        remove_slave(m, e->ip);
+
+    if (expired != m->expiry.expired)
+        LOG(LOG_LEVEL_DEBUG,
+            "Expired %llu slaves not heard since cycle %u\n",
+            (unsigned long long)(m->expiry.expired - expired),
+            (unsigned int)gen);
+}
+
+bool
 master_init_(master_t *m,
-             io_service_t *iosvc) {
+             io_service_t *iosvc,
+             size_t expected_slaves) {
     m->iosvc = iosvc;
+    m->expected_slaves = expected_slaves;
+
+    if (!slave_table_init(&m->slaves, expected_slaves))
+        return false;
+
+    m->expiry.cycles = MASTER_EXPIRY_CYCLES;
+    m->expiry.expired = 0;
+    vector_init(&m->expiry.removed, sizeof(uint32_t), 0);
 
     timer_init(&m->tmr, m->iosvc);
+    timer_init(&m->aggr.tmr, m->iosvc);
+    udp_tx_init(&m->tx);
+
+    m->quiet = false;
+    m->relay = NULL;
+    m->history = NULL;
+    m->shards = NULL;
+    m->shard_count = 0;
+
+    m->aggr.window_msec = MASTER_RESPONSE_TIMEOUT_MSEC;
+    m->aggr.early = false;
+    m->aggr.collecting = false;
+    m->aggr.cycle = 0;
+    m->aggr.answered = 0;
+
+    m->snapshot.period = MASTER_SNAPSHOT_PERIOD_CYCLES;
+    m->snapshot.seq = 0;
 
     memset(&m->sum, 0, sizeof(m->sum));
     memset(&m->avg, 0, sizeof(m->avg));
+    readings_dist_clear(&m->dist);
 
-    avl_tree_init(&m->slaves, true, sizeof(slave_description_t));
+    m->stats.enabled = false;
+    memset(&m->stats.sent, 0, sizeof(m->stats.sent));
+
+    return true;
 }
 
 void
 master_deinit_(master_t *m) {
+    /* socket outlives internals, don't lose what was queued */
+    udp_tx_flush(&m->tx, m->udp_socket);
     timer_deinit(&m->tmr);
-    avl_tree_purge(&m->slaves);
+    timer_deinit(&m->aggr.tmr);
+    slave_table_deinit(&m->slaves);
+    vector_deinit(&m->expiry.removed);
 }
 
 void
@@ -80,49 +425,65 @@ master_arm_timer(master_t *m) {
 void
 master_disarm_timer(master_t *m) {
     timer_cancel(&m->tmr);
+    timer_cancel(&m->aggr.tmr);
+    m->aggr.collecting = false;
 }
 
-avl_tree_node_t *
+slave_description_t *
 master_update_slave(master_t *m,
                     uint32_t ip,
                     const slave_description_t *sd) {
-    avl_tree_node_t *atn = avl_tree_get(&m->slaves, ip);
-    slave_description_t *atn_sd;
+    slave_description_t *registered;
 
     LOG(LOG_LEVEL_DEBUG,
-        "  Slave: ID = %u, T = %d, IL = %u\n",
+        "  Slave: ID = %u, T = %d, IL = %u, N = %u\n",
         (unsigned int)ip,
         (int)sd->temperature,
-        (unsigned int)sd->illumination);
+        (unsigned int)sd->illumination,
+        (unsigned int)sd->count);
+
+    registered = slave_table_add_or_get(&m->slaves, ip, NULL);
+
+    if (!registered) {
+        LOG(LOG_LEVEL_WARN,
+            "Can't register slave, registry is full (%zu)\n",
+            slave_table_count(&m->slaves));
 
-    if (!atn) {
-        atn = avl_tree_add(&m->slaves, ip);
-        atn_sd = (slave_description_t *)atn->data;
-        memset(atn_sd, 0, sizeof(*atn_sd));
+        return NULL;
     }
-    else
-        atn_sd = (slave_description_t *)atn->data;
 
-    m->sum.temperature -= atn_sd->temperature;
-    m->sum.illumination -= atn_sd->illumination;
+    master_slave_seen(m, registered, m->aggr.cycle);
+
+    if (registered->temperature != sd->temperature ||
+        registered->illumination != sd->illumination ||
+        registered->count != sd->count)
+        registered->dirty = true;
+
+    m->sum.temperature -= registered->temperature;
+    m->sum.illumination -= registered->illumination;
+    m->sum.count -= registered->count;
+    readings_dist_remove(&m->dist, registered);
+
+    registered->temperature = sd->temperature;
+    registered->illumination = sd->illumination;
+    registered->count = sd->count;
 
-    memcpy(atn_sd, sd, sizeof(*atn_sd));
+    m->sum.temperature += registered->temperature;
+    m->sum.illumination += registered->illumination;
+    m->sum.count += registered->count;
+    readings_dist_add(&m->dist, registered);
 
-    m->sum.temperature += atn_sd->temperature;
-    m->sum.illumination += atn_sd->illumination;
+    return registered;
 }
 
 bool
 master_calculate_averages(master_t *m) {
     int8_t prev_temperature = m->avg.temperature;
     uint8_t prev_illumination = m->avg.illumination;
+    uint64_t count = m->sum.count;
 
-    m->avg.temperature = m->slaves.count
-                          ? m->sum.temperature / m->slaves.count
-                          : 0;
-    m->avg.illumination = m->slaves.count
-                          ? m->sum.illumination / m->slaves.count
-                          : 0;
+    m->avg.temperature = count ? m->sum.temperature / (int64_t)count : 0;
+    m->avg.illumination = count ? m->sum.illumination / count : 0;
 
     LOG(LOG_LEVEL_DEBUG,
         "    Averages: T = %d, IL = %u\n",
@@ -138,42 +499,78 @@ master_calculate_brightenss(const master_t *m) {
     return m->avg.illumination + 1;
 }
 
-void
-master_act(master_t *m, const pr_signature_t *packet, int fd,
-           const struct sockaddr_in *remote_addr) {
+bool
+master_parse_answer(const pr_signature_t *packet,
+                    const struct sockaddr_in *remote_addr,
+                    master_account_t account, void *ctx) {
     const pr_response_t *response;
-    const pr_vote_t *vote;
-    avl_tree_node_t *updated_slave;
+    const pr_aggregate_t *aggregate;
+    const pr_readings_t *readings;
     uint32_t slave_addr;
     slave_description_t sd;
-    uint8_t brightness;
-    bool avg_changed = false;
-
-    LOG(LOG_LEVEL_DEBUG,
-        "Master acting for signature: %#02x, from: %s\n",
-        (int)packet->s,
-        inet_ntoa(remote_addr->sin_addr));
+    unsigned int idx;
 
     switch (packet->s) {
         case PR_RESPONSE:
             /* parse */
-            response = (const pr_response_t *)(packet + 1);
+            response = (const pr_response_t *)packet;
             slave_addr = ntohl(remote_addr->sin_addr.s_addr);
 
             sd.illumination = response->illumination;
             sd.temperature = response->temperature;
+            sd.count = 1;
 
-            /* update slave, calculate averages, send new info msg if need to */
-            updated_slave = master_update_slave(m, slave_addr, &sd);
-            avg_changed = master_calculate_averages(m);
+            account(ctx, slave_addr, &sd);
+            break;
+
+        case PR_AGGREGATE:
+            aggregate = (const pr_aggregate_t *)packet;
+            slave_addr = ntohl(remote_addr->sin_addr.s_addr);
 
-            if (!avg_changed)
-                break;
+            sd.illumination = aggregate->illumination;
+            sd.temperature = aggregate->temperature;
+            sd.count = aggregate->count;
 
-            brightness = master_calculate_brightenss(m);
-            send_info_message(m, brightness, fd);
+            account(ctx, slave_addr, &sd);
             break;
 
+        case PR_READINGS:
+            readings = (const pr_readings_t *)packet;
+            sd.count = 1;
+
+            LOG(LOG_LEVEL_DEBUG,
+                "  Readings: %u\n", (unsigned int)readings->count);
+
+            for (idx = 0; idx < readings->count; ++idx) {
+                sd.illumination = readings->readings[idx].illumination;
+                sd.temperature = readings->readings[idx].temperature;
+
+                account(ctx, readings->readings[idx].id, &sd);
+            }
+            break;
+
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+void
+master_act(master_t *m, const pr_signature_t *packet, int fd,
+           const struct sockaddr_in *remote_addr) {
+    const pr_vote_t *vote;
+
+    LOG(LOG_LEVEL_DEBUG,
+        "Master acting for signature: %#02x, from: %s\n",
+        (int)packet->s,
+        inet_ntoa(remote_addr->sin_addr));
+
+    if (master_parse_answer(packet, remote_addr,
+                            (master_account_t)account_response, m))
+        return;
+
+    switch (packet->s) {
         case PR_VOTE:
             /* send master reset packet */
             vote = (const pr_vote_t *)(vote + 1);
@@ -189,7 +586,82 @@ master_act(master_t *m, const pr_signature_t *packet, int fd,
 void
 master_set_broadcast_addr(master_t *m, const struct sockaddr *bcast_addr) {
     memcpy(&m->bcast_addr, bcast_addr, sizeof(*bcast_addr));
-    m->bcast_addr.sin_port = htons(UDP_PORT);
+    m->bcast_addr.sin_port = htons(m->port);
+}
+
+void master_set_aggregation(master_t *m, uint32_t window_msec, bool early) {
+    if (window_msec >= MASTER_REQUEST_TIMEOUT_MSEC)
+        window_msec = MASTER_REQUEST_TIMEOUT_MSEC - 1;
+
+    /* zero deadline would disarm the timer and the window would never end */
+    if (!window_msec)
+        window_msec = 1;
+
+    m->aggr.window_msec = window_msec;
+    m->aggr.early = early;
+}
+
+void
+master_adopt_slaves(master_t *m, slave_table_t *replica, uint32_t self_ip) {
+    slave_table_entry_t *e;
+
+    for (e = slave_table_next(replica, NULL); e;
+         e = slave_table_next(replica, e))
+        if (e->ip != self_ip)
+            master_update_slave(m, e->ip, &e->sd);
+
+    master_calculate_averages(m);
+
+    LOG(LOG_LEVEL_INFO,
+        "Took over %zu slaves, averages: T = %d, IL = %u\n",
+        slave_table_count(&m->slaves),
+        (int)m->avg.temperature,
+        (unsigned int)m->avg.illumination);
+}
+
+void master_set_replication(master_t *m, uint32_t period_cycles) {
+    m->snapshot.period = period_cycles;
+}
+
+void master_set_expiry(master_t *m, uint32_t cycles) {
+    m->expiry.cycles = cycles < MASTER_MAX_EXPIRY_CYCLES
+                       ? cycles : MASTER_MAX_EXPIRY_CYCLES;
+}
+
+void
+master_slave_seen(master_t *m, slave_description_t *sd, uint32_t cycle) {
+    if (sd->seen == cycle)
+        return;
+
+    sd->seen = cycle;
+    slave_table_touch(&m->slaves, sd);
+}
+
+void master_set_stats(master_t *m, bool enabled) {
+    m->stats.enabled = enabled;
+}
+
+void master_set_history(master_t *m, struct history *h) {
+    m->history = h;
+}
+
+void
+master_fill_aggregate(const master_t *m, pr_aggregate_t *aggregate) {
+    aggregate->s.s = PR_AGGREGATE;
+    aggregate->temperature = (int32_t)m->sum.temperature;
+    aggregate->illumination = (uint32_t)m->sum.illumination;
+    aggregate->count = (uint32_t)m->sum.count;
+}
+
+void
+master_relay_info(master_t *m, const pr_msg_t *msg) {
+    udp_tx_send(&m->tx, m->udp_socket, msg, sizeof(*msg), &m->bcast_addr);
+}
+
+void
+master_relay_stats(master_t *m, const pr_stats_t *stats) {
+    udp_tx_send(&m->tx, m->udp_socket, stats, sizeof(*stats),
+                &m->bcast_addr);
 }
 
 void master_start(master_t *m) {
@@ -8,28 +8,44 @@
 
 # define MASTER_AVG_CHANGED true
 
-typedef struct slave_description {
-    int8_t temperature;
-    uint8_t illumination;
-} slave_description_t;
+/**
+ * Account slave's answer.
+ * \param [in] ctx context passed to \c master_parse_answer
+ * \param [in] ip slave address
+ * \param [in] sd slave's description
+ */
+typedef void (*master_account_t)(void *ctx, uint32_t ip,
+                                 const slave_description_t *sd);
 
 /**
- * Update or set slave in master's lookup tree.
+ * Update or set slave in master's registry.
  * \param [in] m master instance
  * \param [in] ip slave address
  * \param [in] sd slave's description
- * \return tree node pointing to the slave
+ * \return slave's description in registry or \c NULL if registry
+ *         failed to grow
  *
- * The function will either add another node or update existing one.
- * Also, \c m->temperature_sum and \c m->illumination_sum will be updated
- * appropriately.
+ * The function will either add another slave or update existing one.
+ * Also, \c m->sum will be updated appropriately.
  *
  */
-avl_tree_node_t *
+slave_description_t *
 master_update_slave(master_t *m,
                     uint32_t ip,
                     const slave_description_t *sd);
 
+/**
+ * Stamp slave as heard in a cycle.
+ * \param [in] m master instance
+ * \param [in] sd slave's description in master's registry
+ * \param [in] cycle master's cycle the slave was heard in
+ *
+ * Slave becomes the newest in registry's recency list once per cycle,
+ * expiry takes the oldest ones off until one heard recently is met.
+ */
+void
+master_slave_seen(master_t *m, slave_description_t *sd, uint32_t cycle);
+
 /**
  * Calculate averages of parameters.
  * \param [in] m master instance
@@ -67,13 +83,16 @@ master_disarm_timer(master_t *m);
  * Initialize master's internals.
  * \param [in] m master instance
  * \param [in] iosvc IO service instance
+ * \param [in] expected_slaves number of slaves to presize registry for
+ * \return \c false if registry can't be allocated
  *
- * The function will initialize timer, slaves lookup tree and
+ * The function will initialize timer, slaves registry and
  * zero paramters sums and averages and timestamps.
  */
-void
+bool
 master_init_(master_t *m,
-             io_service_t *iosvc);
+             io_service_t *iosvc,
+             size_t expected_slaves);
 
 /**
  * Deinitialize master's internals.
@@ -96,6 +115,19 @@ void
 master_act(master_t *m, const pr_signature_t *packet, int fd,
            const struct sockaddr_in *remote_addr);
 
+/**
+ * Parse slave's answer: response, sub-master's aggregate or readings.
+ * \param [in] packet data received header
+ * \param [in] remote_addr remote address
+ * \param [in] account called for every slave the answer carries
+ * \param [in] ctx \c account context
+ * \return \c false if the packet is not an answer
+ */
+bool
+master_parse_answer(const pr_signature_t *packet,
+                    const struct sockaddr_in *remote_addr,
+                    master_account_t account, void *ctx);
+
 /**
  * Set master's broadcast address.
  * \param m master instance
@@ -104,6 +136,42 @@ master_act(master_t *m, const pr_signature_t *packet, int fd,
 void
 master_set_broadcast_addr(master_t *m, const struct sockaddr *bcast_addr);
 
+/**
+ * Fill sub-master's response to upper tier.
+ * \param [in] m master instance
+ * \param [out] aggregate sums over registered slaves
+ */
+void
+master_fill_aggregate(const master_t *m, pr_aggregate_t *aggregate);
+
+/**
+ * Broadcast info message received from upper tier to own slaves.
+ * \param [in] m master instance
+ * \param [in] msg info message
+ */
+void
+master_relay_info(master_t *m, const pr_msg_t *msg);
+
+/**
+ * Broadcast distribution received from upper tier to own slaves.
+ * \param [in] m master instance
+ * \param [in] stats distribution message
+ */
+void
+master_relay_stats(master_t *m, const pr_stats_t *stats);
+
+/**
+ * Take over registry replicated from previous master.
+ * \param [in] m master instance, just initialized
+ * \param [in] replica replicated registry
+ * \param [in] self_ip own address, own entry is not taken over
+ *
+ * Averages are recalculated, so the first info message is based on
+ * the whole registry rather than on first responses.
+ */
+void
+master_adopt_slaves(master_t *m, slave_table_t *replica, uint32_t self_ip);
+
 /**
  * Starts master instance timer
  * \param [in] m master instance
@@ -0,0 +1,356 @@
+#include "master-shard.h"
+#include "protocol.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define STOP_RETRY_MSEC             (10)
+
+/* log slave's state for master's registry */
+static inline
+void log_update(master_shard_t *s, uint32_t ip,
+                const slave_description_t *registered, bool changed) {
+    master_shard_update_t *u =
+        (master_shard_update_t *)vector_append(&s->updates);
+
+    u->ip = ip;
+    u->sd = *registered;
+    u->sd.dirty = changed;
+}
+
+/* same as master_update_slave over shard's registry and sums */
+static
+void account(master_shard_t *s, uint32_t ip, const slave_description_t *sd) {
+    slave_description_t *registered;
+    bool added, changed = false;
+
+    registered = slave_table_add_or_get(&s->slaves, ip, &added);
+
+    if (!registered) {
+        LOG(LOG_LEVEL_WARN,
+            "Can't register slave in shard %zu, registry is full (%zu)\n",
+            s->idx, slave_table_count(&s->slaves));
+
+        return;
+    }
+
+    if (registered->temperature != sd->temperature ||
+        registered->illumination != sd->illumination ||
+        registered->count != sd->count) {
+        readings_dist_remove(&s->dist, registered);
+        readings_dist_add(&s->dist, sd);
+
+        s->sum.temperature += (int64_t)sd->temperature -
+                              registered->temperature;
+        s->sum.illumination += (uint64_t)sd->illumination -
+                               registered->illumination;
+        s->sum.count += (uint64_t)sd->count - registered->count;
+
+        registered->temperature = sd->temperature;
+        registered->illumination = sd->illumination;
+        registered->count = sd->count;
+        changed = true;
+    }
+
+    if (s->collecting && registered->cycle != s->cycle) {
+        registered->cycle = s->cycle;
+        ++s->answered;
+    }
+
+    /* unchanged slave is logged once a cycle to keep it from expiry */
+    if (added || changed || registered->seen != s->cycle) {
+        registered->seen = s->cycle;
+        log_update(s, ip, registered, added || changed);
+    }
+}
+
+static
+void act(master_shard_t *s, const pr_signature_t *packet, int fd,
+         const struct sockaddr_in *remote_addr) {
+    switch (packet->s) {
+        case PR_RESPONSE:
+        case PR_AGGREGATE:
+        case PR_READINGS:
+            /* broadcast answer reaches every shard, the owner accounts it */
+            if (ntohl(remote_addr->sin_addr.s_addr) % s->m->shard_count !=
+                s->idx)
+                break;
+
+            master_parse_answer(packet, remote_addr,
+                                (master_account_t)account, s);
+            break;
+
+        default:
+            /* the rest is broadcast, master acts on it once */
+            if (!s->idx)
+                master_act(s->m, packet, fd, remote_addr);
+            break;
+    }
+}
+
+static
+void data_received(int fd, io_svc_op_t op, master_shard_t *s) {
+    /* only master's own thread may send */
+    if (!s->idx)
+        udp_tx_begin(&s->m->tx);
+
+    pthread_mutex_lock(&s->lock);
+
+    udp_rx_drain(&s->rx, fd, &s->m->local_addr,
+                 (udp_rx_handler_t)act, s);
+
+    pthread_mutex_unlock(&s->lock);
+
+    if (!s->idx)
+        udp_tx_flush(&s->m->tx, fd);
+}
+
+static
+void *shard_routine(master_shard_t *s) {
+    io_service_run(&s->iosvc);
+
+    return NULL;
+}
+
+static
+void stop_shard(master_shard_t *s) {
+    struct timespec deadline;
+
+    /* stop which comes before the thread runs IO service is lost, repeat */
+    do {
+        io_service_stop(&s->iosvc, false);
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += STOP_RETRY_MSEC * 1000000;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+    } while (ETIMEDOUT == pthread_timedjoin_np(s->thread, NULL, &deadline));
+
+    s->running = false;
+}
+
+/**************** API ****************/
+bool master_shards_init(master_t *m, const int *sockets, size_t count) {
+    master_shard_t *s;
+    size_t idx;
+
+    m->shards = calloc(count, sizeof(*m->shards));
+
+    if (!m->shards)
+        return false;
+
+    m->shard_count = count;
+
+    for (idx = 0; idx < count; ++idx) {
+        s = &m->shards[idx];
+
+        s->m = m;
+        s->idx = idx;
+        s->udp_socket = sockets[idx];
+        s->running = false;
+
+        udp_rx_init(&s->rx);
+        pthread_mutex_init(&s->lock, NULL);
+        vector_init(&s->updates, sizeof(master_shard_update_t), 0);
+        vector_init(&s->merging, sizeof(master_shard_update_t), 0);
+
+        if (idx)
+            io_service_init(&s->iosvc);
+
+        if (!slave_table_init(&s->slaves, m->expected_slaves / count)) {
+            m->shard_count = idx + 1;
+            master_shards_deinit(m);
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void master_shards_deinit(master_t *m) {
+    master_shard_t *s;
+    size_t idx;
+
+    for (idx = 0; idx < m->shard_count; ++idx) {
+        s = &m->shards[idx];
+
+        if (s->running)
+            stop_shard(s);
+
+        LOG(LOG_LEVEL_INFO, "Shard %zu: received %llu datagrams, %zu slaves\n",
+            idx, (unsigned long long)s->rx.received,
+            slave_table_count(&s->slaves));
+
+        if (idx) {
+            io_service_deinit(&s->iosvc);
+            shutdown(s->udp_socket, SHUT_RDWR);
+            close(s->udp_socket);
+        }
+
+        slave_table_deinit(&s->slaves);
+        vector_deinit(&s->updates);
+        vector_deinit(&s->merging);
+        pthread_mutex_destroy(&s->lock);
+    }
+
+    free(m->shards);
+    m->shards = NULL;
+    m->shard_count = 0;
+}
+
+bool master_shards_start(master_t *m) {
+    master_shard_t *s;
+    sigset_t all, old;
+    size_t idx;
+    int ret = 0;
+
+    io_service_post_job(m->iosvc, m->shards[0].udp_socket, IO_SVC_OP_READ,
+                        !IOSVC_JOB_ONESHOT,
+                        (iosvc_job_function_t)data_received,
+                        &m->shards[0]);
+
+    /* shards must not take signals awaited with signalfd by the caller */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    for (idx = 1; idx < m->shard_count && !ret; ++idx) {
+        s = &m->shards[idx];
+
+        io_service_post_job(&s->iosvc, s->udp_socket, IO_SVC_OP_READ,
+                            !IOSVC_JOB_ONESHOT,
+                            (iosvc_job_function_t)data_received,
+                            s);
+
+        ret = pthread_create(&s->thread, NULL,
+                             (void *(*)(void *))shard_routine, s);
+        s->running = !ret;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (ret)
+        LOG(LOG_LEVEL_FATAL,
+            "Can't start shard thread: %s\n", strerror(ret));
+
+    return !ret;
+}
+
+void master_shards_begin_cycle(master_t *m) {
+    master_shard_t *s;
+    size_t idx;
+
+    for (idx = 0; idx < m->shard_count; ++idx) {
+        s = &m->shards[idx];
+
+        pthread_mutex_lock(&s->lock);
+
+        s->cycle = m->aggr.cycle;
+        s->collecting = true;
+        s->answered = 0;
+
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+void master_shards_merge(master_t *m) {
+    master_shard_t *s;
+    master_shard_update_t *u;
+    slave_description_t *registered;
+    vector_t swapped;
+    uint32_t seen;
+    size_t idx;
+
+    memset(&m->sum, 0, sizeof(m->sum));
+    readings_dist_clear(&m->dist);
+    m->aggr.answered = 0;
+
+    for (idx = 0; idx < m->shard_count; ++idx) {
+        s = &m->shards[idx];
+
+        pthread_mutex_lock(&s->lock);
+
+        s->collecting = false;
+
+        m->sum.temperature += s->sum.temperature;
+        m->sum.illumination += s->sum.illumination;
+        m->sum.count += s->sum.count;
+        readings_dist_merge(&m->dist, &s->dist);
+        m->aggr.answered += s->answered;
+
+        /* shard goes on logging into the emptied spare */
+        swapped = s->updates;
+        s->updates = s->merging;
+        s->merging = swapped;
+
+        pthread_mutex_unlock(&s->lock);
+
+        for (u = vector_begin(&s->merging); u != vector_end(&s->merging);
+             ++u) {
+            registered = slave_table_add_or_get(&m->slaves, u->ip, NULL);
+
+            if (!registered) {
+                LOG(LOG_LEVEL_WARN,
+                    "Can't merge slave, registry is full (%zu)\n",
+                    slave_table_count(&m->slaves));
+                break;
+            }
+
+            /* stays dirty for master's registry snapshot */
+            if (u->sd.dirty) {
+                seen = registered->seen;
+                *registered = u->sd;
+                registered->seen = seen;
+            }
+
+            master_slave_seen(m, registered, u->sd.seen);
+        }
+
+        vector_remove_range(&s->merging, 0, vector_count(&s->merging));
+    }
+}
+
+void master_shards_remove(master_t *m, uint32_t ip) {
+    master_shard_t *s;
+    master_shard_update_t *u, *kept;
+    slave_description_t sd;
+    size_t idx;
+
+    for (idx = 0; idx < m->shard_count; ++idx) {
+        s = &m->shards[idx];
+
+        pthread_mutex_lock(&s->lock);
+
+        if (slave_table_remove(&s->slaves, ip, &sd)) {
+            s->sum.temperature -= sd.temperature;
+            s->sum.illumination -= sd.illumination;
+            s->sum.count -= sd.count;
+            readings_dist_remove(&s->dist, &sd);
+        }
+
+        /* logged since merge, must not bring it back */
+        kept = vector_begin(&s->updates);
+
+        for (u = kept; u != vector_end(&s->updates); ++u)
+            if (u->ip != ip)
+                *kept++ = *u;
+
+        vector_remove_range(&s->updates,
+                            kept - (master_shard_update_t *)
+                                   vector_begin(&s->updates),
+                            (master_shard_update_t *)
+                                vector_end(&s->updates) - kept);
+
+        pthread_mutex_unlock(&s->lock);
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef _MASTER_SHARD_H_
+# define _MASTER_SHARD_H_
+
+/** \file master-shard.h
+ * Standalone master's receive shards.
+ *
+ * Every shard owns a socket of \c SO_REUSEPORT group, which delivers
+ * slave's unicast to shard number <tt>address % count</tt>, a registry of
+ * slaves it owns and partial sums over them. Broadcast reaches every
+ * shard, only the owner accounts it.
+ *
+ * Shard 0 is served by master's IO service, others by a thread each.
+ * Shard logs every change of a slave and first answer of a slave within
+ * a cycle. At cycle end master adds partial sums up and swaps the log out
+ * under shard's lock, then applies it to own registry, which snapshots,
+ * readings, expiry and takeover rely on, with shard running on. Merge
+ * costs O(slaves heard), not O(registry).
+ */
+
+# include "master.h"
+# include "master-private.h"
+# include "io-service.h"
+# include "slave-table.h"
+# include "udp-batch.h"
+# include "containers.h"
+
+# include <stddef.h>
+# include <stdint.h>
+# include <stdbool.h>
+# include <pthread.h>
+
+/** Slave's state as of an answer, logged for master's registry */
+typedef struct master_shard_update {
+    uint32_t ip;
+    /** \c dirty is set if readings changed */
+    slave_description_t sd;
+} master_shard_update_t;
+
+typedef struct master_shard {
+    master_t *m;
+    size_t idx;
+    int udp_socket;
+    udp_rx_t rx;
+
+    /** shard's own IO service, unused by shard 0 */
+    io_service_t iosvc;
+    pthread_t thread;
+    bool running;
+
+    /** guards everything below */
+    pthread_mutex_t lock;
+    /** slaves owned */
+    slave_table_t slaves;
+    struct {
+        int64_t temperature;
+        uint64_t illumination;
+        uint64_t count;
+    } sum;
+    readings_dist_t dist;
+    /** master_shard_update_t logged since merge */
+    vector_t updates;
+    /** log swapped out by merge, master's thread only */
+    vector_t merging;
+    /** master's current cycle */
+    uint32_t cycle;
+    bool collecting;
+    /** owned slaves answered within current cycle */
+    size_t answered;
+} master_shard_t;
+
+/**
+ * Set up shards over sockets of \c SO_REUSEPORT group.
+ * \param [in] m master instance, initialized over the first socket
+ * \param [in] sockets \c count sockets in bind order
+ * \return \c false if shards can't be allocated
+ *
+ * Master takes sockets over, \c master_shards_deinit closes them but
+ * the first one.
+ */
+bool master_shards_init(master_t *m, const int *sockets, size_t count);
+void master_shards_deinit(master_t *m);
+
+/**
+ * Post shard 0 job to master's IO service and start other shards' threads.
+ * \return \c false if a thread can't be started
+ */
+bool master_shards_start(master_t *m);
+
+/** Let shards count answers to master's current cycle */
+void master_shards_begin_cycle(master_t *m);
+/** Stop counting answers, merge shards into master's registry and sums */
+void master_shards_merge(master_t *m);
+/**
+ * Remove expired slave from shards and their sums.
+ *
+ * Readings' slaves are owned by the shard owning their sub-master, so
+ * every shard is looked into.
+ */
+void master_shards_remove(master_t *m, uint32_t ip);
+
+#endif /* _MASTER_SHARD_H_ */
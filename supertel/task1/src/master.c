@@ -1,5 +1,6 @@
 #include "master.h"
 #include "master-private.h"
+#include "master-shard.h"
 #include "protocol.h"
 #include "log.h"
 #include "common.h"
@@ -18,139 +19,150 @@
 #include <arpa/inet.h>
 
 #include <sys/socket.h>
-#include <sys/ioctl.h>
 
 static
 void data_received(int fd, io_svc_op_t op, master_t *m) {
-    pr_signature_t *packet = NULL;
-    int pending;
-    int ret;
-    ssize_t bytes_read;
-    ssize_t buf_size;
-    uint8_t buffer[PR_MAX_SIZE];
-    struct sockaddr_storage remote_addr;
-    socklen_t remote_addr_len;
-
-    /* peek */
-    ret = ioctl(fd, FIONREAD, &pending);
-    if (ret != 0) {
-        LOG(LOG_LEVEL_FATAL,
-            "Can't pending datagram size with ioctl(FIONREAD): %s\n",
-            strerror(errno));
-        abort();
-    }
+    LOG_LN();
 
-    if (pending > PR_MAX_SIZE || pending < PR_MIN_SIZE) {
-        /* discard this datagram */
-        /* read big chunks */
-        while (pending >= PR_MAX_SIZE) {
-            bytes_read = recv(fd, buffer, PR_MAX_SIZE, 0);
-            if (bytes_read < 0) {
-                LOG(LOG_LEVEL_FATAL,
-                    "Can't read data: %s\n",
-                    strerror(errno));
-                abort();
-            }
-
-            pending -= bytes_read;
-        }
+    udp_tx_begin(&m->tx);
 
-        /* red the rest */
-        while (pending) {
-            bytes_read = recv(fd, buffer, pending, 0);
-            if (bytes_read < 0) {
-                LOG(LOG_LEVEL_FATAL,
-                    "Can't read data: %s\n",
-                    strerror(errno));
-                abort();
-            }
-
-            pending -= bytes_read;
-        }
+    udp_rx_drain(&m->rx, fd, &m->local_addr,
+                 (udp_rx_handler_t)master_act, m);
 
-        return;
-    }
+    udp_tx_flush(&m->tx, fd);
+}
 
-    /* read datagram */
-    buf_size = 0;
-    while (pending) {
-        bytes_read = recvfrom(fd, (uint8_t *)(buffer) + buf_size, pending, 0,
-                              (struct sockaddr *)&remote_addr, &remote_addr_len);
-        if (bytes_read < 0) {
-            LOG(LOG_LEVEL_FATAL,
-                "Can't read data: %s\n",
-                strerror(errno));
-            abort();
-        }
+/**************** API ****************/
+bool master_init(master_t *m, io_service_t *iosvc,
+                 const char *iface, uint16_t port, size_t fan_in) {
+    struct sockaddr local_addr;
+    struct sockaddr brcast_addr;
+    int sfd;
 
-        pending -= bytes_read;
-        buf_size += bytes_read;
-    }
+    assert(m && iosvc && iface);
 
-    /* parse and act */
-    packet = (pr_signature_t *)buffer;
+    /* find suitable local address */
+    sfd = allocate_udp_broadcasting_socket(iface, port, &local_addr);
 
-    if (packet->s >= PR_COUNT) {
-        /* invalid, discard*/
-        LOG(LOG_LEVEL_WARN,
-            "Invalid signature received: %#02x\n",
-            (int)(packet->s));
+    if (sfd < 0) {
+        LOG(LOG_LEVEL_FATAL,
+            "Can't locate suitable socket: %s",
+            strerror(errno));
 
-        return;
+        return false;
     }
 
-    if (buf_size != PR_STRUCT_EXPECTED_SIZE[packet->s]) {
-        /* invalid, discard */
-        LOG(LOG_LEVEL_WARN,
-            "Invalid size of datagram received: %lu instead of %lu\n",
-            buf_size, PR_STRUCT_EXPECTED_SIZE[packet->s]);
+    /* not fatal, defaults would do for a small network */
+    set_udp_receive_buffer(sfd, fan_in);
+
+    /* fetch broadcast addr */
+    if (0 > fetch_broadcast_addr(sfd, iface, &brcast_addr)) {
+        LOG(LOG_LEVEL_FATAL,
+            "Can't fetch broadcast address with ioctl(SIOCGIFBRDADDR): %s\n",
+            strerror(errno));
+
+        shutdown(sfd, SHUT_RDWR);
+        close(sfd);
 
-        return;
+        return false;
     }
 
-    if (((struct sockaddr_in *)&remote_addr)->sin_addr.s_addr ==
-        ((struct sockaddr_in *)&m->local_addr)->sin_addr.s_addr) /* discard */
-        return;
+    if (!master_init_socket(m, iosvc, sfd, &local_addr, &brcast_addr,
+                            port, fan_in)) {
+        shutdown(sfd, SHUT_RDWR);
+        close(sfd);
 
-    LOG_LN();
+        return false;
+    }
 
-    master_act(m, packet, fd, (struct sockaddr_in *)&remote_addr);
+    return true;
 }
 
-/**************** API ****************/
-bool master_init(master_t *m, io_service_t *iosvc,
-                 const char *iface) {
+bool master_init_shards(master_t *m, io_service_t *iosvc,
+                        const char *iface, uint16_t port, size_t fan_in,
+                        size_t shards) {
+    struct sockaddr local_addr;
     struct sockaddr brcast_addr;
+    int sockets[MASTER_MAX_SHARDS];
+    size_t opened;
 
-    assert(m && iosvc && iface);
+    assert(m && iosvc && iface && shards && shards <= MASTER_MAX_SHARDS);
 
-    master_init_(m, iosvc);
+    if (1 == shards)
+        return master_init(m, iosvc, iface, port, fan_in);
 
-    /* find suitable local address */
-    m->udp_socket = allocate_udp_broadcasting_socket(
-        iface, UDP_PORT, &m->local_addr);
+    /* sockets join SO_REUSEPORT group in bind order */
+    for (opened = 0; opened < shards; ++opened) {
+        sockets[opened] = allocate_udp_reuseport_socket(iface, port,
+                                                        &local_addr);
 
-    if (m->udp_socket < 0) {
-        LOG(LOG_LEVEL_FATAL,
-            "Can't locate suitable socket: %s",
-            strerror(errno));
+        if (sockets[opened] < 0) {
+            LOG(LOG_LEVEL_FATAL,
+                "Can't locate suitable socket for shard %zu: %s\n",
+                opened, strerror(errno));
 
-        return false;
+            goto fail;
+        }
+
+        set_udp_receive_buffer(sockets[opened], fan_in);
     }
 
-    /* fetch broadcast addr */
-    if (0 > fetch_broadcast_addr(m->udp_socket, iface, &brcast_addr)) {
+    if (!steer_udp_by_source(sockets[0], shards)) {
+        LOG_MSG(LOG_LEVEL_FATAL, "Can't steer slaves to shards\n");
+
+        goto fail;
+    }
+
+    if (0 > fetch_broadcast_addr(sockets[0], iface, &brcast_addr)) {
         LOG(LOG_LEVEL_FATAL,
             "Can't fetch broadcast address with ioctl(SIOCGIFBRDADDR): %s\n",
             strerror(errno));
 
-        shutdown(m->udp_socket, SHUT_RDWR);
-        close(m->udp_socket);
+        goto fail;
+    }
+
+    if (!master_init_socket(m, iosvc, sockets[0], &local_addr, &brcast_addr,
+                            port, fan_in))
+        goto fail;
+
+    if (!master_shards_init(m, sockets, shards)) {
+        LOG(LOG_LEVEL_FATAL,
+            "Can't allocate %zu shards\n", shards);
+
+        master_deinit_(m);
+        goto fail;
+    }
+
+    return true;
+
+fail:
+    while (opened--) {
+        shutdown(sockets[opened], SHUT_RDWR);
+        close(sockets[opened]);
+    }
+
+    return false;
+}
+
+bool master_init_socket(master_t *m, io_service_t *iosvc, int udp_socket,
+                        const struct sockaddr *local_addr,
+                        const struct sockaddr *bcast_addr,
+                        uint16_t port, size_t fan_in) {
+    assert(m && iosvc && udp_socket >= 0 && local_addr && bcast_addr);
+
+    if (!master_init_(m, iosvc, fan_in)) {
+        LOG(LOG_LEVEL_FATAL,
+            "Can't allocate slaves' registry for %zu slaves\n", fan_in);
 
         return false;
     }
 
-    master_set_broadcast_addr(m, &brcast_addr);
+    udp_rx_init(&m->rx);
+    m->port = port;
+    m->udp_socket = udp_socket;
+    memcpy(&m->local_addr, local_addr, sizeof(*local_addr));
+
+    master_set_broadcast_addr(m, bcast_addr);
 
     return true;
 }
@@ -158,28 +170,41 @@ bool master_init(master_t *m, io_service_t *iosvc,
 void master_deinit(master_t *m) {
     assert(m);
 
+    /* shard threads account into registries master_deinit_ frees */
+    if (m->shards)
+        master_shards_deinit(m);
+
     master_deinit_(m);
 
     shutdown(m->udp_socket, SHUT_RDWR);
     close(m->udp_socket);
 }
 
-void master_run(master_t *m) {
+void master_post_jobs(master_t *m) {
     assert(m);
 
-    io_service_post_job(m->iosvc, m->udp_socket, IO_SVC_OP_READ,
-                        !IOSVC_JOB_ONESHOT,
-                        (iosvc_job_function_t)data_received,
-                        m);
+    if (!m->shards)
+        io_service_post_job(m->iosvc, m->udp_socket, IO_SVC_OP_READ,
+                            !IOSVC_JOB_ONESHOT,
+                            (iosvc_job_function_t)data_received,
+                            m);
+    else if (!master_shards_start(m))
+        abort();
 
     /* reset master initialy */
     pr_reset_master_t reset;
     reset.s.s = PR_RESET_MASTER;
 
-    sendto(m->udp_socket, &reset, sizeof(reset), 0,
-           (struct sockaddr *)&m->bcast_addr, sizeof(m->bcast_addr));
+    udp_tx_send(&m->tx, m->udp_socket, &reset, sizeof(reset),
+                &m->bcast_addr);
 
     master_start(m);
+}
+
+void master_run(master_t *m) {
+    assert(m);
+
+    master_post_jobs(m);
 
     LOG(LOG_LEVEL_DEBUG,
         "Running (pid: %d)\n", getpid());
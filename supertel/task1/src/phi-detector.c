@@ -0,0 +1,130 @@
+#include "phi-detector.h"
+
+#include <math.h>
+#include <time.h>
+#include <assert.h>
+
+static
+double stddev(const phi_detector_t *d) {
+    double mean = d->sum / d->count;
+    double var = d->sum_sq / d->count - mean * mean;
+    double sd = var > 0 ? sqrt(var) : 0;
+
+    return sd < PHI_DETECTOR_MIN_STDDEV_MSEC ? PHI_DETECTOR_MIN_STDDEV_MSEC
+                                             : sd;
+}
+
+/* logistic approximation of normal CDF tail */
+static
+double phi_of(double y) {
+    double e = exp(-y * (1.5976 + 0.070566 * y * y));
+
+    if (y > 0)
+        return -log10(e / (1.0 + e));
+
+    return -log10(1.0 - 1.0 / (1.0 + e));
+}
+
+static
+double solve_threshold(double threshold) {
+    double lo = -10.0, hi = 40.0, mid;
+    int idx;
+
+    for (idx = 0; idx < 64; ++idx) {
+        mid = (lo + hi) / 2;
+
+        if (phi_of(mid) < threshold)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return hi;
+}
+
+/**************** API ****************/
+void phi_detector_init(phi_detector_t *d, double threshold) {
+    assert(d && threshold > 0);
+
+    d->threshold = threshold;
+    d->y_threshold = solve_threshold(threshold);
+
+    phi_detector_reset(d);
+}
+
+void phi_detector_reset(phi_detector_t *d) {
+    assert(d);
+
+    d->count = d->next = 0;
+    d->sum = d->sum_sq = 0;
+    d->has_last = false;
+}
+
+void phi_detector_heartbeat(phi_detector_t *d, uint64_t now) {
+    double interval, old;
+
+    assert(d);
+
+    if (!d->has_last) {
+        d->has_last = true;
+        d->last = now;
+        return;
+    }
+
+    interval = (double)(now - d->last);
+    d->last = now;
+
+    if (d->count == PHI_DETECTOR_WINDOW) {
+        old = d->intervals[d->next];
+        d->sum -= old;
+        d->sum_sq -= old * old;
+    }
+    else
+        ++d->count;
+
+    d->intervals[d->next] = interval;
+    d->next = (d->next + 1) % PHI_DETECTOR_WINDOW;
+    d->sum += interval;
+    d->sum_sq += interval * interval;
+}
+
+double phi_detector_mean(const phi_detector_t *d) {
+    assert(d);
+
+    return d->count ? d->sum / d->count : 0;
+}
+
+double phi_detector_phi(const phi_detector_t *d, uint64_t now) {
+    assert(d);
+
+    if (!d->has_last || d->count < PHI_DETECTOR_MIN_SAMPLES)
+        return 0;
+
+    return phi_of(((double)(now - d->last) - phi_detector_mean(d)) /
+                  stddev(d));
+}
+
+bool phi_detector_deadline(const phi_detector_t *d, uint64_t now,
+                           uint64_t *msec) {
+    double at;
+
+    assert(d && msec);
+
+    if (!d->has_last || d->count < PHI_DETECTOR_MIN_SAMPLES)
+        return false;
+
+    at = (double)d->last + phi_detector_mean(d) +
+         d->y_threshold * stddev(d);
+
+    *msec = at > (double)now ? (uint64_t)(at - (double)now) : 0;
+
+    return true;
+}
+
+uint64_t phi_detector_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
@@ -5,5 +5,33 @@ const size_t PR_STRUCT_EXPECTED_SIZE[] = {
     [PR_RESPONSE]       = sizeof(pr_response_t),
     [PR_MSG]            = sizeof(pr_msg_t),
     [PR_VOTE]           = sizeof(pr_vote_t),
-    [PR_RESET_MASTER]   = sizeof(pr_reset_master_t)
+    [PR_RESET_MASTER]   = sizeof(pr_reset_master_t),
+    [PR_AGGREGATE]      = sizeof(pr_aggregate_t),
+    [PR_READINGS]       = PR_READINGS_SIZE(0),
+    [PR_SNAPSHOT]       = PR_SNAPSHOT_SIZE(0),
+    [PR_STATS]          = sizeof(pr_stats_t)
 };
+
+bool pr_size_valid(const pr_signature_t *packet, size_t len) {
+    const pr_readings_t *readings;
+    const pr_snapshot_t *snapshot;
+
+    switch (packet->s) {
+        case PR_READINGS:
+            readings = (const pr_readings_t *)packet;
+
+            return len >= PR_READINGS_SIZE(0) &&
+                   readings->count <= PR_READINGS_MAX &&
+                   len == PR_READINGS_SIZE(readings->count);
+
+        case PR_SNAPSHOT:
+            snapshot = (const pr_snapshot_t *)packet;
+
+            return len >= PR_SNAPSHOT_SIZE(0) &&
+                   snapshot->count <= PR_SNAPSHOT_MAX &&
+                   len == PR_SNAPSHOT_SIZE(snapshot->count);
+
+        default:
+            return len == PR_STRUCT_EXPECTED_SIZE[packet->s];
+    }
+}
@@ -0,0 +1,101 @@
+#include "readings-dist.h"
+
+#include <string.h>
+
+/* percents of quantiles in order of PR_STATS_* */
+static const unsigned int QUANTILE_PERCENT[PR_STATS_QUANTILES] = {
+    [PR_STATS_MIN]      = 0,
+    [PR_STATS_P10]      = 10,
+    [PR_STATS_MEDIAN]   = 50,
+    [PR_STATS_P90]      = 90,
+    [PR_STATS_MAX]      = 100
+};
+
+/**************** private ****************/
+static inline
+unsigned int temperature_bin(const slave_description_t *sd) {
+    int32_t t = sd->temperature / (int32_t)sd->count;
+
+    if (t < INT8_MIN)
+        t = INT8_MIN;
+    else if (t > INT8_MAX)
+        t = INT8_MAX;
+
+    return t - INT8_MIN;
+}
+
+static inline
+unsigned int illumination_bin(const slave_description_t *sd) {
+    uint32_t il = sd->illumination / sd->count;
+
+    return il > UINT8_MAX ? UINT8_MAX : il;
+}
+
+/* nearest rank: quantile q is value number (count - 1) * q / 100 */
+static
+void quantiles(const uint64_t *bins, uint64_t count,
+               unsigned int values[PR_STATS_QUANTILES]) {
+    uint64_t seen = 0;
+    unsigned int bin, k = 0;
+
+    for (bin = 0; bin < READINGS_DIST_BINS && k < PR_STATS_QUANTILES; ++bin) {
+        seen += bins[bin];
+
+        while (k < PR_STATS_QUANTILES &&
+               seen > (count - 1) * QUANTILE_PERCENT[k] / 100)
+            values[k++] = bin;
+    }
+}
+
+/**************** API ****************/
+void readings_dist_clear(readings_dist_t *d) {
+    memset(d, 0, sizeof(*d));
+}
+
+void readings_dist_add(readings_dist_t *d, const slave_description_t *sd) {
+    if (!sd->count)
+        return;
+
+    d->temperature[temperature_bin(sd)] += sd->count;
+    d->illumination[illumination_bin(sd)] += sd->count;
+    d->count += sd->count;
+}
+
+void readings_dist_remove(readings_dist_t *d, const slave_description_t *sd) {
+    if (!sd->count)
+        return;
+
+    d->temperature[temperature_bin(sd)] -= sd->count;
+    d->illumination[illumination_bin(sd)] -= sd->count;
+    d->count -= sd->count;
+}
+
+void readings_dist_merge(readings_dist_t *d, const readings_dist_t *other) {
+    unsigned int bin;
+
+    for (bin = 0; bin < READINGS_DIST_BINS; ++bin) {
+        d->temperature[bin] += other->temperature[bin];
+        d->illumination[bin] += other->illumination[bin];
+    }
+
+    d->count += other->count;
+}
+
+void readings_dist_fill_stats(const readings_dist_t *d, pr_stats_t *stats) {
+    unsigned int temperature[PR_STATS_QUANTILES] = { 0 };
+    unsigned int illumination[PR_STATS_QUANTILES] = { 0 };
+    unsigned int k;
+
+    stats->count = d->count > UINT32_MAX ? UINT32_MAX : d->count;
+
+    if (d->count) {
+        quantiles(d->temperature, d->count, temperature);
+        quantiles(d->illumination, d->count, illumination);
+    }
+
+    for (k = 0; k < PR_STATS_QUANTILES; ++k) {
+        stats->temperature[k] = d->count ?
+                                (int)temperature[k] + INT8_MIN : 0;
+        stats->illumination[k] = illumination[k];
+    }
+}
@@ -0,0 +1,450 @@
+#include "sim-medium.h"
+#include "master.h"
+#include "slave.h"
+#include "io-service.h"
+#include "timer.h"
+#include "common.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define DEFAULT_NODES               (100)
+/* io_service looks jobs up linearly, keep node processes small */
+#define DEFAULT_NODES_PER_PROCESS   (250)
+#define DEFAULT_DURATION_SEC        (60)
+#define DEFAULT_SPREAD_MSEC         (1000)
+#define START_TICK_MSEC             (10)
+#define CONTROL_TICK_MSEC           (100)
+
+typedef struct sim_options {
+    sim_config_t cfg;
+    size_t processes;
+    uint32_t duration_sec;
+    /** nodes start evenly within that time */
+    uint32_t spread_msec;
+    /** node 0 is standalone master */
+    bool with_master;
+    slave_election_t election;
+    /** \c -1 for none */
+    long crash_at_sec;
+    long partition_from_sec;
+    long partition_to_sec;
+    bool verbose;
+} sim_options_t;
+
+/** Nodes run by a single node process */
+typedef struct sim_nodes {
+    const sim_options_t *o;
+    io_service_t *iosvc;
+    size_t lo;
+    size_t hi;
+    /** next node to start */
+    size_t next;
+    slave_t *slaves;
+    bool *started;
+    master_t *master;
+    tmr_t start_tmr;
+    uint64_t started_at;
+} sim_nodes_t;
+
+/** Medium process' schedule */
+typedef struct sim_control {
+    const sim_options_t *o;
+    io_service_t *iosvc;
+    sim_medium_t *medium;
+    uint64_t started_at;
+    bool crashed;
+    bool split;
+    bool healed;
+} sim_control_t;
+
+static
+uint64_t now_msec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static
+void print_usage(const char *self) {
+    printf("usage: %s [-n <nodes>] [-p <processes>] [-d <sec>] [-m] "
+           "[-e] [-L <loss %%>] [-l <msec>] [-j <msec>] [-k <sec>] "
+           "[-P <sec>:<sec>] [-q <quorum %%>] [-s <msec>] [-S <seed>] [-v]\n",
+           self);
+    printf("  -n  nodes to simulate (default %d, at most %d)\n",
+           DEFAULT_NODES, SIM_MAX_NODES);
+    printf("  -p  node processes (default one per %d nodes)\n",
+           DEFAULT_NODES_PER_PROCESS);
+    printf("  -d  run for that long (default %d)\n", DEFAULT_DURATION_SEC);
+    printf("  -m  node 0 is standalone master, others are slaves\n");
+    printf("  -e  slaves delay votes by rank instead of voting at once\n");
+    printf("  -L  lose that share of datagrams, per recipient\n");
+    printf("  -l  deliver datagrams that late\n");
+    printf("  -j  add random latency up to that much\n");
+    printf("  -k  crash current master at that second\n");
+    printf("  -P  split nodes into halves between these seconds\n");
+    printf("  -q  share of nodes to answer a request for convergence "
+           "(default %.0f)\n", SIM_DEFAULT_QUORUM * 100);
+    printf("  -s  start nodes evenly within that time (default %d)\n",
+           DEFAULT_SPREAD_MSEC);
+    printf("  -S  medium's and slaves' random seed\n");
+    printf("  -v  keep nodes' log, it goes to stderr\n");
+}
+
+static
+void start_node(sim_nodes_t *n, size_t idx) {
+    const sim_options_t *o = n->o;
+    struct sockaddr local_addr, bcast_addr;
+    int sfd;
+
+    sfd = sim_node_socket(idx, o->cfg.port, &local_addr, &bcast_addr);
+
+    if (sfd < 0)
+        return;
+
+    if (o->with_master && !idx) {
+        n->master = malloc(sizeof(*n->master));
+
+        if (!n->master ||
+            !master_init_socket(n->master, n->iosvc, sfd,
+                                &local_addr, &bcast_addr,
+                                o->cfg.port, o->cfg.nodes)) {
+            free(n->master);
+            n->master = NULL;
+            close(sfd);
+            return;
+        }
+
+        master_post_jobs(n->master);
+        return;
+    }
+
+    if (!slave_init_socket(&n->slaves[idx - n->lo], n->iosvc, sfd,
+                           &local_addr, &bcast_addr, o->cfg.port)) {
+        close(sfd);
+        return;
+    }
+
+    slave_set_election(&n->slaves[idx - n->lo], o->election);
+    n->started[idx - n->lo] = true;
+    slave_start(&n->slaves[idx - n->lo]);
+}
+
+static
+void start_due(sim_nodes_t *n) {
+    uint64_t elapsed = now_msec() - n->started_at;
+
+    while (n->next < n->hi &&
+           (uint64_t)n->o->spread_msec * n->next / n->o->cfg.nodes <= elapsed)
+        start_node(n, n->next++);
+
+    if (n->next == n->hi)
+        timer_cancel(&n->start_tmr);
+}
+
+static
+int run_nodes(const sim_options_t *o, size_t lo, size_t hi) {
+    io_service_t iosvc;
+    sim_nodes_t n;
+    struct rlimit rl;
+    size_t idx;
+
+    /* socket and three timers per node */
+    if (0 == getrlimit(RLIMIT_NOFILE, &rl)) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    if (!o->verbose && !freopen("/dev/null", "w", stderr))
+        return 1;
+
+    /* processes forked with the same state would vote alike */
+    srandom(o->cfg.seed + lo);
+
+    log_async_start();
+
+    io_service_init(&iosvc);
+
+    if (!wait_for_sigterm_sigint(&iosvc)) {
+        LOG(LOG_LEVEL_FATAL, "Can't initiate SIGTERM awaiting: %s\n",
+            strerror(errno));
+
+        return 1;
+    }
+
+    memset(&n, 0, sizeof(n));
+    n.o = o;
+    n.iosvc = &iosvc;
+    n.lo = n.next = lo;
+    n.hi = hi;
+    n.slaves = calloc(hi - lo, sizeof(*n.slaves));
+    n.started = calloc(hi - lo, sizeof(*n.started));
+
+    if (!n.slaves || !n.started) {
+        LOG_MSG(LOG_LEVEL_FATAL, "Can't allocate nodes\n");
+
+        return 1;
+    }
+
+    n.started_at = now_msec();
+
+    timer_init(&n.start_tmr, &iosvc);
+    timer_set_periodic(&n.start_tmr,
+                       0, START_TICK_MSEC * 1000000,
+                       (tmr_job_t)start_due, &n);
+
+    start_due(&n);
+
+    io_service_run(&iosvc);
+
+    timer_deinit(&n.start_tmr);
+
+    for (idx = 0; idx < hi - lo; ++idx)
+        if (n.started[idx])
+            slave_deinit(&n.slaves[idx]);
+
+    if (n.master) {
+        master_deinit(n.master);
+        free(n.master);
+    }
+
+    free(n.slaves);
+    free(n.started);
+
+    io_service_deinit(&iosvc);
+
+    log_async_stop();
+
+    return 0;
+}
+
+static
+void control(sim_control_t *c) {
+    const sim_options_t *o = c->o;
+    uint64_t elapsed = now_msec() - c->started_at;
+
+    if (o->crash_at_sec >= 0 && !c->crashed &&
+        elapsed >= (uint64_t)o->crash_at_sec * 1000 &&
+        c->medium->master >= 0) {
+        LOG(LOG_LEVEL_INFO,
+            "Crashing master: node %ld\n", c->medium->master);
+
+        sim_medium_crash(c->medium, c->medium->master);
+        sim_medium_mark(c->medium, "master crash");
+        c->crashed = true;
+    }
+
+    if (o->partition_from_sec >= 0 && !c->split &&
+        elapsed >= (uint64_t)o->partition_from_sec * 1000) {
+        sim_medium_partition(c->medium, true);
+        sim_medium_mark(c->medium, "partition");
+        c->split = true;
+    }
+
+    if (c->split && !c->healed &&
+        elapsed >= (uint64_t)o->partition_to_sec * 1000) {
+        sim_medium_partition(c->medium, false);
+        sim_medium_mark(c->medium, "partition heal");
+        c->healed = true;
+    }
+
+    if (elapsed >= (uint64_t)o->duration_sec * 1000)
+        io_service_stop(c->iosvc, false);
+}
+
+static
+bool parse_partition(const char *s, sim_options_t *o) {
+    char *end;
+
+    o->partition_from_sec = strtol(s, &end, 10);
+
+    if (end == s || ':' != *end)
+        return false;
+
+    s = end + 1;
+    o->partition_to_sec = strtol(s, &end, 10);
+
+    return end != s && !*end && o->partition_from_sec >= 0 &&
+           o->partition_to_sec > o->partition_from_sec;
+}
+
+int main(int argc, char **argv) {
+    sim_options_t o;
+    sim_medium_t medium;
+    sim_control_t c;
+    io_service_t iosvc;
+    tmr_t control_tmr;
+    pid_t *pids;
+    size_t idx, per_process;
+    int opt;
+
+    memset(&o, 0, sizeof(o));
+    o.cfg.nodes = DEFAULT_NODES;
+    o.cfg.port = SIM_DEFAULT_PORT;
+    o.cfg.seed = time(NULL);
+    o.cfg.quorum = SIM_DEFAULT_QUORUM;
+    o.duration_sec = DEFAULT_DURATION_SEC;
+    o.spread_msec = DEFAULT_SPREAD_MSEC;
+    o.crash_at_sec = o.partition_from_sec = o.partition_to_sec = -1;
+
+    while (-1 != (opt = getopt(argc, argv, "n:p:d:meL:l:j:k:P:q:s:S:vh"))) {
+        switch (opt) {
+            case 'n':
+                o.cfg.nodes = strtoull(optarg, NULL, 10);
+                break;
+            case 'p':
+                o.processes = strtoull(optarg, NULL, 10);
+                break;
+            case 'd':
+                o.duration_sec = strtoul(optarg, NULL, 10);
+                break;
+            case 'm':
+                o.with_master = true;
+                break;
+            case 'e':
+                o.election = SLAVE_ELECTION_DELAYED;
+                break;
+            case 'L':
+                o.cfg.loss = strtod(optarg, NULL) / 100;
+                break;
+            case 'l':
+                o.cfg.latency_msec = strtoul(optarg, NULL, 10);
+                break;
+            case 'j':
+                o.cfg.jitter_msec = strtoul(optarg, NULL, 10);
+                break;
+            case 'k':
+                o.crash_at_sec = strtol(optarg, NULL, 10);
+                break;
+            case 'P':
+                if (parse_partition(optarg, &o))
+                    break;
+
+                print_usage(argv[0]);
+                exit(2);
+            case 'q':
+                o.cfg.quorum = strtod(optarg, NULL) / 100;
+                break;
+            case 's':
+                o.spread_msec = strtoul(optarg, NULL, 10);
+                break;
+            case 'S':
+                o.cfg.seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'v':
+                o.verbose = true;
+                break;
+            default:
+                print_usage(argv[0]);
+                exit(opt == 'h' ? 0 : 2);
+        }
+    }
+
+    if (!o.cfg.nodes || o.cfg.nodes > SIM_MAX_NODES ||
+        o.cfg.loss < 0 || o.cfg.loss > 1 ||
+        o.cfg.quorum <= 0 || o.cfg.quorum > 1) {
+        print_usage(argv[0]);
+        exit(2);
+    }
+
+    if (!o.processes)
+        o.processes = (o.cfg.nodes + DEFAULT_NODES_PER_PROCESS - 1) /
+                      DEFAULT_NODES_PER_PROCESS;
+
+    if (o.processes > o.cfg.nodes)
+        o.processes = o.cfg.nodes;
+
+    io_service_init(&iosvc);
+
+    /* bound before nodes start sending */
+    if (!sim_medium_init(&medium, &iosvc, &o.cfg)) {
+        fprintf(stderr, "Can't initialize medium\n");
+
+        exit(1);
+    }
+
+    pids = calloc(o.processes, sizeof(*pids));
+
+    if (!pids)
+        exit(1);
+
+    per_process = (o.cfg.nodes + o.processes - 1) / o.processes;
+
+    for (idx = 0; idx < o.processes; ++idx) {
+        size_t lo = idx * per_process;
+        size_t hi = lo + per_process < o.cfg.nodes ? lo + per_process
+                                                   : o.cfg.nodes;
+
+        if (lo >= hi)
+            break;
+
+        pids[idx] = fork();
+
+        if (pids[idx] < 0) {
+            fprintf(stderr, "Can't fork: %s\n", strerror(errno));
+            break;
+        }
+
+        if (!pids[idx]) {
+            close(medium.udp_socket);
+            exit(run_nodes(&o, lo, hi));
+        }
+    }
+
+    log_async_start();
+
+    if (!wait_for_sigterm_sigint(&iosvc)) {
+        LOG(LOG_LEVEL_FATAL, "Can't initiate SIGTERM awaiting: %s\n",
+            strerror(errno));
+    }
+    else {
+        c.o = &o;
+        c.iosvc = &iosvc;
+        c.medium = &medium;
+        c.started_at = now_msec();
+        c.crashed = c.split = c.healed = false;
+
+        sim_medium_start(&medium);
+        sim_medium_mark(&medium, "start");
+
+        timer_init(&control_tmr, &iosvc);
+        timer_set_periodic(&control_tmr,
+                           0, CONTROL_TICK_MSEC * 1000000,
+                           (tmr_job_t)control, &c);
+
+        io_service_run(&iosvc);
+
+        timer_deinit(&control_tmr);
+    }
+
+    for (idx = 0; idx < o.processes; ++idx)
+        if (pids[idx] > 0)
+            kill(pids[idx], SIGTERM);
+
+    for (idx = 0; idx < o.processes; ++idx)
+        if (pids[idx] > 0)
+            waitpid(pids[idx], NULL, 0);
+
+    printf("processes: %zu, seed: %llu\n",
+           o.processes, (unsigned long long)o.cfg.seed);
+    sim_medium_report(&medium, stdout);
+
+    sim_medium_deinit(&medium);
+    io_service_deinit(&iosvc);
+    free(pids);
+
+    log_async_stop();
+
+    return 0;
+}
@@ -0,0 +1,723 @@
+#include "sim-medium.h"
+#include "common.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define NET_MASK                (0xffff0000u)
+#define REAL_NET                (0x7f010000u)
+#define ALIAS_NET               (0x7f020000u)
+#define BROADCAST               (0x7f03ffffu)
+/* datagrams handled per readiness event, keeps timers going under load */
+#define RECEIVE_BATCH           (256)
+
+static
+void deliver(sim_medium_t *m, uint32_t from, uint32_t to,
+             const sim_payload_t *p);
+static
+void delivery_timeout(sim_medium_t *m);
+
+static
+uint64_t now_msec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* xorshift64* */
+static
+uint64_t next_rand(sim_medium_t *m) {
+    uint64_t x = m->rng;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    m->rng = x;
+
+    return x * 0x2545f4914f6cdd1dull;
+}
+
+static
+bool chance(sim_medium_t *m, double p) {
+    return p > 0 && (double)(next_rand(m) >> 11) / (double)(1ull << 53) < p;
+}
+
+static
+void set_addr(struct sockaddr_in *addr, uint32_t ip, uint16_t port) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(ip);
+    addr->sin_port = htons(port);
+}
+
+static
+void payload_release(sim_payload_t *p) {
+    if (!--p->refs)
+        free(p);
+}
+
+static
+void queue_swap(sim_medium_t *m, size_t a, size_t b) {
+    sim_delivery_t tmp = m->queue[a];
+
+    m->queue[a] = m->queue[b];
+    m->queue[b] = tmp;
+}
+
+static
+bool queue_push(sim_medium_t *m, const sim_delivery_t *d) {
+    sim_delivery_t *grown;
+    size_t idx, parent;
+
+    if (m->queued == m->capacity) {
+        grown = realloc(m->queue,
+                        (m->capacity ? m->capacity * 2 : 1024) *
+                        sizeof(*m->queue));
+
+        if (!grown)
+            return false;
+
+        m->queue = grown;
+        m->capacity = m->capacity ? m->capacity * 2 : 1024;
+    }
+
+    idx = m->queued++;
+    m->queue[idx] = *d;
+
+    for (; idx; idx = parent) {
+        parent = (idx - 1) / 2;
+
+        if (m->queue[parent].due <= m->queue[idx].due)
+            break;
+
+        queue_swap(m, idx, parent);
+    }
+
+    return true;
+}
+
+static
+void queue_pop(sim_medium_t *m, sim_delivery_t *d) {
+    size_t idx = 0, child;
+
+    *d = m->queue[0];
+    m->queue[0] = m->queue[--m->queued];
+
+    for (;; idx = child) {
+        child = idx * 2 + 1;
+
+        if (child >= m->queued)
+            break;
+
+        if (child + 1 < m->queued &&
+            m->queue[child + 1].due < m->queue[child].due)
+            ++child;
+
+        if (m->queue[idx].due <= m->queue[child].due)
+            break;
+
+        queue_swap(m, idx, child);
+    }
+}
+
+static
+bool reachable(const sim_medium_t *m, uint32_t from, uint32_t to) {
+    return !m->nodes[to].crashed &&
+           m->nodes[to].partition == m->nodes[from].partition;
+}
+
+static
+void converge(sim_medium_t *m, uint8_t partition, uint64_t cycle_started_at) {
+    sim_event_t *e;
+    size_t p;
+
+    if (!m->event_count)
+        return;
+
+    e = &m->events[m->event_count - 1];
+
+    if (e->converged || cycle_started_at < e->at || !m->pending[partition])
+        return;
+
+    m->pending[partition] = false;
+
+    for (p = 0; p < SIM_PARTITIONS; ++p)
+        if (m->pending[p])
+            return;
+
+    e->converged = true;
+    e->converged_in = now_msec() - e->at;
+}
+
+static
+void close_cycle(sim_medium_t *m, sim_node_t *master) {
+    master->cycle.closed = true;
+
+    if (!master->cycle.expected)
+        return;
+
+    if (master->cycle.answered == master->cycle.expected)
+        ++m->cycles_complete;
+    else
+        ++m->cycles_partial;
+
+    if (master->cycle.answered)
+        histogram_record(&m->cycle_completion,
+                         master->cycle.last_answer_at -
+                         master->cycle.started_at);
+
+    histogram_record(&m->cycle_coverage,
+                     master->cycle.answered * 100 / master->cycle.expected);
+}
+
+/* every started node the master may hear is expected to answer */
+static
+void open_cycle(sim_medium_t *m, uint32_t from) {
+    sim_node_t *master = &m->nodes[from];
+    size_t idx;
+
+    if (master->cycle.id && !master->cycle.closed)
+        close_cycle(m, master);
+
+    if (m->master != (long)from) {
+        /* previous master's cycle is superseded as well */
+        if (m->master >= 0 && m->nodes[m->master].cycle.id &&
+            !m->nodes[m->master].cycle.closed)
+            close_cycle(m, &m->nodes[m->master]);
+
+        m->master = from;
+        ++m->master_changes;
+    }
+
+    master->cycle.id = ++m->last_cycle_id;
+    master->cycle.started_at = master->cycle.last_answer_at = now_msec();
+    master->cycle.answered = 0;
+    master->cycle.expected = 0;
+    master->cycle.quorum = false;
+    master->cycle.closed = false;
+
+    for (idx = 0; idx < m->cfg.nodes; ++idx)
+        if (idx != from && m->nodes[idx].up && reachable(m, from, idx))
+            ++master->cycle.expected;
+
+    /* lone node is its own quorum */
+    if (!master->cycle.expected) {
+        master->cycle.quorum = true;
+        converge(m, master->partition, master->cycle.started_at);
+        close_cycle(m, master);
+    }
+}
+
+static
+void account_answer(sim_medium_t *m, uint32_t from, uint32_t to) {
+    sim_node_t *master = &m->nodes[to];
+    sim_node_t *slave = &m->nodes[from];
+
+    if (!master->cycle.id || master->cycle.closed ||
+        slave->answered == master->cycle.id)
+        return;
+
+    slave->answered = master->cycle.id;
+    master->cycle.last_answer_at = now_msec();
+    ++master->cycle.answered;
+
+    if (!master->cycle.quorum &&
+        master->cycle.answered >= master->cycle.expected * m->cfg.quorum) {
+        master->cycle.quorum = true;
+        converge(m, master->partition, master->cycle.started_at);
+    }
+
+    if (master->cycle.answered == master->cycle.expected)
+        close_cycle(m, master);
+}
+
+static
+void arm_delivery_timer(sim_medium_t *m) {
+    uint64_t now, msec;
+
+    if (!m->queued) {
+        m->armed_for = 0;
+        return;
+    }
+
+    if (m->armed_for && m->armed_for <= m->queue[0].due)
+        return;
+
+    now = now_msec();
+    msec = m->queue[0].due > now ? m->queue[0].due - now : 0;
+    m->armed_for = m->queue[0].due;
+
+    /* zero deadline would disarm the timer */
+    timer_set_deadline(
+        &m->delivery_tmr,
+        msec / 1000,
+        msec ? (msec % 1000) * 1000000 : 1000,
+        (tmr_job_t)delivery_timeout, m
+    );
+}
+
+void delivery_timeout(sim_medium_t *m) {
+    sim_delivery_t d;
+    uint64_t now = now_msec();
+
+    m->armed_for = 0;
+
+    while (m->queued && m->queue[0].due <= now) {
+        queue_pop(m, &d);
+
+        /* crash or partition may have happened while in flight */
+        if (reachable(m, d.from, d.to))
+            deliver(m, d.from, d.to, d.payload);
+        else
+            ++m->cut_off;
+
+        payload_release(d.payload);
+    }
+
+    arm_delivery_timer(m);
+}
+
+static
+void route(sim_medium_t *m, uint32_t from, uint32_t to, sim_payload_t *p) {
+    sim_delivery_t d;
+    uint64_t delay;
+
+    /* socket of node not started yet may even not exist */
+    if (!m->nodes[to].up)
+        return;
+
+    if (!reachable(m, from, to)) {
+        ++m->cut_off;
+        return;
+    }
+
+    if (chance(m, m->cfg.loss)) {
+        ++m->lost;
+        return;
+    }
+
+    delay = m->cfg.latency_msec;
+
+    if (m->cfg.jitter_msec)
+        delay += next_rand(m) % (m->cfg.jitter_msec + 1);
+
+    if (!delay) {
+        deliver(m, from, to, p);
+        return;
+    }
+
+    d.due = now_msec() + delay;
+    d.from = from;
+    d.to = to;
+    d.payload = p;
+
+    if (!queue_push(m, &d)) {
+        ++m->lost;
+        return;
+    }
+
+    ++p->refs;
+    arm_delivery_timer(m);
+}
+
+void deliver(sim_medium_t *m, uint32_t from, uint32_t to,
+             const sim_payload_t *p) {
+    struct sockaddr_in dst;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    struct in_pktinfo *pi;
+    union {
+        struct cmsghdr align;
+        uint8_t buf[CMSG_SPACE(sizeof(struct in_pktinfo))];
+    } control;
+
+    set_addr(&dst, REAL_NET + to + 1, m->cfg.port);
+
+    iov.iov_base = (void *)p->data;
+    iov.iov_len = p->len;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &dst;
+    msg.msg_namelen = sizeof(dst);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    /* any 127/8 address is local, so sender's alias may be the source */
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = IPPROTO_IP;
+    cmsg->cmsg_type = IP_PKTINFO;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(*pi));
+    pi = (struct in_pktinfo *)CMSG_DATA(cmsg);
+    memset(pi, 0, sizeof(*pi));
+    pi->ipi_spec_dst.s_addr = htonl(ALIAS_NET + from + 1);
+
+    if (sendmsg(m->udp_socket, &msg, 0) < 0) {
+        LOG(LOG_LEVEL_WARN,
+            "Can't deliver datagram to node %u: %s\n",
+            (unsigned int)to, strerror(errno));
+
+        return;
+    }
+
+    ++m->delivered;
+    ++m->nodes[to].received;
+
+    switch (p->data[0]) {
+        case PR_RESPONSE:
+        case PR_AGGREGATE:
+        case PR_READINGS:
+            account_answer(m, from, to);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static
+void datagram_received(sim_medium_t *m, uint32_t from, uint32_t dst,
+                       const uint8_t *data, size_t len) {
+    sim_payload_t *p;
+    uint32_t to;
+
+    m->nodes[from].up = true;
+    ++m->nodes[from].sent;
+
+    if (m->nodes[from].crashed) {
+        ++m->cut_off;
+        return;
+    }
+
+    if (PR_REQUEST == data[0])
+        open_cycle(m, from);
+    else if (PR_VOTE == data[0])
+        ++m->votes;
+
+    p = malloc(sizeof(*p));
+
+    if (!p) {
+        ++m->lost;
+        return;
+    }
+
+    /* held by the medium while routing */
+    p->refs = 1;
+    p->len = len;
+    memcpy(p->data, data, len);
+
+    if (BROADCAST == dst) {
+        for (to = 0; to < m->cfg.nodes; ++to)
+            if (to != from)
+                route(m, from, to, p);
+    }
+    else if (ALIAS_NET == (dst & NET_MASK) &&
+             (dst & ~NET_MASK) >= 1 && (dst & ~NET_MASK) <= m->cfg.nodes)
+        route(m, from, (dst & ~NET_MASK) - 1, p);
+
+    payload_release(p);
+}
+
+static
+void data_received(int fd, io_svc_op_t op, sim_medium_t *m) {
+    uint8_t buffer[PR_MAX_SIZE];
+    struct sockaddr_in src;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    uint32_t ip, dst;
+    ssize_t len;
+    unsigned int idx;
+    union {
+        struct cmsghdr align;
+        uint8_t buf[CMSG_SPACE(sizeof(struct in_pktinfo))];
+    } control;
+
+    for (idx = 0; idx < RECEIVE_BATCH; ++idx) {
+        iov.iov_base = buffer;
+        iov.iov_len = sizeof(buffer);
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &src;
+        msg.msg_namelen = sizeof(src);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        len = recvmsg(fd, &msg, MSG_DONTWAIT);
+
+        if (len < 0) {
+            if (EINTR == errno)
+                continue;
+
+            if (EAGAIN != errno && EWOULDBLOCK != errno)
+                LOG(LOG_LEVEL_WARN,
+                    "Can't read data: %s\n",
+                    strerror(errno));
+
+            return;
+        }
+
+        ip = ntohl(src.sin_addr.s_addr);
+
+        /* node's own datagrams only, not ones looped back to the medium */
+        if (REAL_NET != (ip & NET_MASK) ||
+            (ip & ~NET_MASK) < 1 || (ip & ~NET_MASK) > m->cfg.nodes ||
+            ntohs(src.sin_port) != m->cfg.port ||
+            (msg.msg_flags & MSG_TRUNC))
+            continue;
+
+        /* started node announces itself */
+        if (!len) {
+            m->nodes[(ip & ~NET_MASK) - 1].up = true;
+            continue;
+        }
+
+        if ((size_t)len < PR_MIN_SIZE)
+            continue;
+
+        for (dst = 0, cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+             cmsg = CMSG_NXTHDR(&msg, cmsg))
+            if (IPPROTO_IP == cmsg->cmsg_level &&
+                IP_PKTINFO == cmsg->cmsg_type)
+                dst = ntohl(
+                    ((struct in_pktinfo *)CMSG_DATA(cmsg))->ipi_addr.s_addr);
+
+        datagram_received(m, (ip & ~NET_MASK) - 1, dst, buffer, len);
+    }
+}
+
+/**************** API ****************/
+int sim_node_socket(size_t idx, uint16_t port,
+                    struct sockaddr *local_addr,
+                    struct sockaddr *bcast_addr) {
+    static const int REUSE_ADDR = 1;
+
+    struct sockaddr_in addr;
+    int sfd;
+
+    assert(idx < SIM_MAX_NODES && local_addr && bcast_addr);
+
+    sfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    if (sfd < 0)
+        return -1;
+
+    /* medium's wildcard socket is bound to the same port */
+    set_addr(&addr, REAL_NET + idx + 1, port);
+
+    if (setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR,
+                   &REUSE_ADDR, sizeof(REUSE_ADDR)) ||
+        bind(sfd, (const struct sockaddr *)&addr, sizeof(addr))) {
+        LOG(LOG_LEVEL_WARN,
+            "Can't bind node %zu: %s\n",
+            idx, strerror(errno));
+
+        close(sfd);
+        return -1;
+    }
+
+    /* every node votes at once during election */
+    set_udp_receive_buffer(sfd, UDP_DEFAULT_FAN_IN);
+
+    set_addr((struct sockaddr_in *)local_addr, ALIAS_NET + idx + 1, port);
+    set_addr((struct sockaddr_in *)bcast_addr, BROADCAST, port);
+
+    /* medium delivers nothing to node it hasn't heard of */
+    if (sendto(sfd, NULL, 0, 0, bcast_addr, sizeof(addr)) < 0) {
+        LOG(LOG_LEVEL_WARN,
+            "Can't announce node %zu: %s\n",
+            idx, strerror(errno));
+
+        close(sfd);
+        return -1;
+    }
+
+    return sfd;
+}
+
+bool sim_medium_init(sim_medium_t *m, io_service_t *iosvc,
+                     const sim_config_t *cfg) {
+    static const int ENABLE = 1;
+
+    struct sockaddr_in addr;
+
+    assert(m && iosvc && cfg);
+    assert(cfg->nodes && cfg->nodes <= SIM_MAX_NODES);
+
+    memset(m, 0, sizeof(*m));
+
+    m->iosvc = iosvc;
+    m->cfg = *cfg;
+    m->rng = cfg->seed | 1;
+    m->master = -1;
+
+    histogram_reset(&m->cycle_completion);
+    histogram_reset(&m->cycle_coverage);
+
+    m->nodes = calloc(cfg->nodes, sizeof(*m->nodes));
+
+    if (!m->nodes)
+        return false;
+
+    m->udp_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    if (m->udp_socket < 0) {
+        free(m->nodes);
+        return false;
+    }
+
+    set_addr(&addr, INADDR_ANY, cfg->port);
+
+    if (setsockopt(m->udp_socket, SOL_SOCKET, SO_REUSEADDR,
+                   &ENABLE, sizeof(ENABLE)) ||
+        setsockopt(m->udp_socket, IPPROTO_IP, IP_PKTINFO,
+                   &ENABLE, sizeof(ENABLE)) ||
+        bind(m->udp_socket, (const struct sockaddr *)&addr, sizeof(addr))) {
+        LOG(LOG_LEVEL_FATAL,
+            "Can't set up medium's socket: %s\n",
+            strerror(errno));
+
+        close(m->udp_socket);
+        free(m->nodes);
+        return false;
+    }
+
+    /* every node may send at once */
+    set_udp_receive_buffer(m->udp_socket, cfg->nodes * 4);
+
+    timer_init(&m->delivery_tmr, iosvc);
+
+    m->started_at = now_msec();
+
+    return true;
+}
+
+void sim_medium_deinit(sim_medium_t *m) {
+    assert(m);
+
+    while (m->queued)
+        payload_release(m->queue[--m->queued].payload);
+
+    free(m->queue);
+    free(m->nodes);
+
+    timer_deinit(&m->delivery_tmr);
+    io_service_remove_job(m->iosvc, m->udp_socket, IO_SVC_OP_READ);
+    close(m->udp_socket);
+}
+
+void sim_medium_start(sim_medium_t *m) {
+    assert(m);
+
+    io_service_post_job(m->iosvc, m->udp_socket, IO_SVC_OP_READ,
+                        !IOSVC_JOB_ONESHOT,
+                        (iosvc_job_function_t)data_received,
+                        m);
+}
+
+void sim_medium_crash(sim_medium_t *m, size_t idx) {
+    assert(m && idx < m->cfg.nodes);
+
+    m->nodes[idx].crashed = true;
+}
+
+void sim_medium_partition(sim_medium_t *m, bool split) {
+    size_t idx;
+
+    assert(m);
+
+    for (idx = 0; idx < m->cfg.nodes; ++idx)
+        m->nodes[idx].partition = split && idx >= m->cfg.nodes / 2;
+}
+
+void sim_medium_mark(sim_medium_t *m, const char *name) {
+    sim_event_t *e;
+    size_t idx;
+
+    assert(m && name);
+
+    if (m->event_count == SIM_MAX_EVENTS)
+        return;
+
+    e = &m->events[m->event_count++];
+
+    strncpy(e->name, name, sizeof(e->name) - 1);
+    e->name[sizeof(e->name) - 1] = '\0';
+    e->at = now_msec();
+    e->converged = false;
+
+    memset(m->pending, 0, sizeof(m->pending));
+
+    for (idx = 0; idx < m->cfg.nodes; ++idx)
+        if (!m->nodes[idx].crashed)
+            m->pending[m->nodes[idx].partition] = true;
+}
+
+void sim_medium_report(const sim_medium_t *m, FILE *f) {
+    histogram_t sent, received;
+    uint64_t total = 0;
+    size_t idx, up = 0;
+
+    assert(m && f);
+
+    histogram_reset(&sent);
+    histogram_reset(&received);
+
+    for (idx = 0; idx < m->cfg.nodes; ++idx) {
+        total += m->nodes[idx].sent;
+
+        if (!m->nodes[idx].up)
+            continue;
+
+        ++up;
+        histogram_record(&sent, m->nodes[idx].sent);
+        histogram_record(&received, m->nodes[idx].received);
+    }
+
+    fprintf(f, "nodes: %zu (%zu started), run: %llu ms\n",
+            m->cfg.nodes, up,
+            (unsigned long long)(now_msec() - m->started_at));
+    fprintf(f, "medium: loss %.2f%%, latency %u ms, jitter %u ms, "
+            "quorum %.0f%%\n",
+            m->cfg.loss * 100, (unsigned int)m->cfg.latency_msec,
+            (unsigned int)m->cfg.jitter_msec, m->cfg.quorum * 100);
+    fprintf(f, "datagrams: sent %llu, delivered %llu, lost %llu, "
+            "cut off %llu\n",
+            (unsigned long long)total, (unsigned long long)m->delivered,
+            (unsigned long long)m->lost, (unsigned long long)m->cut_off);
+    fprintf(f, "poll cycles: complete %llu, partial %llu, "
+            "master changes %llu, votes %llu\n",
+            (unsigned long long)m->cycles_complete,
+            (unsigned long long)m->cycles_partial,
+            (unsigned long long)m->master_changes,
+            (unsigned long long)m->votes);
+
+    histogram_print(&m->cycle_completion, f, "poll cycle completion, ms", 0);
+    histogram_print(&m->cycle_coverage, f, "poll cycle coverage, %", 0);
+    histogram_print(&sent, f, "datagrams sent per node", 0);
+    histogram_print(&received, f, "datagrams received per node", 0);
+
+    for (idx = 0; idx < m->event_count; ++idx)
+        if (m->events[idx].converged)
+            fprintf(f, "convergence after %s: %llu ms\n",
+                    m->events[idx].name,
+                    (unsigned long long)m->events[idx].converged_in);
+        else
+            fprintf(f, "convergence after %s: not reached\n",
+                    m->events[idx].name);
+}
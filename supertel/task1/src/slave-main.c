@@ -2,26 +2,97 @@
 #include "io-service.h"
 #include "common.h"
 #include "log.h"
+#include "protocol.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
+
+static
+void print_usage(const char *self) {
+    printf("usage: %s [-g <group>] [-u <group>] [-r] [-p <phi>] [-e] "
+           "<interface>\n", self);
+    printf("  -g  tier group to take part in (default 0, the top tier)\n");
+    printf("  -u  tier group to report aggregates to once elected master "
+           "(default 0 for groups other than 0)\n");
+    printf("  -r  report readings of every slave instead of aggregate\n");
+    printf("  -p  suspicion level to suspect master at (default %.1f)\n",
+           PHI_DETECTOR_DEFAULT_THRESHOLD);
+    printf("  -e  delay own vote by its rank instead of voting at once\n");
+}
+
+static
+bool parse_group(const char *s, long *group) {
+    char *end;
+
+    *group = strtol(s, &end, 10);
+
+    return *s && !*end && *group >= 0 && *group <= UDP_MAX_GROUP;
+}
 
 int main(int argc, char **argv) {
     slave_t slave;
     io_service_t iosvc;
     char *interface = NULL;
+    long group = 0, uplink_group = -1;
+    bool readings = false;
+    bool delayed = false;
+    double phi = PHI_DETECTOR_DEFAULT_THRESHOLD;
+    int opt;
+
+    while (-1 != (opt = getopt(argc, argv, "g:u:rp:eh"))) {
+        switch (opt) {
+            case 'g':
+                if (parse_group(optarg, &group))
+                    break;
+
+                print_usage(argv[0]);
+                exit(2);
+            case 'u':
+                if (parse_group(optarg, &uplink_group))
+                    break;
+
+                print_usage(argv[0]);
+                exit(2);
+            case 'r':
+                readings = true;
+                break;
+            case 'e':
+                delayed = true;
+                break;
+            case 'p':
+                phi = strtod(optarg, NULL);
+
+                if (phi > 0)
+                    break;
+
+                print_usage(argv[0]);
+                exit(2);
+            default:
+                print_usage(argv[0]);
+                exit(opt == 'h' ? 0 : 2);
+        }
+    }
 
-    if (argc < 2) {
-        printf("usage: %s <interface>\n", argv[0]);
+    if (optind >= argc) {
+        print_usage(argv[0]);
         exit(0);
     }
 
-    interface = argv[1];
+    interface = argv[optind];
+
+    if (uplink_group < 0 && group > 0)
+        uplink_group = 0;
 
-    srandom(time(NULL));
+    if (uplink_group == group) {
+        print_usage(argv[0]);
+        exit(2);
+    }
+
+    log_async_start();
 
     io_service_init(&iosvc);
 
@@ -32,16 +103,30 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
-    if (!slave_init(&slave, &iosvc, interface)) {
+    if (!slave_init(&slave, &iosvc, interface, UDP_GROUP_PORT(group))) {
         LOG_MSG(LOG_LEVEL_FATAL, "Can't initialize slave\n");
 
         exit(1);
     }
 
+    /* slaves started within a second must not vote alike */
+    srandom(time(NULL) ^ getpid() ^
+            ((const struct sockaddr_in *)&slave.local_addr)->sin_addr.s_addr);
+
+    slave_set_phi_threshold(&slave, phi);
+
+    if (delayed)
+        slave_set_election(&slave, SLAVE_ELECTION_DELAYED);
+
+    if (uplink_group >= 0)
+        slave_set_uplink(&slave, UDP_GROUP_PORT(uplink_group), readings);
+
     slave_run(&slave);
 
     slave_deinit(&slave);
     io_service_deinit(&iosvc);
 
+    log_async_stop();
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,271 @@
+#include "slave-table.h"
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+static inline
+size_t slot(const slave_table_t *t, uint32_t ip) {
+    /* Fibonacci hashing, consecutive addresses land far apart */
+    return (size_t)((ip * 0x9e3779b9u) >> (32 - t->bits));
+}
+
+static
+void link_newest(slave_table_t *t, uint32_t idx) {
+    slave_table_entry_t *e = &t->entries[idx];
+
+    e->older = t->newest;
+    e->newer = SLAVE_TABLE_NIL;
+
+    if (SLAVE_TABLE_NIL == t->newest)
+        t->oldest = idx;
+    else
+        t->entries[t->newest].newer = idx;
+
+    t->newest = idx;
+}
+
+static
+void unlink_entry(slave_table_t *t, uint32_t idx) {
+    slave_table_entry_t *e = &t->entries[idx];
+
+    if (SLAVE_TABLE_NIL == e->older)
+        t->oldest = e->newer;
+    else
+        t->entries[e->older].newer = e->newer;
+
+    if (SLAVE_TABLE_NIL == e->newer)
+        t->newest = e->older;
+    else
+        t->entries[e->newer].older = e->older;
+}
+
+/* entry has been moved to index to, point its neighbours there */
+static
+void relink(slave_table_t *t, uint32_t to) {
+    slave_table_entry_t *e = &t->entries[to];
+
+    if (SLAVE_TABLE_NIL == e->older)
+        t->oldest = to;
+    else
+        t->entries[e->older].newer = to;
+
+    if (SLAVE_TABLE_NIL == e->newer)
+        t->newest = to;
+    else
+        t->entries[e->newer].older = to;
+}
+
+static
+slave_table_entry_t *find(const slave_table_t *t, uint32_t ip) {
+    size_t mask = t->capacity - 1;
+    size_t idx;
+
+    for (idx = slot(t, ip); t->entries[idx].used; idx = (idx + 1) & mask)
+        if (t->entries[idx].ip == ip)
+            return &t->entries[idx];
+
+    return NULL;
+}
+
+static
+slave_table_entry_t *insert(slave_table_t *t, uint32_t ip) {
+    size_t mask = t->capacity - 1;
+    size_t idx;
+
+    for (idx = slot(t, ip); t->entries[idx].used; idx = (idx + 1) & mask);
+
+    t->entries[idx].used = true;
+    t->entries[idx].ip = ip;
+    ++t->count;
+
+    link_newest(t, idx);
+
+    return &t->entries[idx];
+}
+
+static
+bool allocate(slave_table_t *t, unsigned int bits) {
+    t->entries = calloc((size_t)1 << bits, sizeof(*t->entries));
+
+    if (!t->entries)
+        return false;
+
+    t->bits = bits;
+    t->capacity = (size_t)1 << bits;
+    t->count = 0;
+    t->oldest = t->newest = SLAVE_TABLE_NIL;
+
+    return true;
+}
+
+static
+bool grow(slave_table_t *t) {
+    slave_table_entry_t *old = t->entries;
+    uint32_t idx = t->oldest;
+
+    /* indices must stay below SLAVE_TABLE_NIL */
+    if (t->bits >= 31 || !allocate(t, t->bits + 1)) {
+        t->entries = old;
+        return false;
+    }
+
+    /* reinserted from the oldest on, recency order is kept */
+    for (; SLAVE_TABLE_NIL != idx; idx = old[idx].newer)
+        insert(t, old[idx].ip)->sd = old[idx].sd;
+
+    free(old);
+
+    return true;
+}
+
+/**************** API ****************/
+bool slave_table_init(slave_table_t *t, size_t expected) {
+    unsigned int bits = 0;
+
+    assert(t);
+
+    /* keep load factor at 3/4 */
+    while (bits < 32 &&
+           (((size_t)1 << bits) < SLAVE_TABLE_MIN_CAPACITY ||
+            ((size_t)1 << bits) / 4 * 3 < expected))
+        ++bits;
+
+    return allocate(t, bits);
+}
+
+void slave_table_deinit(slave_table_t *t) {
+    assert(t);
+
+    free(t->entries);
+    t->entries = NULL;
+    t->capacity = t->count = 0;
+}
+
+void slave_table_clear(slave_table_t *t) {
+    assert(t);
+
+    memset(t->entries, 0, t->capacity * sizeof(*t->entries));
+    t->count = 0;
+    t->oldest = t->newest = SLAVE_TABLE_NIL;
+}
+
+size_t slave_table_count(const slave_table_t *t) {
+    assert(t);
+
+    return t->count;
+}
+
+slave_description_t *slave_table_get(slave_table_t *t, uint32_t ip) {
+    slave_table_entry_t *e;
+
+    assert(t);
+
+    e = find(t, ip);
+
+    return e ? &e->sd : NULL;
+}
+
+slave_description_t *slave_table_add_or_get(slave_table_t *t, uint32_t ip,
+                                            bool *added) {
+    slave_table_entry_t *e;
+
+    assert(t);
+
+    e = find(t, ip);
+
+    if (added)
+        *added = !e;
+
+    if (e)
+        return &e->sd;
+
+    if (t->count + 1 > t->capacity / 4 * 3 && !grow(t))
+        return NULL;
+
+    e = insert(t, ip);
+    memset(&e->sd, 0, sizeof(e->sd));
+
+    return &e->sd;
+}
+
+bool slave_table_remove(slave_table_t *t, uint32_t ip,
+                        slave_description_t *sd) {
+    size_t mask, hole, idx, home;
+    slave_table_entry_t *e;
+
+    assert(t);
+
+    e = find(t, ip);
+
+    if (!e)
+        return false;
+
+    if (sd)
+        *sd = e->sd;
+
+    mask = t->capacity - 1;
+    hole = e - t->entries;
+
+    unlink_entry(t, hole);
+
+    /*
+     * Move back every following entry of the cluster which may live
+     * at the hole, i.e. whose home slot is not within (hole, idx].
+     */
+    for (idx = (hole + 1) & mask; t->entries[idx].used;
+         idx = (idx + 1) & mask) {
+        home = slot(t, t->entries[idx].ip);
+
+        if (((idx - home) & mask) < ((idx - hole) & mask))
+            continue;
+
+        t->entries[hole] = t->entries[idx];
+        relink(t, hole);
+        hole = idx;
+    }
+
+    t->entries[hole].used = false;
+    --t->count;
+
+    return true;
+}
+
+void slave_table_touch(slave_table_t *t, slave_description_t *sd) {
+    slave_table_entry_t *e;
+    uint32_t idx;
+
+    assert(t && sd);
+
+    e = (slave_table_entry_t *)((uint8_t *)sd
+                                - offsetof(slave_table_entry_t, sd));
+    idx = e - t->entries;
+
+    if (idx == t->newest)
+        return;
+
+    unlink_entry(t, idx);
+    link_newest(t, idx);
+}
+
+slave_table_entry_t *slave_table_oldest(slave_table_t *t) {
+    assert(t);
+
+    return SLAVE_TABLE_NIL == t->oldest ? NULL : &t->entries[t->oldest];
+}
+
+slave_table_entry_t *slave_table_next(slave_table_t *t,
+                                      slave_table_entry_t *prev) {
+    slave_table_entry_t *end;
+
+    assert(t);
+
+    end = t->entries + t->capacity;
+
+    for (prev = prev ? prev + 1 : t->entries; prev < end; ++prev)
+        if (prev->used)
+            return prev;
+
+    return NULL;
+}
@@ -20,9 +20,10 @@
 #include <arpa/inet.h>
 
 #include <sys/socket.h>
-#include <sys/ioctl.h>
 
 #define MASTERING_TIMEOUT_MSEC      (MASTER_REQUEST_TIMEOUT_MSEC / 2)
+/** Delayed election: lowest vote is sent that late */
+#define VOTE_WINDOW_MSEC            (SLAVE_POLLING_TIMEOUT_MSEC / 2)
 
 typedef void (* slave_actor_t)(slave_t *m, const pr_signature_t *packet, int fd,
                                const struct sockaddr_in *remote_addr);
@@ -30,6 +31,15 @@ typedef void (* slave_actor_t)(slave_t *m, const pr_signature_t *packet, int fd,
 static
 void slave_master_timed_out(slave_t *sl);
 static
+void slave_heartbeat(slave_t *sl, const struct sockaddr_in *remote_addr);
+static
+void slave_follow_master(slave_t *sl, const struct sockaddr_in *remote_addr);
+static
+bool slave_yield(slave_t *sl, const pr_signature_t *packet,
+                 const struct sockaddr_in *remote_addr);
+static
+const struct sockaddr_in *slave_report_addr(const slave_t *sl);
+static
 void slave_act(slave_t *m, const pr_signature_t *packet, int fd,
                const struct sockaddr_in *remote_addr);
 static
@@ -55,6 +65,8 @@ void slave_disarm_master_gone_timer(slave_t *sl);
 static
 void slave_arm_poll_timer(slave_t *sl);
 static
+void slave_arm_vote_timer(slave_t *sl);
+static
 void slave_disarm_poll_timer(slave_t *sl);
 static
 void slave_arm_mastering_timer(slave_t *sl);
@@ -74,11 +86,27 @@ void slave_memorize(slave_t *sl, const pr_msg_t *msg);
 static
 void slave_poll(slave_t *sl);
 static
+void slave_send_vote(slave_t *sl);
+static
 void slave_mastering_timeout(slave_t *sl);
 static inline
 void slave_prepare_to_poll(slave_t *sl, const pr_vote_t *v);
 static inline
 void slave_idle(slave_t *sl);
+static
+void slave_report(slave_t *sl);
+static
+void slave_report_readings(slave_t *sl);
+static
+void slave_receive_info(slave_t *sl, const pr_msg_t *msg);
+static
+void slave_receive_stats(slave_t *sl, const pr_stats_t *stats);
+static
+void slave_replicate(slave_t *sl, const pr_snapshot_t *snapshot);
+static
+void slave_start_uplink(slave_t *sl);
+static
+void slave_stop_uplink(slave_t *sl);
 
 
 /* static data */
@@ -102,6 +130,9 @@ void slave_prepare_to_poll(slave_t *sl, const pr_vote_t *v) {
     sl->max_vote_per_poll = v ? v->vote : 0;
     sl->vote_sent = 0;
     slave_disarm_master_gone_timer(sl);
+
+    /* report by broadcast until the poll winner shows up */
+    sl->report_addr.sin_addr.s_addr = INADDR_NONE;
 }
 
 void slave_memorize(slave_t *sl, const pr_msg_t *msg) {
@@ -118,6 +149,200 @@ void slave_memorize(slave_t *sl, const pr_msg_t *msg) {
         (long int)msg->date_time);
 }
 
+void slave_report_readings(slave_t *sl) {
+    pr_readings_t readings;
+    pr_aggregate_t rest;
+    pr_reading_t *r;
+    slave_table_entry_t *e = NULL;
+
+    readings.s.s = PR_READINGS;
+    readings.count = 0;
+
+    /* groups of sub-masters below can't be split, they go summed */
+    rest.s.s = PR_AGGREGATE;
+    rest.temperature = 0;
+    rest.illumination = 0;
+    rest.count = 0;
+
+    while ((e = slave_table_next(&sl->source->slaves, e))) {
+        if (e->sd.count != 1) {
+            rest.temperature += e->sd.temperature;
+            rest.illumination += e->sd.illumination;
+            rest.count += e->sd.count;
+            continue;
+        }
+
+        r = &readings.readings[readings.count++];
+
+        /* source's own readings are registered for zero address */
+        r->id = e->ip ? e->ip : ntohl(
+            ((const struct sockaddr_in *)&sl->source->local_addr)
+                ->sin_addr.s_addr);
+        r->temperature = e->sd.temperature;
+        r->illumination = e->sd.illumination;
+
+        if (readings.count < PR_READINGS_MAX)
+            continue;
+
+        udp_tx_send(&sl->tx, sl->udp_socket, &readings,
+                    PR_READINGS_SIZE(readings.count), slave_report_addr(sl));
+        readings.count = 0;
+    }
+
+    if (readings.count)
+        udp_tx_send(&sl->tx, sl->udp_socket, &readings,
+                    PR_READINGS_SIZE(readings.count), slave_report_addr(sl));
+
+    if (rest.count)
+        udp_tx_send(&sl->tx, sl->udp_socket, &rest, sizeof(rest),
+                    slave_report_addr(sl));
+}
+
+void slave_report(slave_t *sl) {
+    pr_response_t response;
+    pr_aggregate_t aggregate;
+
+    if (sl->source && sl->readings) {
+        slave_report_readings(sl);
+        return;
+    }
+
+    if (sl->source) {
+        master_fill_aggregate(sl->source, &aggregate);
+
+        udp_tx_send(&sl->tx, sl->udp_socket, &aggregate, sizeof(aggregate),
+                    slave_report_addr(sl));
+        return;
+    }
+
+    slave_fetch_parameters(sl);
+    response.s.s = PR_RESPONSE;
+    response.illumination = sl->illumination;
+    response.temperature = sl->temperature;
+
+    udp_tx_send(&sl->tx, sl->udp_socket, &response, sizeof(response),
+                slave_report_addr(sl));
+}
+
+void slave_receive_info(slave_t *sl, const pr_msg_t *msg) {
+    slave_memorize(sl, msg);
+
+    if (sl->source)
+        master_relay_info(sl->source, msg);
+}
+
+void slave_receive_stats(slave_t *sl, const pr_stats_t *stats) {
+    LOG(LOG_LEVEL_INFO,
+        "  Distribution of %u: T = %d [%d, %d, %d, %d], "
+        "IL = %u [%u, %u, %u, %u]\n",
+        (unsigned int)stats->count,
+        (int)stats->temperature[PR_STATS_MEDIAN],
+        (int)stats->temperature[PR_STATS_MIN],
+        (int)stats->temperature[PR_STATS_P10],
+        (int)stats->temperature[PR_STATS_P90],
+        (int)stats->temperature[PR_STATS_MAX],
+        (unsigned int)stats->illumination[PR_STATS_MEDIAN],
+        (unsigned int)stats->illumination[PR_STATS_MIN],
+        (unsigned int)stats->illumination[PR_STATS_P10],
+        (unsigned int)stats->illumination[PR_STATS_P90],
+        (unsigned int)stats->illumination[PR_STATS_MAX]);
+
+    if (sl->source)
+        master_relay_stats(sl->source, stats);
+}
+
+/*
+ * Full snapshot restarts replica. Delta applies only on top of complete
+ * previous snapshot, anything out of order invalidates replica until
+ * next full one.
+ */
+void slave_replicate(slave_t *sl, const pr_snapshot_t *snapshot) {
+    const pr_snapshot_entry_t *e;
+    slave_description_t *sd;
+    unsigned int idx;
+
+    if ((snapshot->flags & PR_SNAPSHOT_FULL) && !snapshot->part) {
+        slave_table_clear(&sl->replica.slaves);
+        sl->replica.seq = snapshot->seq;
+        sl->replica.next_part = 0;
+        sl->replica.valid = true;
+        sl->replica.complete = false;
+    }
+    else if (!snapshot->part && sl->replica.valid && sl->replica.complete &&
+             snapshot->seq == sl->replica.seq + 1) {
+        sl->replica.seq = snapshot->seq;
+        sl->replica.next_part = 0;
+        sl->replica.complete = false;
+    }
+
+    if (!sl->replica.valid || sl->replica.complete ||
+        snapshot->seq != sl->replica.seq ||
+        snapshot->part != sl->replica.next_part) {
+        if (sl->replica.valid)
+            LOG(LOG_LEVEL_DEBUG,
+                "Snapshot %u part %u is out of order, "
+                "replica waits for full one\n",
+                (unsigned int)snapshot->seq, (unsigned int)snapshot->part);
+
+        sl->replica.valid = false;
+        return;
+    }
+
+    for (idx = 0; idx < snapshot->count; ++idx) {
+        e = &snapshot->entries[idx];
+
+        if (!e->count) {
+            slave_table_remove(&sl->replica.slaves, e->id, NULL);
+            continue;
+        }
+
+        sd = slave_table_add_or_get(&sl->replica.slaves, e->id, NULL);
+
+        if (!sd) {
+            sl->replica.valid = false;
+            return;
+        }
+
+        sd->temperature = e->temperature;
+        sd->illumination = e->illumination;
+        sd->count = e->count;
+    }
+
+    ++sl->replica.next_part;
+    sl->replica.complete = !!(snapshot->flags & PR_SNAPSHOT_LAST);
+}
+
+void slave_start_uplink(slave_t *sl) {
+    /* slave over foreign socket has no interface to bind uplink to */
+    if (!sl->uplink_port || !sl->iface)
+        return;
+
+    sl->uplink = malloc(sizeof(*sl->uplink));
+
+    if (!sl->uplink ||
+        !slave_init(sl->uplink, sl->iosvc, sl->iface, sl->uplink_port)) {
+        LOG(LOG_LEVEL_WARN,
+            "Can't start uplink to port %u\n",
+            (unsigned int)sl->uplink_port);
+
+        free(sl->uplink);
+        sl->uplink = NULL;
+        return;
+    }
+
+    slave_set_source(sl->uplink, &sl->master, sl->readings);
+    slave_start(sl->uplink);
+}
+
+void slave_stop_uplink(slave_t *sl) {
+    if (!sl->uplink)
+        return;
+
+    slave_deinit(sl->uplink);
+    free(sl->uplink);
+    sl->uplink = NULL;
+}
+
 void slave_fetch_parameters(slave_t *sl) {
     sl->temperature = random();
     sl->illumination = random();
@@ -127,22 +352,26 @@ void slave_fetch_parameters(slave_t *sl) {
 }
 
 void slave_mastering_timeout(slave_t *sl) {
-    pr_response_t response;
+    pr_any_t own;
     struct sockaddr_in special_addr;
 
     switch (sl->state) {
         case SLAVE_MASTER:
-            slave_fetch_parameters(sl);
-
-            response.s.s = PR_RESPONSE;
-            response.illumination = sl->illumination;
-            response.temperature = sl->temperature;
+            if (sl->source)
+                master_fill_aggregate(sl->source, &own.aggregate);
+            else {
+                slave_fetch_parameters(sl);
+
+                own.response.s.s = PR_RESPONSE;
+                own.response.illumination = sl->illumination;
+                own.response.temperature = sl->temperature;
+            }
 
             special_addr.sin_addr.s_addr = htonl(0x00000000);
-            special_addr.sin_port = htons(UDP_PORT);
+            special_addr.sin_port = htons(sl->port);
             special_addr.sin_family = AF_INET;
 
-            master_act(&sl->master, (const pr_signature_t *)&response,
+            master_act(&sl->master, (const pr_signature_t *)&own,
                        sl->udp_socket, &special_addr);
             break;
 
@@ -153,7 +382,6 @@ void slave_mastering_timeout(slave_t *sl) {
 }
 
 void slave_poll(slave_t *sl) {
-    pr_vote_t vote;
     long int rnd;
     uint32_t v;
 
@@ -172,37 +400,55 @@ void slave_poll(slave_t *sl) {
         return;
     }
 
+    if (SLAVE_ELECTION_DELAYED == sl->election) {
+        slave_arm_vote_timer(sl);
+        return;
+    }
+
+    slave_send_vote(sl);
+}
+
+void slave_send_vote(slave_t *sl) {
+    pr_vote_t vote;
+
     vote.s.s = PR_VOTE;
-    vote.vote = v;
+    vote.vote = sl->vote_sent;
 
-    sendto(sl->udp_socket, &vote, sizeof(vote), 0,
-           (struct sockaddr *)&sl->bcast_addr, sizeof(sl->bcast_addr));
+    udp_tx_send(&sl->tx, sl->udp_socket, &vote, sizeof(vote), &sl->bcast_addr);
 
     slave_arm_poll_timer(sl);
 }
 
 void slave_act_idle(slave_t *sl, const pr_signature_t *packet, int fd,
                     const struct sockaddr_in *remote_addr) {
-    pr_response_t response;
     const pr_vote_t *vote;
 
     switch (packet->s) {
         case PR_REQUEST:
+            slave_follow_master(sl, remote_addr);
+            slave_heartbeat(sl, remote_addr);
             slave_arm_master_gone_timer(sl);
 
-            slave_fetch_parameters(sl);
-            response.s.s = PR_RESPONSE;
-            response.illumination = sl->illumination;
-            response.temperature = sl->temperature;
-
-            sendto(sl->udp_socket, &response, sizeof(response), 0,
-                   (struct sockaddr *)&sl->bcast_addr, sizeof(sl->bcast_addr));
+            slave_report(sl);
             break;
 
         case PR_MSG:
+            slave_follow_master(sl, remote_addr);
             slave_arm_master_gone_timer(sl);
 
-            slave_memorize(sl, (const pr_msg_t *)packet);
+            slave_receive_info(sl, (const pr_msg_t *)packet);
+            break;
+
+        case PR_STATS:
+            slave_receive_stats(sl, (const pr_stats_t *)packet);
+            break;
+
+        case PR_SNAPSHOT:
+            slave_replicate(sl, (const pr_snapshot_t *)packet);
+            break;
+
+        case PR_RESET_MASTER:
+            slave_follow_master(sl, remote_addr);
             break;
 
         case PR_VOTE:
@@ -211,6 +457,15 @@ void slave_act_idle(slave_t *sl, const pr_signature_t *packet, int fd,
                 (unsigned int)(((const pr_vote_t *)packet)->vote),
                 (unsigned int)sl->vote_sent,
                 (unsigned int)sl->max_vote_per_poll);
+
+            /*
+             * Voter has missed requests of master which is alive as far
+             * as this slave knows, master resets the voter
+             */
+            if (SLAVE_ELECTION_DELAYED == sl->election &&
+                INADDR_NONE != sl->report_addr.sin_addr.s_addr)
+                break;
+
             slave_prepare_to_poll(sl, (const pr_vote_t *)packet);
             slave_initialize_master_polling(sl);
             break;
@@ -253,6 +508,7 @@ void slave_act_poll(slave_t *sl, const pr_signature_t *packet, int fd,
         case PR_RESET_MASTER:
             slave_idle(sl);
             slave_finish_master_polling(sl, SLAVE_IDLE);
+            slave_act_idle(sl, packet, fd, remote_addr);
             break;
 
         case PR_REQUEST:
@@ -261,6 +517,10 @@ void slave_act_poll(slave_t *sl, const pr_signature_t *packet, int fd,
             slave_finish_master_polling(sl, SLAVE_IDLE);
             slave_act_idle(sl, packet, fd, remote_addr);
             break;
+
+        case PR_SNAPSHOT:
+            slave_replicate(sl, (const pr_snapshot_t *)packet);
+            break;
     }
 }
 
@@ -268,13 +528,12 @@ void slave_act_master(slave_t *sl, const pr_signature_t *packet, int fd,
                       const struct sockaddr_in *remote_addr) {
 #define IDLE                                \
 do {                                        \
+    slave_stop_uplink(sl);                  \
     master_deinit_(&sl->master);            \
     slave_disarm_mastering_timer(sl);       \
     slave_idle(sl);                         \
 } while(0)
 
-    pr_response_t response;
-
     switch (packet->s) {
         case PR_VOTE:
             LOG(LOG_LEVEL_DEBUG,
@@ -286,6 +545,12 @@ do {                                        \
             if (sl->vote_sent)
                 break;
 
+            /* voter missed master's requests, let it know there is one */
+            if (SLAVE_ELECTION_DELAYED == sl->election) {
+                master_act(&sl->master, packet, fd, remote_addr);
+                break;
+            }
+
             IDLE;
 
             slave_prepare_to_poll(sl, (const pr_vote_t *)packet);
@@ -294,21 +559,13 @@ do {                                        \
             break;
 
         case PR_REQUEST:
-            IDLE;
-
-            slave_fetch_parameters(sl);
-            response.s.s = PR_RESPONSE;
-            response.illumination = sl->illumination;
-            response.temperature = sl->temperature;
-
-            sendto(sl->udp_socket, &response, sizeof(response), 0,
-                   (struct sockaddr *)&sl->bcast_addr, sizeof(sl->bcast_addr));
-            break;
-
         case PR_MSG:
+            if (!slave_yield(sl, packet, remote_addr))
+                break;
+
             IDLE;
 
-            slave_memorize(sl, (const pr_msg_t *)packet);
+            slave_act_idle(sl, packet, fd, remote_addr);
             break;
 
         case PR_RESET_MASTER:
@@ -316,6 +573,8 @@ do {                                        \
             break;
 
         case PR_RESPONSE:
+        case PR_AGGREGATE:
+        case PR_READINGS:
             master_act(&sl->master, packet, fd, remote_addr);
             break;
     }
@@ -342,11 +601,89 @@ void slave_act_waiting_master(slave_t *sl, const pr_signature_t *packet, int fd,
             slave_idle(sl);
             slave_act_idle(sl, packet, fd, remote_addr);
             break;
+
+        case PR_SNAPSHOT:
+            slave_replicate(sl, (const pr_snapshot_t *)packet);
+            break;
     }
 }
 
+void slave_heartbeat(slave_t *sl, const struct sockaddr_in *remote_addr) {
+    /* history of previous master tells nothing about the new one */
+    if (sl->master_addr.s_addr != remote_addr->sin_addr.s_addr) {
+        sl->master_addr = remote_addr->sin_addr;
+        phi_detector_reset(&sl->detector);
+    }
+
+    phi_detector_heartbeat(&sl->detector, phi_detector_now());
+}
+
+void slave_follow_master(slave_t *sl, const struct sockaddr_in *remote_addr) {
+    if (sl->report_addr.sin_addr.s_addr == remote_addr->sin_addr.s_addr &&
+        sl->report_addr.sin_port == remote_addr->sin_port)
+        return;
+
+    LOG(LOG_LEVEL_DEBUG,
+        "Reporting to master %s\n", inet_ntoa(remote_addr->sin_addr));
+
+    memcpy(&sl->report_addr, remote_addr, sizeof(*remote_addr));
+}
+
+/*
+ * Masters which hear each other would both step down and leave the group
+ * without master until next election. Lower address yields at once,
+ * higher one only if the rival goes on requesting, e.g. it is standalone
+ * master.
+ */
+bool slave_yield(slave_t *sl, const pr_signature_t *packet,
+                 const struct sockaddr_in *remote_addr) {
+    const struct sockaddr_in *own = (const struct sockaddr_in *)&sl->local_addr;
+
+    if (ntohl(remote_addr->sin_addr.s_addr) > ntohl(own->sin_addr.s_addr))
+        return true;
+
+    if (PR_REQUEST != packet->s)
+        return false;
+
+    if (sl->rival.s_addr == remote_addr->sin_addr.s_addr)
+        return true;
+
+    LOG(LOG_LEVEL_INFO,
+        "Master %s conflicts, waiting for it to step down\n",
+        inet_ntoa(remote_addr->sin_addr));
+
+    sl->rival = remote_addr->sin_addr;
+
+    return false;
+}
+
+const struct sockaddr_in *slave_report_addr(const slave_t *sl) {
+    return INADDR_NONE == sl->report_addr.sin_addr.s_addr ? &sl->bcast_addr
+                                                         : &sl->report_addr;
+}
+
 void slave_master_timed_out(slave_t *sl) {
-    LOG_MSG(LOG_LEVEL_DEBUG, "Master timed out\n");
+    uint64_t now = phi_detector_now();
+    uint64_t since_last = now - sl->detector.last;
+    double mean = phi_detector_mean(&sl->detector);
+    double late;
+
+    if (sl->detector.has_last &&
+        sl->detector.count >= PHI_DETECTOR_MIN_SAMPLES) {
+        late = (double)since_last - mean;
+        histogram_record(&sl->detection, late > 0 ? (uint64_t)late : 0);
+
+        LOG(LOG_LEVEL_INFO,
+            "Master suspected: phi %.1f, %llu ms since last request, "
+            "%.0f ms after expected (p50 %llu ms, p99 %llu ms)\n",
+            phi_detector_phi(&sl->detector, now),
+            (unsigned long long)since_last, late,
+            (unsigned long long)histogram_quantile(&sl->detection, 0.5),
+            (unsigned long long)histogram_quantile(&sl->detection, 0.99));
+    }
+    else
+        LOG_MSG(LOG_LEVEL_DEBUG, "Master timed out\n");
+
     slave_prepare_to_poll(sl, NULL);
     slave_initialize_master_polling(sl);
 }
@@ -356,13 +693,32 @@ void slave_poll_timeout(slave_t *sl) {
     if (sl->state == SLAVE_POLLING) {
         slave_disarm_poll_timer(sl);
         slave_finish_master_polling(sl, SLAVE_MASTER);
-        master_init_(&sl->master, sl->iosvc);
+        if (!master_init_(&sl->master, sl->iosvc, UDP_DEFAULT_FAN_IN)) {
+            LOG_MSG(LOG_LEVEL_FATAL, "Can't allocate slaves' registry\n");
+            abort();
+        }
+
+        sl->master.port = sl->port;
         master_set_broadcast_addr(
             &sl->master,
             (const struct sockaddr *)&sl->bcast_addr);
+        memcpy(&sl->master.local_addr, &sl->local_addr,
+               sizeof(sl->local_addr));
         sl->master.udp_socket = sl->udp_socket;
+        sl->master.relay = sl->source;
+        sl->rival.s_addr = INADDR_NONE;
+
+        if (sl->replica.valid)
+            master_adopt_slaves(
+                &sl->master, &sl->replica.slaves,
+                ntohl(((const struct sockaddr_in *)&sl->local_addr)
+                          ->sin_addr.s_addr));
+
+        /* goes stale while mastering */
+        sl->replica.valid = false;
         master_start(&sl->master);
         slave_arm_mastering_timer(sl);
+        slave_start_uplink(sl);
     }
 }
 
@@ -401,106 +757,44 @@ void slave_act(slave_t *sl, const pr_signature_t *packet, int fd,
 }
 
 void data_received(int fd, io_svc_op_t op, slave_t *sl) {
-    pr_signature_t *packet = NULL;
-    int pending;
-    int ret;
-    ssize_t bytes_read;
-    ssize_t buf_size;
-    uint8_t buffer[PR_MAX_SIZE];
-    struct sockaddr_storage remote_addr;
-    socklen_t remote_addr_len;
-
-    /* peek */
-    ret = ioctl(fd, FIONREAD, &pending);
-    if (ret != 0) {
-        LOG(LOG_LEVEL_FATAL,
-            "Can't pending datagram size with ioctl(FIONREAD): %s\n",
-            strerror(errno));
-        abort();
-    }
-
-    if (pending > PR_MAX_SIZE || pending < PR_MIN_SIZE) {
-        /* discard this datagram */
-        /* read big chunks */
-        while (pending >= PR_MAX_SIZE) {
-            bytes_read = recv(fd, buffer, PR_MAX_SIZE, 0);
-            if (bytes_read < 0) {
-                LOG(LOG_LEVEL_FATAL,
-                    "Can't read data: %s\n",
-                    strerror(errno));
-                abort();
-            }
-
-            pending -= bytes_read;
-        }
-
-        /* red the rest */
-        while (pending) {
-            bytes_read = recv(fd, buffer, pending, 0);
-            if (bytes_read < 0) {
-                LOG(LOG_LEVEL_FATAL,
-                    "Can't read data: %s\n",
-                    strerror(errno));
-                abort();
-            }
-
-            pending -= bytes_read;
-        }
-
-        return;
-    }
+    LOG_LN();
 
-    /* read datagram */
-    buf_size = 0;
-    while (pending) {
-        bytes_read = recvfrom(fd, (uint8_t *)(buffer) + buf_size, pending, 0,
-                              (struct sockaddr *)&remote_addr, &remote_addr_len);
-        if (bytes_read < 0) {
-            LOG(LOG_LEVEL_FATAL,
-                "Can't read data: %s\n",
-                strerror(errno));
-            abort();
-        }
+    udp_tx_begin(&sl->tx);
 
-        pending -= bytes_read;
-        buf_size += bytes_read;
-    }
+    /* mastering may end within the batch, master_deinit_ flushes then */
+    if (SLAVE_MASTER == sl->state)
+        udp_tx_begin(&sl->master.tx);
 
-    /* parse and act */
-    packet = (pr_signature_t *)buffer;
+    udp_rx_drain(&sl->rx, fd, &sl->local_addr,
+                 (udp_rx_handler_t)slave_act, sl);
 
-    if (packet->s >= PR_COUNT) {
-        /* invalid, discard*/
-        LOG(LOG_LEVEL_WARN,
-            "Invalid signature received: %#02x\n",
-            (int)(packet->s));
-
-        return;
-    }
+    if (SLAVE_MASTER == sl->state)
+        udp_tx_flush(&sl->master.tx, fd);
 
-    if (buf_size != PR_STRUCT_EXPECTED_SIZE[packet->s]) {
-        /* invalid, discard */
-        LOG(LOG_LEVEL_WARN,
-            "Invalid size of datagram received: %lu instead of %lu\n",
-            buf_size, PR_STRUCT_EXPECTED_SIZE[packet->s]);
+    udp_tx_flush(&sl->tx, fd);
+}
 
-        return;
-    }
+void slave_arm_master_gone_timer(slave_t *sl) {
+    uint64_t msec;
+    bool adaptive;
 
-    if (((struct sockaddr_in *)&remote_addr)->sin_addr.s_addr ==
-        ((struct sockaddr_in *)&sl->local_addr)->sin_addr.s_addr) /* discard */
-        return;
+    adaptive = phi_detector_deadline(&sl->detector, phi_detector_now(), &msec);
 
-    LOG_LN();
+    /*
+     * Detector only shortens the wait while it tracks a live master.
+     * Suspicion already crossed means history is stale, e.g. election
+     * has just finished.
+     */
+    if (adaptive && !msec)
+        phi_detector_reset(&sl->detector);
 
-    slave_act(sl, packet, fd, (struct sockaddr_in *)&remote_addr);
-}
+    if (!adaptive || !msec || msec > MASTER_GONE_TIMEOUT_MSEC)
+        msec = MASTER_GONE_TIMEOUT_MSEC;
 
-void slave_arm_master_gone_timer(slave_t *sl) {
     timer_set_deadline(
         &sl->master_gone_tmr,
-        MASTER_GONE_TIMEOUT_MSEC / 1000,
-        (MASTER_GONE_TIMEOUT_MSEC % 1000) * 1000000,
+        msec / 1000,
+        (msec % 1000) * 1000000,
         (tmr_job_t)slave_master_timed_out, sl
     );
 }
@@ -518,6 +812,25 @@ void slave_arm_poll_timer(slave_t *sl) {
     );
 }
 
+/* higher vote goes first, the rest are outvoted before their turn */
+void slave_arm_vote_timer(slave_t *sl) {
+    uint64_t nsec = (uint64_t)VOTE_WINDOW_MSEC * 1000000 *
+                    (RAND_MAX - sl->vote_sent) / RAND_MAX;
+
+    /* zero deadline would disarm the timer */
+    if (!nsec) {
+        slave_send_vote(sl);
+        return;
+    }
+
+    timer_set_deadline(
+        &sl->poll_tmr,
+        nsec / 1000000000,
+        nsec % 1000000000,
+        (tmr_job_t)slave_send_vote, sl
+    );
+}
+
 void slave_disarm_poll_timer(slave_t *sl) {
     timer_cancel(&sl->poll_tmr);
 }
@@ -537,23 +850,17 @@ void slave_disarm_mastering_timer(slave_t *sl) {
 
 /**************** API ****************/
 bool slave_init(slave_t *sl, io_service_t *iosvc,
-                const char *iface) {
-    struct addrinfo addr;
+                const char *iface, uint16_t port) {
+    struct sockaddr local_addr;
     struct sockaddr brcast_addr;
+    int sfd;
 
     assert(sl && iosvc && iface);
 
-    sl->iosvc = iosvc;
-
-    timer_init(&sl->master_gone_tmr, sl->iosvc);
-    timer_init(&sl->poll_tmr, sl->iosvc);
-    timer_init(&sl->mastering_tmr, sl->iosvc);
-
     /* find suitable local address */
-    sl->udp_socket = allocate_udp_broadcasting_socket(
-        iface, UDP_PORT, &sl->local_addr);
+    sfd = allocate_udp_broadcasting_socket(iface, port, &local_addr);
 
-    if (sl->udp_socket < 0) {
+    if (sfd < 0) {
         LOG(LOG_LEVEL_FATAL,
             "Can't locate suitable socket: %s",
             strerror(errno));
@@ -561,19 +868,74 @@ bool slave_init(slave_t *sl, io_service_t *iosvc,
         return false;
     }
 
+    /* every slave votes at once during election */
+    set_udp_receive_buffer(sfd, UDP_DEFAULT_FAN_IN);
+
     /* fetch broadcast addr */
-    if (0 > fetch_broadcast_addr(sl->udp_socket, iface, &brcast_addr)) {
+    if (0 > fetch_broadcast_addr(sfd, iface, &brcast_addr)) {
         LOG(LOG_LEVEL_FATAL,
             "Can't fetch broadcast address with ioctl(SIOCGIFBRDADDR): %s\n",
             strerror(errno));
 
-        shutdown(sl->udp_socket, SHUT_RDWR);
-        close(sl->udp_socket);
+        shutdown(sfd, SHUT_RDWR);
+        close(sfd);
         return false;
     }
 
-    memcpy(&sl->bcast_addr, &brcast_addr, sizeof(brcast_addr));
-    sl->bcast_addr.sin_port = htons(UDP_PORT);
+    if (!slave_init_socket(sl, iosvc, sfd, &local_addr, &brcast_addr, port)) {
+        shutdown(sfd, SHUT_RDWR);
+        close(sfd);
+        return false;
+    }
+
+    sl->iface = iface;
+
+    return true;
+}
+
+bool slave_init_socket(slave_t *sl, io_service_t *iosvc, int udp_socket,
+                       const struct sockaddr *local_addr,
+                       const struct sockaddr *bcast_addr, uint16_t port) {
+    assert(sl && iosvc && udp_socket >= 0 && local_addr && bcast_addr);
+
+    if (!slave_table_init(&sl->replica.slaves, 0)) {
+        LOG_MSG(LOG_LEVEL_FATAL, "Can't allocate registry replica\n");
+
+        return false;
+    }
+
+    sl->replica.seq = 0;
+    sl->replica.next_part = 0;
+    sl->replica.valid = sl->replica.complete = false;
+
+    sl->iosvc = iosvc;
+    sl->iface = NULL;
+    sl->port = port;
+    sl->state = SLAVE_IDLE;
+    sl->election = SLAVE_ELECTION_TOURS;
+    sl->source = NULL;
+    sl->readings = false;
+    sl->uplink_port = 0;
+    sl->uplink = NULL;
+
+    phi_detector_init(&sl->detector, PHI_DETECTOR_DEFAULT_THRESHOLD);
+    histogram_reset(&sl->detection);
+    sl->master_addr.s_addr = INADDR_NONE;
+    sl->rival.s_addr = INADDR_NONE;
+    memset(&sl->report_addr, 0, sizeof(sl->report_addr));
+    sl->report_addr.sin_addr.s_addr = INADDR_NONE;
+
+    udp_rx_init(&sl->rx);
+    udp_tx_init(&sl->tx);
+
+    timer_init(&sl->master_gone_tmr, sl->iosvc);
+    timer_init(&sl->poll_tmr, sl->iosvc);
+    timer_init(&sl->mastering_tmr, sl->iosvc);
+
+    sl->udp_socket = udp_socket;
+    memcpy(&sl->local_addr, local_addr, sizeof(*local_addr));
+    memcpy(&sl->bcast_addr, bcast_addr, sizeof(sl->bcast_addr));
+    sl->bcast_addr.sin_port = htons(sl->port);
 
     sl->illumination = 0;
     sl->temperature = 0;
@@ -582,6 +944,17 @@ bool slave_init(slave_t *sl, io_service_t *iosvc,
 }
 
 void slave_deinit(slave_t *sl) {
+    slave_stop_uplink(sl);
+
+    if (sl->detection.count)
+        histogram_print(&sl->detection, stderr,
+                        "master suspected, ms after expected request", 0);
+
+    LOG(LOG_LEVEL_INFO, "Datagrams on port %u: received %llu, sent %llu\n",
+        (unsigned int)sl->port,
+        (unsigned long long)sl->rx.received,
+        (unsigned long long)sl->tx.sent);
+
     if (SLAVE_MASTER == sl->state)
         master_deinit_(&sl->master);
 
@@ -589,11 +962,41 @@ void slave_deinit(slave_t *sl) {
     timer_deinit(&sl->poll_tmr);
     timer_deinit(&sl->mastering_tmr);
 
+    slave_table_deinit(&sl->replica.slaves);
+
+    io_service_remove_job(sl->iosvc, sl->udp_socket, IO_SVC_OP_READ);
     shutdown(sl->udp_socket, SHUT_RDWR);
     close(sl->udp_socket);
 }
 
-void slave_run(slave_t *sl) {
+void slave_set_source(slave_t *sl, master_t *source, bool readings) {
+    assert(sl && source);
+
+    sl->source = source;
+    sl->readings = readings;
+    source->quiet = true;
+}
+
+void slave_set_uplink(slave_t *sl, uint16_t port, bool readings) {
+    assert(sl);
+
+    sl->uplink_port = port;
+    sl->readings = readings;
+}
+
+void slave_set_phi_threshold(slave_t *sl, double threshold) {
+    assert(sl && threshold > 0);
+
+    phi_detector_init(&sl->detector, threshold);
+}
+
+void slave_set_election(slave_t *sl, slave_election_t election) {
+    assert(sl);
+
+    sl->election = election;
+}
+
+void slave_start(slave_t *sl) {
     assert(sl);
 
     slave_idle(sl);
@@ -602,8 +1005,15 @@ void slave_run(slave_t *sl) {
                         !IOSVC_JOB_ONESHOT,
                         (iosvc_job_function_t)data_received,
                         sl);
+}
+
+void slave_run(slave_t *sl) {
+    assert(sl);
+
+    slave_start(sl);
 
-    LOG(LOG_LEVEL_INFO, "Starting (pid: %d)\n", getpid());
+    LOG(LOG_LEVEL_INFO, "Starting (pid: %d, port: %u)\n",
+        getpid(), (unsigned int)sl->port);
 
     io_service_run(sl->iosvc);
 }
@@ -0,0 +1,189 @@
+#include "udp-batch.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <sys/socket.h>
+
+static
+bool datagram_valid(const udp_rx_t *rx, unsigned int idx,
+                    const struct sockaddr *local_addr) {
+    const struct msghdr *hdr = &rx->msgs[idx].msg_hdr;
+    size_t len = rx->msgs[idx].msg_len;
+    const pr_signature_t *packet = (const pr_signature_t *)rx->buffers[idx];
+
+    if ((hdr->msg_flags & MSG_TRUNC) || len < PR_MIN_SIZE) {
+        LOG(LOG_LEVEL_WARN,
+            "Invalid size of datagram received: %zu%s\n",
+            len, (hdr->msg_flags & MSG_TRUNC) ? " (truncated)" : "");
+
+        return false;
+    }
+
+    if (packet->s >= PR_COUNT) {
+        LOG(LOG_LEVEL_WARN,
+            "Invalid signature received: %#02x\n",
+            (int)(packet->s));
+
+        return false;
+    }
+
+    if (!pr_size_valid(packet, len)) {
+        LOG(LOG_LEVEL_WARN,
+            "Invalid size of datagram received: %zu for signature %#02x\n",
+            len, (int)(packet->s));
+
+        return false;
+    }
+
+    /* own broadcast */
+    if (rx->addrs[idx].sin_addr.s_addr ==
+        ((const struct sockaddr_in *)local_addr)->sin_addr.s_addr)
+        return false;
+
+    return true;
+}
+
+/**************** API ****************/
+void udp_rx_init(udp_rx_t *rx) {
+    unsigned int idx;
+
+    assert(rx);
+
+    memset(rx->msgs, 0, sizeof(rx->msgs));
+
+    for (idx = 0; idx < UDP_BATCH_SIZE; ++idx) {
+        rx->iov[idx].iov_base = rx->buffers[idx];
+        rx->iov[idx].iov_len = sizeof(rx->buffers[idx]);
+
+        rx->msgs[idx].msg_hdr.msg_iov = &rx->iov[idx];
+        rx->msgs[idx].msg_hdr.msg_iovlen = 1;
+    }
+
+    rx->received = 0;
+}
+
+int udp_rx_drain(udp_rx_t *rx, int fd, const struct sockaddr *local_addr,
+                 udp_rx_handler_t handler, void *ctx) {
+    unsigned int idx, valid = 0;
+    int received;
+
+    assert(rx && local_addr && handler);
+
+    /* name length is value-result, reset it for every message */
+    for (idx = 0; idx < UDP_BATCH_SIZE; ++idx) {
+        rx->msgs[idx].msg_hdr.msg_name = &rx->addrs[idx];
+        rx->msgs[idx].msg_hdr.msg_namelen = sizeof(rx->addrs[idx]);
+    }
+
+    received = recvmmsg(fd, rx->msgs, UDP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+
+    if (received < 0) {
+        if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno)
+            return 0;
+
+        LOG(LOG_LEVEL_FATAL,
+            "Can't read data: %s\n",
+            strerror(errno));
+        abort();
+    }
+
+    rx->received += received;
+
+    /* validate whole batch first, act then */
+    for (idx = 0; idx < (unsigned int)received; ++idx)
+        if (datagram_valid(rx, idx, local_addr))
+            rx->valid[valid++] = idx;
+
+    LOG(LOG_LEVEL_DEBUG,
+        "Datagrams received: %d, valid: %u\n", received, valid);
+
+    for (idx = 0; idx < valid; ++idx)
+        handler(ctx, (const pr_signature_t *)rx->buffers[rx->valid[idx]],
+                fd, &rx->addrs[rx->valid[idx]]);
+
+    return received;
+}
+
+void udp_tx_init(udp_tx_t *tx) {
+    unsigned int idx;
+
+    assert(tx);
+
+    memset(tx->msgs, 0, sizeof(tx->msgs));
+
+    for (idx = 0; idx < UDP_BATCH_SIZE; ++idx) {
+        tx->iov[idx].iov_base = tx->buffers[idx];
+
+        tx->msgs[idx].msg_hdr.msg_iov = &tx->iov[idx];
+        tx->msgs[idx].msg_hdr.msg_iovlen = 1;
+        tx->msgs[idx].msg_hdr.msg_name = &tx->addrs[idx];
+        tx->msgs[idx].msg_hdr.msg_namelen = sizeof(tx->addrs[idx]);
+    }
+
+    tx->count = 0;
+    tx->batching = false;
+    tx->sent = 0;
+}
+
+void udp_tx_begin(udp_tx_t *tx) {
+    assert(tx);
+
+    tx->batching = true;
+}
+
+void udp_tx_send(udp_tx_t *tx, int fd, const void *d, size_t len,
+                 const struct sockaddr_in *addr) {
+    assert(tx && d && addr && len <= PR_MAX_SIZE);
+
+    if (!tx->batching) {
+        if (sendto(fd, d, len, 0,
+                   (const struct sockaddr *)addr, sizeof(*addr)) >= 0)
+            ++tx->sent;
+
+        return;
+    }
+
+    memcpy(tx->buffers[tx->count], d, len);
+    tx->iov[tx->count].iov_len = len;
+    memcpy(&tx->addrs[tx->count], addr, sizeof(*addr));
+
+    if (++tx->count < UDP_BATCH_SIZE)
+        return;
+
+    udp_tx_flush(tx, fd);
+    tx->batching = true;
+}
+
+void udp_tx_flush(udp_tx_t *tx, int fd) {
+    size_t sent = 0;
+    int ret;
+
+    assert(tx);
+
+    tx->batching = false;
+
+    while (sent < tx->count) {
+        ret = sendmmsg(fd, tx->msgs + sent, tx->count - sent, 0);
+
+        if (ret > 0) {
+            sent += ret;
+            tx->sent += ret;
+            continue;
+        }
+
+        if (ret < 0 && EINTR == errno)
+            continue;
+
+        /* skip the datagram which failed */
+        LOG(LOG_LEVEL_WARN,
+            "Can't send datagram: %s\n",
+            strerror(errno));
+        ++sent;
+    }
+
+    tx->count = 0;
+}
@@ -4,6 +4,7 @@
 # include "containers.h"
 # include "io-service.h"
 # include "unix-socket-server.h"
+# include "shm-channel.h"
 # include "avl-tree.h"
 
 # include <stdbool.h>
@@ -73,11 +74,12 @@ struct driver_command_argument {
 };
 
 struct driver_core_connection_state {
+    driver_core_t *core;
     uss_connection_t *ussc;
 
-    int argc;
-    int args_received;
-    size_t last_argument_offset;
+    /* commands from client come through shared memory as well */
+    bool shm_active;
+    shm_channel_t shm;
 };
 
 bool driver_core_init(io_service_t *iosvc,
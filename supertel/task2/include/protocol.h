@@ -26,10 +26,26 @@ typedef struct pr_driver_command_argument pr_driver_command_argument_t;
 struct pr_driver_response;
 typedef struct pr_driver_response pr_driver_response_t;
 
+struct pr_driver_command_tagged;
+typedef struct pr_driver_command_tagged pr_driver_command_tagged_t;
+
+struct pr_driver_response_tagged;
+typedef struct pr_driver_response_tagged pr_driver_response_tagged_t;
+
+struct pr_driver_shm_request;
+typedef struct pr_driver_shm_request pr_driver_shm_request_t;
+
+struct pr_driver_shm_grant;
+typedef struct pr_driver_shm_grant pr_driver_shm_grant_t;
+
 enum {
     PR_DRV_INFO             = 0x00,
     PR_DRV_COMMAND          = 0x01,
-    PR_DRV_RESPONSE         = 0x02
+    PR_DRV_RESPONSE         = 0x02,
+    PR_DRV_SHM_REQUEST      = 0x03,
+    PR_DRV_SHM_GRANT        = 0x04,
+    PR_DRV_COMMAND_TAGGED   = 0x05,
+    PR_DRV_RESPONSE_TAGGED  = 0x06
 };
 
 struct PKD pr_signature {
@@ -62,4 +78,39 @@ struct PKD pr_driver_response {
     uint32_t len;
 };
 
+/*
+ * client -> driver, command carrying request id, arguments follow.
+ * Client may send many of them without waiting for responses.
+ */
+struct PKD pr_driver_command_tagged {
+    pr_signature_t s;
+    uint32_t id;
+    uint8_t cmd_idx;
+    uint8_t argc;
+};
+
+/* driver -> client, response to tagged command, in any order */
+struct PKD pr_driver_response_tagged {
+    pr_signature_t s;
+    uint32_t id;
+    uint32_t len;
+};
+
+/* client -> driver, ask to move commands to shared memory */
+struct PKD pr_driver_shm_request {
+    pr_signature_t s;
+    /* size of each ring wanted, 0 for driver's default */
+    uint32_t ring_size;
+};
+
+/*
+ * driver -> client.
+ * Non-zero ring_size comes with memfd, driver doorbell and client doorbell
+ * eventfds attached as SCM_RIGHTS. Zero means refusal, socket stays in use.
+ */
+struct PKD pr_driver_shm_grant {
+    pr_signature_t s;
+    uint32_t ring_size;
+};
+
 #endif /* _PROTOCOL_H_ */
\ No newline at end of file
@@ -4,6 +4,7 @@
 # include "io-service.h"
 # include "avl-tree.h"
 # include "unix-socket-client.h"
+# include "shm-channel.h"
 # include "protocol.h"
 
 # include <stdio.h>
@@ -16,6 +17,20 @@ typedef struct shell shell_t;
 struct shell_driver;
 typedef struct shell_driver shell_driver_t;
 
+/** Drivers with up to this many commands don't allocate for them */
+# define SHELL_DRIVER_INLINE_COMMANDS   (4)
+
+typedef struct {
+    uint8_t name[MAX_COMMAND_NAME_LEN + 1];
+    uint8_t arity;
+    uint8_t descr[MAX_COMMAND_DESCRIPTION_LEN + 1];
+} shell_driver_command_t;
+
+/** Tagged command awaiting response */
+typedef struct {
+    uint8_t cmd_idx;
+} shell_request_t;
+
 struct shell {
     io_service_t *iosvc;
     int inotify_fd;
@@ -23,6 +38,9 @@ struct shell {
 
     bool running;
 
+    /* ask drivers for shared memory transport, true by default */
+    bool use_shm;
+
     int input_fd;
     FILE *output;
 
@@ -39,15 +57,29 @@ struct shell {
 };
 
 struct shell_driver {
+    shell_t *host;
+
     char *name;
     size_t name_len;
 
     unsigned int slot;
 
-    /* vector of internal data structures */
+    /* vector of shell_driver_command_t */
     vector_t commands;
+    shell_driver_command_t commands_inline[SHELL_DRIVER_INLINE_COMMANDS];
 
     usc_t usc;
+
+    /*
+     * Commands sent and not answered yet.
+     * Maps request id to shell_request_t.
+     */
+    avl_tree_t pending;
+    uint32_t next_request_id;
+
+    /* commands go through shared memory once driver granted it */
+    bool shm_active;
+    shm_channel_t shm;
 };
 
 bool shell_init(shell_t *sh, const char *base_path, size_t base_path_len,
@@ -0,0 +1,139 @@
+#ifndef _SHM_CHANNEL_H_
+# define _SHM_CHANNEL_H_
+
+/** \file shm-channel.h
+ * Shared memory duplex byte channel.
+ *
+ * Channel is a memfd holding two single-producer single-consumer byte
+ * rings, one per direction. Each side owns an eventfd doorbell which
+ * the peer rings only when it published data for a sleeping reader
+ * or freed space for a waiting writer. While both sides are busy
+ * data doesn't pass through the kernel at all.
+ *
+ * Server creates the channel and hands \c SHM_CHANNEL_FDS descriptors
+ * to the client (over UNIX socket with SCM_RIGHTS).
+ * Channel doesn't detect peer death, the socket it was negotiated over
+ * is kept open for that.
+ *
+ * Single-thread implementation per side.
+ */
+
+# include "io-service.h"
+# include "containers.h"
+# include "chain-buffer.h"
+
+# include <stddef.h>
+# include <stdint.h>
+# include <stdbool.h>
+# include <stdatomic.h>
+# include <sys/types.h>
+
+# define SHM_CHANNEL_CACHE_LINE         (64)
+/** Space in front of rings holding ring headers */
+# define SHM_CHANNEL_HEADER_SIZE        (4096)
+# define SHM_CHANNEL_MIN_RING           (4096)
+# define SHM_CHANNEL_DEFAULT_RING       (64 * 1024)
+# define SHM_CHANNEL_MAX_RING           (16 * 1024 * 1024)
+
+/** Descriptors passed to client: memfd, server doorbell, client doorbell */
+# define SHM_CHANNEL_FDS                (3)
+
+struct shm_channel;
+typedef struct shm_channel shm_channel_t;
+
+/**
+ * Receive callback.
+ * \param [in] data bytes received and not consumed yet
+ * \param [in] len their count
+ * \return number of bytes consumed, \c 0 if more data is required
+ *         or negative value to stop the channel
+ *
+ * Called repeatedly while it consumes something.
+ */
+typedef ssize_t (*shm_channel_reader_t)(shm_channel_t *ch,
+                                        const uint8_t *data, size_t len,
+                                        void *ctx);
+
+/** Ring control block, lives in shared memory */
+typedef struct shm_ring_header {
+    /* consumer side */
+    _Alignas(SHM_CHANNEL_CACHE_LINE) _Atomic uint32_t head;
+    /** consumer is about to sleep or sleeps */
+    _Atomic uint32_t reader_sleeping;
+
+    /* producer side */
+    _Alignas(SHM_CHANNEL_CACHE_LINE) _Atomic uint32_t tail;
+    /** producer has data which didn't fit */
+    _Atomic uint32_t writer_waiting;
+} shm_ring_header_t;
+
+typedef struct shm_ring {
+    shm_ring_header_t *hdr;
+    uint8_t *data;
+    uint32_t mask;
+} shm_ring_t;
+
+struct shm_channel {
+    io_service_t *iosvc;
+
+    void *base;
+    size_t map_size;
+
+    int memfd;
+    /** rung by peer */
+    int doorbell;
+    /** rung by us */
+    int peer_doorbell;
+
+    shm_ring_t tx;
+    shm_ring_t rx;
+
+    /** data which didn't fit into tx ring */
+    chain_buffer_t pending;
+    /** incomplete packet collected from rx ring */
+    buffer_t in;
+
+    shm_channel_reader_t reader;
+    void *ctx;
+
+    bool running;
+};
+
+/**
+ * Create channel (server side).
+ * \param [in] ring_size size of each ring, rounded up to power of two
+ *                       and clamped to [MIN_RING, MAX_RING]
+ */
+bool shm_channel_create(shm_channel_t *ch, io_service_t *iosvc,
+                        size_t ring_size);
+/**
+ * Attach to channel created by peer (client side).
+ * \param [in] fds descriptors as filled by \c shm_channel_fds,
+ *                 ownership is taken even on failure
+ * \param [in] ring_size ring size reported by server
+ */
+bool shm_channel_attach(shm_channel_t *ch, io_service_t *iosvc,
+                        const int fds[SHM_CHANNEL_FDS], size_t ring_size);
+void shm_channel_deinit(shm_channel_t *ch);
+
+/** Fill descriptors to pass to client. Server side only */
+void shm_channel_fds(const shm_channel_t *ch, int fds[SHM_CHANNEL_FDS]);
+size_t shm_channel_ring_size(const shm_channel_t *ch);
+
+/** Post doorbell job to IO service and start receiving */
+void shm_channel_start(shm_channel_t *ch,
+                       shm_channel_reader_t reader, void *ctx);
+/** Remove doorbell job. Safe to call from within reader */
+void shm_channel_stop(shm_channel_t *ch);
+bool shm_channel_running(const shm_channel_t *ch);
+
+/**
+ * Queue data for peer.
+ * Data is copied into the ring right away as long as there is space,
+ * the rest is sent when peer frees some.
+ */
+void shm_channel_send(shm_channel_t *ch, const void *d, size_t sz);
+/** Same as \c shm_channel_send. Contents of \c cb are moved */
+void shm_channel_send_chain(shm_channel_t *ch, chain_buffer_t *cb);
+
+#endif /* _SHM_CHANNEL_H_ */
@@ -2,10 +2,14 @@
 # define _UNIX_SOCKET_CLIENT_H_
 
 # include "io-service.h"
+# include "chain-buffer.h"
 
 # include <stdbool.h>
 # include <stddef.h>
 
+/** Maximum descriptors kept from SCM_RIGHTS until reader takes them */
+# define USC_MAX_FDS        (4)
+
 struct unix_socket_client;
 typedef struct unix_socket_client usc_t;
 
@@ -39,13 +43,17 @@ struct unix_socket_client {
         void *ctx;
         buffer_t b;
         size_t currently_read;
+        /* descriptors received so far, reader takes ownership
+         * by zeroing fds_number */
+        int fds[USC_MAX_FDS];
+        size_t fds_number;
     } read_task;
 
     struct {
         usc_writer_t writer;
         void *ctx;
-        buffer_t b;
-        size_t currently_wrote;
+        /* queued data, sent with sendmsg */
+        chain_buffer_t chain;
     } write_task;
 
     void *priv;
@@ -66,6 +74,10 @@ void unix_socket_client_send(usc_t *usc,
                              const void *d, size_t sz,
                              usc_writer_t writer,
                              void *ctx);
+void unix_socket_client_send_chain(usc_t *usc,
+                                   chain_buffer_t *cb,
+                                   usc_writer_t writer,
+                                   void *ctx);
 void unix_socket_client_recv(usc_t *usc,
                              size_t sz,
                              usc_reader_t reader,
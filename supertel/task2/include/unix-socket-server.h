@@ -2,10 +2,18 @@
 # define _UNIX_SOCKET_SERVER_H_
 
 # include "io-service.h"
+# include "chain-buffer.h"
 # include "avl-tree.h"
 
 # include <stdbool.h>
 # include <stddef.h>
+# include <stdint.h>
+# include <sys/types.h>
+
+/** Maximum descriptors passed along with single send */
+# define USS_MAX_FDS        (4)
+/** Connection's stream is received with chunks up to that size */
+# define USS_READ_CHUNK     (64 * 1024)
 
 struct unix_socket_server;
 typedef struct unix_socket_server uss_t;
@@ -14,7 +22,24 @@ struct unix_socket_connection;
 typedef struct unix_socket_server_connection uss_connection_t;
 
 typedef bool (*uss_acceptor_t)(uss_t *srv, uss_connection_t *conn, void *ctx);
-typedef void (*uss_reader_t)(uss_t *srv, uss_connection_t *conn,
+/**
+ * Stream receive callback.
+ * \param [in] data bytes received and not consumed yet
+ * \param [in] len their count
+ * \return number of bytes consumed, \c 0 if more data is required
+ *         or negative value to stop reading, \c uss_closed_t follows
+ *
+ * Called repeatedly while it consumes something, so a frame at a time
+ * may be consumed. Connection must not be closed from within.
+ */
+typedef ssize_t (*uss_stream_reader_t)(uss_t *srv, uss_connection_t *conn,
+                                       const uint8_t *data, size_t len,
+                                       void *ctx);
+/**
+ * Connection stopped being read: EOF, receive error or reader refused
+ * data (\c error is \c EPROTO then). \c conn->eof is set on EOF.
+ */
+typedef void (*uss_closed_t)(uss_t *srv, uss_connection_t *conn,
                              int error, void *ctx);
 typedef void (*uss_writer_t)(uss_t *srv, uss_connection_t *conn,
                              int error,
@@ -38,17 +63,23 @@ struct unix_socket_server_connection {
     bool eof;
 
     struct {
-        uss_reader_t reader;
+        uss_stream_reader_t reader;
+        uss_closed_t closed;
         void *ctx;
-        buffer_t b;
-        size_t currently_read;
+        /* received and not consumed yet */
+        chain_buffer_t chain;
+        /* frame spanning chain's slices is gathered here */
+        buffer_t frame;
     } read_task;
 
     struct {
         uss_writer_t writer;
         void *ctx;
-        buffer_t b;
-        size_t currently_wrote;
+        /* queued data, sent with sendmsg */
+        chain_buffer_t chain;
+        /* descriptors attached to the first byte of queued data */
+        int fds[USS_MAX_FDS];
+        size_t fds_number;
     } write_task;
 
     void *priv;
@@ -68,9 +99,29 @@ void unix_socket_server_send(uss_t *srv, uss_connection_t *conn,
                              const void *d, size_t sz,
                              uss_writer_t writer,
                              void *ctx);
-void unix_socket_server_recv(uss_t *srv, uss_connection_t *conn,
-                             size_t sz,
-                             uss_reader_t reader,
-                             void *ctx);
+void unix_socket_server_send_chain(uss_t *srv, uss_connection_t *conn,
+                                   chain_buffer_t *cb,
+                                   uss_writer_t writer,
+                                   void *ctx);
+/**
+ * Same as \c unix_socket_server_send with descriptors passed as SCM_RIGHTS.
+ * Descriptors should stay open until \c writer is called.
+ */
+void unix_socket_server_send_fds(uss_t *srv, uss_connection_t *conn,
+                                 const void *d, size_t sz,
+                                 const int *fds, size_t fds_number,
+                                 uss_writer_t writer,
+                                 void *ctx);
+/**
+ * Start reading connection's stream.
+ * Every wakeup stream is received with chunks up to \c USS_READ_CHUNK,
+ * \c reader consumes as many frames as they hold. Data sent from
+ * within \c reader goes with a single \c sendmsg after the chunk.
+ * \param [in] closed called once connection stops being read
+ */
+void unix_socket_server_recv_stream(uss_t *srv, uss_connection_t *conn,
+                                    uss_stream_reader_t reader,
+                                    uss_closed_t closed,
+                                    void *ctx);
 
 #endif /* _UNIX_SOCKET_SERVER_H_ */
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "driver-core.h"
 #include "protocol.h"
 #include "containers.h"
+#include "chain-buffer.h"
 #include "common.h"
 #include "log.h"
 
@@ -12,11 +13,17 @@
 #include <errno.h>
 #include <unistd.h>
 
+#include <sys/socket.h>
+
 #include <linux/un.h>
 
 /************ declaratins ************/
 static
-void reader(uss_t *srv, uss_connection_t *conn,
+ssize_t reader(uss_t *srv, uss_connection_t *conn,
+               const uint8_t *data, size_t len,
+               driver_core_t *core);
+static
+void closed(uss_t *srv, uss_connection_t *conn,
             int error,
             driver_core_t *core);
 static
@@ -25,243 +32,306 @@ void writer(uss_t *srv, uss_connection_t *conn,
             driver_core_t *core);
 static
 bool acceptor(uss_t *srv, uss_connection_t *conn, driver_core_t *core);
+static
+void drop_connection(uss_t *srv, uss_connection_t *conn,
+                     driver_core_t *core);
+static
+void prepare_response(driver_command_t *comm, uint8_t cmd_idx,
+                      int argc, driver_command_argument_t *argv,
+                      bool tagged, uint32_t id,
+                      chain_buffer_t *cb);
+static
+ssize_t run_command(driver_core_t *core, const uint8_t *data, size_t len,
+                    chain_buffer_t *cb);
+static
+void grant_shm(uss_t *srv, uss_connection_t *conn, driver_core_t *core,
+               const pr_driver_shm_request_t *req);
+static
+ssize_t shm_reader(shm_channel_t *ch, const uint8_t *data, size_t len,
+                   driver_core_connection_state_t *state);
+static
+void deinit_channels(avl_tree_node_t *atn);
 static inline
 bool driver_core_init_(io_service_t *iosvc,
                        driver_core_t *core,
                        driver_payload_t *payload);
 
 /************ definitions ************/
-void reader(uss_t *srv, uss_connection_t *conn,
-            int error, driver_core_t *core) {
-    const pr_signature_t *s;
-    pr_driver_response_t *response_header;
-    const pr_driver_command_t *dc;
-    const pr_driver_command_argument_t *dca;
-    const uint8_t *dca_value;
-    uint8_t argc, arg_idx;
-    uint8_t cmd_idx;
-    size_t required_length;
-    driver_command_t *comm;
-    buffer_t response;
+void drop_connection(uss_t *srv, uss_connection_t *conn, driver_core_t *core) {
+    driver_core_connection_state_t *state = conn->priv;
+
+    if (state->shm_active)
+        shm_channel_deinit(&state->shm);
+
+    avl_tree_remove(&core->connection_state, conn->fd);
+    unix_socket_server_close_connection(srv, conn);
+}
+
+void deinit_channels(avl_tree_node_t *atn) {
     driver_core_connection_state_t *state;
 
-    if (error) {
-        LOG(LOG_LEVEL_WARN, "Couldn't recv from client: %s\n",
-            strerror(errno));
-        avl_tree_remove(&core->connection_state, conn->fd);
-        unix_socket_server_close_connection(srv, conn);
+    if (!atn)
         return;
-    }
 
-    if (conn->eof) {
-        LOG_MSG(LOG_LEVEL_DEBUG, "Another one EOF\n");
-        avl_tree_remove(&core->connection_state, conn->fd);
-        unix_socket_server_close_connection(srv, conn);
+    deinit_channels(atn->left);
+    deinit_channels(atn->right);
+
+    state = (driver_core_connection_state_t *)atn->data;
+
+    if (state->shm_active)
+        shm_channel_deinit(&state->shm);
+
+    state->shm_active = false;
+}
+
+void prepare_response(driver_command_t *comm, uint8_t cmd_idx,
+                      int argc, driver_command_argument_t *argv,
+                      bool tagged, uint32_t id,
+                      chain_buffer_t *cb) {
+    pr_driver_response_t response_header;
+    pr_driver_response_tagged_t tagged_header;
+    buffer_t response;
+
+    buffer_init(&response, 0, bp_non_shrinkable);
+    comm->handler(cmd_idx,
+                  comm->name, comm->name_len,
+                  argc, argv, &response);
+
+    /* payload is handed over to the chain, header goes in front of it */
+    chain_buffer_init(cb, 0);
+    chain_buffer_adopt(cb, response.data, response.user_size);
+
+    if (tagged) {
+        tagged_header.s.s = PR_DRV_RESPONSE_TAGGED;
+        tagged_header.id = id;
+        tagged_header.len = response.user_size;
+
+        chain_buffer_prepend(cb, &tagged_header, sizeof(tagged_header));
         return;
     }
 
-    s = (const pr_signature_t *)(conn->read_task.b.data);
+    response_header.s.s = PR_DRV_RESPONSE;
+    response_header.len = response.user_size;
 
-    if (PR_DRV_COMMAND != s->s) {
-        LOG(LOG_LEVEL_WARN, "Invalid signature received: %#02x\n",
-            s->s);
-        avl_tree_remove(&core->connection_state, conn->fd);
-        unix_socket_server_close_connection(srv, conn);
-        return;
+    chain_buffer_prepend(cb, &response_header, sizeof(response_header));
+}
+
+/*
+ * Parse plain or tagged command frame right within received data
+ * and prepare response. Tagged command gets tagged response.
+ * Return frame length, 0 if frame is incomplete or -1 if it's invalid.
+ */
+ssize_t run_command(driver_core_t *core, const uint8_t *data, size_t len,
+                    chain_buffer_t *cb) {
+    const pr_driver_command_t *dc;
+    const pr_driver_command_tagged_t *dct;
+    const pr_driver_command_argument_t *dca;
+    driver_command_t *comm;
+    bool tagged = PR_DRV_COMMAND_TAGGED == data[0];
+    uint32_t id = 0;
+    uint8_t cmd_idx, argc;
+    size_t offset;
+    uint8_t arg_idx;
+
+    if (tagged) {
+        dct = (const pr_driver_command_tagged_t *)data;
+
+        if (len < sizeof(*dct))
+            return 0;
+
+        id = dct->id;
+        cmd_idx = dct->cmd_idx;
+        argc = dct->argc;
+        offset = sizeof(*dct);
     }
+    else {
+        dc = (const pr_driver_command_t *)data;
 
-    if (conn->read_task.b.user_size < sizeof(pr_driver_command_t)) {
-        conn->read_task.b.offset = conn->read_task.b.user_size;
-        unix_socket_server_recv(
-            srv, conn,
-            sizeof(pr_driver_command_t) - conn->read_task.b.user_size,
-            (uss_reader_t)reader,
-            core);
+        if (len < sizeof(*dc))
+            return 0;
 
-        return;
+        cmd_idx = dc->cmd_idx;
+        argc = dc->argc;
+        offset = sizeof(*dc);
     }
 
-    state = (driver_core_connection_state_t *)conn->priv;
-    dc = (const pr_driver_command_t *)s;
-    argc = dc->argc;
-    cmd_idx = dc->cmd_idx;
-    dca = (const pr_driver_command_argument_t *)(dc + 1);
+    if (cmd_idx >= vector_count(&core->payload->commands)) {
+        LOG(LOG_LEVEL_WARN, "Invalid command: %#02x\n",
+            (unsigned int)cmd_idx);
+        return -1;
+    }
 
-    state->argc = argc;
+    comm = (driver_command_t *)vector_get(&core->payload->commands,
+                                          cmd_idx);
 
-    comm = (driver_command_t *)vector_get(&core->payload->commands, cmd_idx);
     if (argc > comm->max_arity) {
         LOG(LOG_LEVEL_WARN, "Maximum command arity exceeded: %#02x vs %#02x\n",
             (unsigned int)argc, (unsigned int)comm->max_arity);
-        avl_tree_remove(&core->connection_state, conn->fd);
-        unix_socket_server_close_connection(srv, conn);
-        return;
+        return -1;
     }
 
-    if (!argc) {
-        LOG(LOG_LEVEL_DEBUG, "Calling %*s with no arguments\n",
-            comm->name_len, comm->name);
-        buffer_init(&response, sizeof(*response_header), bp_non_shrinkable);
-        comm->handler(cmd_idx,
-                      comm->name, comm->name_len,
-                      argc, NULL, &response);
-
-        if (response.user_size < sizeof(*response_header)) {
-            LOG_MSG(LOG_LEVEL_FATAL,
-                    "Comand handler malforms response buffer\n");
-            abort();
-        }
-
-        response_header = (pr_driver_response_t *)response.data;
-        response_header->s.s = PR_DRV_RESPONSE;
-        response_header->len = response.user_size - sizeof(*response_header);
-
-        unix_socket_server_send(srv, conn, response.data, response.user_size,
-                                (uss_writer_t)writer, core);
-        buffer_deinit(&response);
-        return;
-    }   /* if (!argc) */
-
-    if (state->argc == state->args_received) {
-        LOG(LOG_LEVEL_DEBUG, "Calling %*s with %d arguments\n",
-            comm->name_len, comm->name, state->argc);
-        driver_command_argument_t argv[state->argc];
+    /* arguments are referenced right within received data */
+    driver_command_argument_t argv[argc + 1];
 
-        for (arg_idx = 0; arg_idx < state->argc; ++arg_idx) {
-            argv[arg_idx].arg = (const char *)(dca + 1);
-            argv[arg_idx].arg_len = dca->len;
+    for (arg_idx = 0; arg_idx < argc; ++arg_idx) {
+        if (len < offset + sizeof(*dca))
+            return 0;
 
-            dca = (const pr_driver_command_argument_t *)(
-                (const uint8_t *)(dca + 1) + dca->len);
-        }
+        dca = (const pr_driver_command_argument_t *)(data + offset);
 
-        buffer_init(&response, 0, bp_non_shrinkable);
-        comm->handler(cmd_idx,
-                      comm->name, comm->name_len,
-                      state->argc, argv, &response);
-        unix_socket_server_send(srv, conn, response.data, response.user_size,
-                                (uss_writer_t)writer, core);
-        buffer_deinit(&response);
+        if (len < offset + sizeof(*dca) + dca->len)
+            return 0;
 
-        return;
-    }   /* if (state->argc == state->args_received) */
-
-    /* TODO receive full arguments vector */
-    if (0 == state->last_argument_offset)
-        state->last_argument_offset = sizeof(*dc);
-
-    dca = (const pr_driver_command_argument_t *)(
-        (const uint8_t *)s + state->last_argument_offset
-    );
-
-    if (conn->read_task.b.user_size < state->last_argument_offset
-                                            + sizeof(*dca)) {
-        required_length = state->last_argument_offset + sizeof(*dca);
-        conn->read_task.b.offset = conn->read_task.b.user_size;
-        unix_socket_server_recv(
-            srv, conn,
-            required_length - conn->read_task.b.user_size,
-            (uss_reader_t)reader,
-            core);
+        argv[arg_idx].arg = (const char *)(dca + 1);
+        argv[arg_idx].arg_len = dca->len;
 
-        return;
+        offset += sizeof(*dca) + dca->len;
     }
 
-    if (conn->read_task.b.user_size < state->last_argument_offset
-                                            + sizeof(*dca) + dca->len) {
-        required_length = state->last_argument_offset + sizeof(*dca)
-                            + dca->len;
-        conn->read_task.b.offset = conn->read_task.b.user_size;
-        unix_socket_server_recv(
-            srv, conn,
-            required_length - conn->read_task.b.user_size,
-            (uss_reader_t)reader,
-            core);
+    LOG(LOG_LEVEL_DEBUG, "Calling %*s with %d arguments\n",
+        comm->name_len, comm->name, argc);
 
-        return;
-    }
+    prepare_response(comm, cmd_idx, argc, argv, tagged, id, cb);
 
-    ++state->args_received;
-    state->last_argument_offset += sizeof(*dca) + dca->len;
-    required_length = state->last_argument_offset + sizeof(*dca);
+    return offset;
+}
 
-    if (state->args_received < state->argc) {
-        conn->read_task.b.offset = conn->read_task.b.user_size;
-        unix_socket_server_recv(
-            srv, conn,
-            required_length - conn->read_task.b.user_size,
-            (uss_reader_t)reader,
-            core);
+ssize_t shm_reader(shm_channel_t *ch, const uint8_t *data, size_t len,
+                   driver_core_connection_state_t *state) {
+    chain_buffer_t cb;
+    ssize_t n;
 
-        return;
+    if (PR_DRV_COMMAND != data[0] && PR_DRV_COMMAND_TAGGED != data[0]) {
+        LOG(LOG_LEVEL_WARN, "Invalid signature through shared memory: "
+                            "%#02x\n", (unsigned int)data[0]);
+        n = -1;
     }
+    else
+        n = run_command(state->core, data, len, &cb);
 
-    LOG(LOG_LEVEL_DEBUG, "Calling %*s with %d arguments\n",
-        comm->name_len, comm->name, state->argc);
-    driver_command_argument_t argv[state->argc];
-
-    for (arg_idx = 0; arg_idx < state->argc; ++arg_idx) {
-        argv[arg_idx].arg = (const char *)(dca + 1);
-        argv[arg_idx].arg_len = dca->len;
+    if (n < 0) {
+        /* connection is dropped when reader sees EOF */
+        shutdown(state->ussc->fd, SHUT_RDWR);
+        return -1;
+    }
 
-        dca = (const pr_driver_command_argument_t *)(
-            (const uint8_t *)(dca + 1) + dca->len);
+    if (n) {
+        shm_channel_send_chain(ch, &cb);
+        chain_buffer_deinit(&cb);
     }
 
-    buffer_init(&response, sizeof(*response_header), bp_non_shrinkable);
-    comm->handler(cmd_idx,
-                  comm->name, comm->name_len,
-                  state->argc, argv, &response);
+    return n;
+}
 
-    if (response.user_size < sizeof(*response_header)) {
-        LOG_MSG(LOG_LEVEL_FATAL,
-                "Comand handler malforms response buffer\n");
-        abort();
+void grant_shm(uss_t *srv, uss_connection_t *conn, driver_core_t *core,
+               const pr_driver_shm_request_t *req) {
+    driver_core_connection_state_t *state = conn->priv;
+    pr_driver_shm_grant_t grant;
+    int fds[SHM_CHANNEL_FDS];
+
+    grant.s.s = PR_DRV_SHM_GRANT;
+    grant.ring_size = 0;
+
+    /* descriptors can't ride along responses queued before */
+    if (!state->shm_active &&
+        !chain_buffer_length(&conn->write_task.chain) &&
+        shm_channel_create(&state->shm, core->iosvc,
+                           req->ring_size ? req->ring_size
+                                          : SHM_CHANNEL_DEFAULT_RING)) {
+        state->shm_active = true;
+        shm_channel_start(&state->shm,
+                          (shm_channel_reader_t)shm_reader, state);
+
+        grant.ring_size = shm_channel_ring_size(&state->shm);
+        shm_channel_fds(&state->shm, fds);
+
+        LOG(LOG_LEVEL_DEBUG, "Shared memory granted, ring size %u\n",
+            (unsigned int)grant.ring_size);
+
+        unix_socket_server_send_fds(srv, conn, &grant, sizeof(grant),
+                                    fds, SHM_CHANNEL_FDS,
+                                    (uss_writer_t)writer, core);
+        return;
     }
 
-    response_header = (pr_driver_response_t *)response.data;
-    response_header->s.s = PR_DRV_RESPONSE;
-    response_header->len = response.user_size - sizeof(*response_header);
+    /* client stays with the socket */
+    LOG_MSG(LOG_LEVEL_WARN, "Shared memory refused\n");
 
-    unix_socket_server_send(srv, conn, response.data, response.user_size,
+    unix_socket_server_send(srv, conn, &grant, sizeof(grant),
                             (uss_writer_t)writer, core);
-    buffer_deinit(&response);
 }
 
-void writer(uss_t *srv, uss_connection_t *conn,
-            int error, driver_core_t *core) {
-    driver_core_connection_state_t *s = conn->priv;
-
-    if (error) {
-        LOG(LOG_LEVEL_WARN, "Couldn't send buffer to client: %s\n",
-            strerror(errno));
-        avl_tree_remove(&core->connection_state, conn->fd);
-        unix_socket_server_close_connection(srv, conn);
-        return;
+/* every frame of a chunk is answered, responses are coalesced in the queue */
+ssize_t reader(uss_t *srv, uss_connection_t *conn,
+               const uint8_t *data, size_t len, driver_core_t *core) {
+    chain_buffer_t cb;
+    ssize_t n;
+
+    switch (data[0]) {
+        case PR_DRV_SHM_REQUEST:
+            if (len < sizeof(pr_driver_shm_request_t))
+                return 0;
+
+            grant_shm(srv, conn, core,
+                      (const pr_driver_shm_request_t *)data);
+            return sizeof(pr_driver_shm_request_t);
+
+        case PR_DRV_COMMAND:
+        case PR_DRV_COMMAND_TAGGED:
+            n = run_command(core, data, len, &cb);
+
+            if (n > 0) {
+                unix_socket_server_send_chain(srv, conn, &cb,
+                                              (uss_writer_t)writer, core);
+                chain_buffer_deinit(&cb);
+            }
+
+            return n;
+
+        default:
+            LOG(LOG_LEVEL_WARN, "Invalid signature received: %#02x\n",
+                (unsigned int)data[0]);
+            return -1;
     }
+}
 
-    s->argc = s->args_received = 0;
-    s->last_argument_offset = 0;
+void closed(uss_t *srv, uss_connection_t *conn,
+            int error, driver_core_t *core) {
+    if (error)
+        LOG(LOG_LEVEL_WARN, "Couldn't recv from client: %s\n",
+            strerror(error));
+    else
+        LOG_MSG(LOG_LEVEL_DEBUG, "Another one EOF\n");
 
-    buffer_realloc(&conn->read_task.b, 0);
+    drop_connection(srv, conn, core);
+}
+
+void writer(uss_t *srv, uss_connection_t *conn,
+            int error, driver_core_t *core) {
+    if (!error)
+        return;
 
-    unix_socket_server_recv(srv, conn, sizeof(pr_signature_t),
-                            (uss_reader_t)reader,
-                            core);
+    LOG(LOG_LEVEL_WARN, "Couldn't send buffer to client: %s\n",
+        strerror(error));
+    drop_connection(srv, conn, core);
 }
 
 bool acceptor(uss_t *srv, uss_connection_t *conn, driver_core_t *core) {
     avl_tree_node_t *atn = avl_tree_add(&core->connection_state, conn->fd);
     driver_core_connection_state_t *s = (driver_core_connection_state_t *)atn->data;
 
-    s->argc = s->args_received = 0;
-    s->last_argument_offset = 0;
+    s->core = core;
     s->ussc = conn;
+    s->shm_active = false;
 
     conn->priv = s;
 
     unix_socket_server_send(srv, conn, core->greeting, core->greeting_length,
                             (uss_writer_t)writer, core);
+    unix_socket_server_recv_stream(srv, conn,
+                                   (uss_stream_reader_t)reader,
+                                   (uss_closed_t)closed,
+                                   core);
     return true;
 }
 
@@ -353,6 +423,7 @@ bool driver_core_init(io_service_t *iosvc,
 
 void driver_core_deinit(driver_core_t *core) {
     assert(core);
+    deinit_channels(core->connection_state.root);
     unix_socket_server_deinit(&core->uss);
 
     vector_deinit(&core->payload->commands);
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <signal.h>
 
 void print_usage(const char *self) {
     printf("usage: %s <driver type: one | two> <slot number>\n", self);
@@ -37,6 +38,8 @@ int main(int argc, char **argv) {
         exit(2);
     }
 
+    log_async_start();
+
     io_service_init(&iosvc);
 
     if (!wait_for_sigterm_sigint(&iosvc)) {
@@ -46,6 +49,13 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
+#ifdef IO_SERVICE_STATS
+    /* kill -USR1 <pid> prints event loop histograms */
+    if (!io_service_stats_dump_on_signal(&iosvc, SIGUSR1))
+        LOG(LOG_LEVEL_WARN, "Can't await SIGUSR1 for stats dump: %s\n",
+            strerror(errno));
+#endif
+
     if (!driver_core_init(&iosvc, &dc, &dp)) {
         LOG_MSG(LOG_LEVEL_FATAL, "Can't initialzie driver core\n");
         exit(1);
@@ -57,5 +67,7 @@ int main(int argc, char **argv) {
 
     io_service_deinit(&iosvc);
 
+    log_async_stop();
+
     return 0;
 }
\ No newline at end of file
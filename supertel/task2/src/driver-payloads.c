@@ -216,6 +216,7 @@ void driver_payload_one(driver_payload_t *dp,unsigned int slot) {
     dp->slot_number = slot;
 
     vector_init(&dp->commands, sizeof(driver_command_t), 0);
+    vector_reserve(&dp->commands, 3);
     dc = (driver_command_t *)vector_append(&dp->commands);
     dc->description = "O1 is the first command ever. For One driver only";
     dc->description_len = strlen(dc->description);
@@ -250,6 +251,7 @@ void driver_payload_two(driver_payload_t *dp, unsigned int slot) {
     dp->slot_number = slot;
 
     vector_init(&dp->commands, sizeof(driver_command_t), 0);
+    vector_reserve(&dp->commands, 2);
     dc = (driver_command_t *)vector_append(&dp->commands);
     dc->description = "T1 is the first command for Two driver";
     dc->description_len = strlen(dc->description);
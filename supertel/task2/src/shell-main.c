@@ -5,14 +5,36 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <signal.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <stdbool.h>
+
+void print_usage(const char *self) {
+    printf("usage: %s [-S]\n", self);
+    printf("  -S  talk to drivers over sockets only, no shared memory\n");
+}
 
 int main(int argc, char **argv) {
     io_service_t iosvc;
     shell_t sh;
+    bool use_shm = true;
+    int opt;
+
+    while (-1 != (opt = getopt(argc, argv, "Sh"))) {
+        switch (opt) {
+            case 'S':
+                use_shm = false;
+                break;
+            default:
+                print_usage(argv[0]);
+                exit(opt == 'h' ? 0 : 2);
+        }
+    }
 
+    /* interactive: log records are flushed in place to keep them
+     * in order with the prompt */
     io_service_init(&iosvc);
 
     if (!wait_for_sigterm_sigint(&iosvc)) {
@@ -22,12 +44,21 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
+#ifdef IO_SERVICE_STATS
+    /* kill -USR1 <pid> prints event loop histograms */
+    if (!io_service_stats_dump_on_signal(&iosvc, SIGUSR1))
+        LOG(LOG_LEVEL_WARN, "Can't await SIGUSR1 for stats dump: %s\n",
+            strerror(errno));
+#endif
+
     if (!shell_init(&sh, BASE_DIR, BASE_DIR_LEN, &iosvc, STDIN_FILENO, stdout)) {
         LOG(LOG_LEVEL_FATAL, "Can't initialize shell: %s\n",
             strerror(errno));
         exit(1);
     }
 
+    sh.use_shm = use_shm;
+
     setvbuf(stdout, NULL, _IONBF, 0);
 
     shell_run(&sh);
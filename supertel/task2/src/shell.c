@@ -1,6 +1,7 @@
 #include "shell.h"
 #include "hash-functions.h"
 #include "containers.h"
+#include "chain-buffer.h"
 #include "common.h"
 #include "protocol.h"
 #include "log.h"
@@ -53,6 +54,9 @@
 #define SPACE               " "
 #define SPACE_LEN           (sizeof(SPACE) - 1)
 
+/* arguments of a typical command don't allocate */
+#define INLINE_ARGS         (8)
+
 #define DRIVER_SLOT_ID(name, name_len, slot)    \
 char ID[name_len + MAX_DIGITS + 1];             \
 size_t ID_len;                                  \
@@ -72,11 +76,13 @@ typedef struct {
     uint8_t len;
 } arg_from_input_t;
 
+/* plain or tagged response */
 typedef struct {
-    uint8_t name[MAX_COMMAND_NAME_LEN + 1];
-    uint8_t arity;
-    uint8_t descr[MAX_COMMAND_DESCRIPTION_LEN + 1];
-} shell_driver_command_t;
+    bool tagged;
+    uint32_t id;
+    uint32_t len;
+    const char *text;
+} response_t;
 
 static
 void purge_clients_list(avl_tree_node_t *atn);
@@ -117,6 +123,24 @@ static
 void reader_info(usc_t *usc, int error, shell_t *sh);
 static
 void reader_response(usc_t *usc, int error, shell_t *sh);
+static
+void reader_shm_grant(usc_t *usc, int error, shell_t *sh);
+
+static
+ssize_t shm_reader(shm_channel_t *ch, const uint8_t *data, size_t len,
+                   shell_driver_t *sd);
+
+static inline
+size_t parse_response(const uint8_t *data, size_t len, response_t *r);
+
+static
+void print_response(shell_driver_t *sd, const response_t *r);
+
+static
+void drop_shm(shell_driver_t *sd);
+
+static
+void forget_pending(shell_driver_t *sd);
 
 static
 void on_input(int fd, io_svc_op_t op, shell_t *sh);
@@ -313,14 +337,14 @@ void cmd_invalid(shell_t *sh) {
 void cmd_cmd(shell_t *sh,
              const char *drv, unsigned int slot, const char *cmd,
              vector_t *args) {
-    buffer_t b;
-    size_t length_required;
+    chain_buffer_t cb;
     const shell_driver_command_t *sdc;
     pr_driver_command_argument_t *pdca;
-    pr_driver_command_t *pdc;
+    pr_driver_command_tagged_t *pdc;
+    shell_request_t *req;
+    bool inserted;
     size_t idx;
     arg_from_input_t *afi;
-    uint8_t *arg_val;
     avl_tree_node_t *atn;
     hash_t hash;
     list_t *l;
@@ -387,37 +411,41 @@ void cmd_cmd(shell_t *sh,
         return;
     }
 
-    length_required = sizeof(*pdc) + vector_count(args) * sizeof(*pdca);
-
-    for (idx = 0; idx < vector_count(args); ++idx) {
-        afi = (arg_from_input_t *)vector_get(args, idx);
-        length_required += afi->len;
-    }
-
-    buffer_init(&b, length_required, bp_non_shrinkable);
+    /* header and arguments are appended to the chain tail
+     * without reallocating a contiguous buffer */
+    chain_buffer_init(&cb, 0);
 
-    pdc = (pr_driver_command_t *)b.data;
-    pdc->s.s = PR_DRV_COMMAND;
+    /* tagged: no need to wait for the response before the next command */
+    pdc = (pr_driver_command_tagged_t *)chain_buffer_append_space(
+        &cb, sizeof(*pdc));
+    pdc->s.s = PR_DRV_COMMAND_TAGGED;
+    pdc->id = sd->next_request_id++;
     pdc->cmd_idx = cmd_idx;
     pdc->argc = vector_count(args);
-    pdca = (pr_driver_command_argument_t *)(pdc + 1);
+
+    /* id wrapped around onto a command never answered, reuse its entry */
+    req = (shell_request_t *)avl_tree_add_or_get(&sd->pending, pdc->id,
+                                                 &inserted)->data;
+    req->cmd_idx = cmd_idx;
 
     for (idx = 0; idx < vector_count(args); ++idx) {
         afi = (arg_from_input_t *)vector_get(args, idx);
 
+        pdca = (pr_driver_command_argument_t *)chain_buffer_append_space(
+            &cb, sizeof(*pdca));
         pdca->len = afi->len;
-        arg_val = (uint8_t *)(pdca + 1);
-        memcpy(arg_val, afi->arg, pdca->len);
-
-        pdca = (pr_driver_command_argument_t *)(arg_val + pdca->len);
+        chain_buffer_append(&cb, afi->arg, afi->len);
     }
 
-    unix_socket_client_send(
-        &sd->usc, b.data, b.user_size,
-        (usc_writer_t)writer, sh
-    );
+    if (sd->shm_active && shm_channel_running(&sd->shm))
+        shm_channel_send_chain(&sd->shm, &cb);
+    else
+        unix_socket_client_send_chain(
+            &sd->usc, &cb,
+            (usc_writer_t)writer, sh
+        );
 
-    buffer_deinit(&b);
+    chain_buffer_deinit(&cb);
 }
 
 void finish_cmd(shell_t *sh) {
@@ -445,6 +473,7 @@ void run_command_from_input(shell_t *sh) {
     char *slot_endptr = NULL;
     unsigned int slot_number;
     vector_t args;
+    arg_from_input_t args_inline[INLINE_ARGS];
     arg_from_input_t *afi;
     size_t arg_len;
 
@@ -491,7 +520,7 @@ void run_command_from_input(shell_t *sh) {
         return;
     }
 
-    vector_init(&args, sizeof(*afi), 0);
+    vector_init_inline(&args, sizeof(*afi), args_inline, INLINE_ARGS);
     token = strtok(NULL, DELIM);
 
     while (token) {
@@ -576,15 +605,16 @@ void on_input(int fd, io_svc_op_t op, shell_t *sh) {
     }
 }
 
+/* responses are read regardless of sends, only errors matter here */
 void writer(usc_t *usc, int error, shell_t *sh) {
-    buffer_realloc(&usc->read_task.b, 0);
-    buffer_realloc(&usc->write_task.b, 0);
-
     if (error) {
         LOG(LOG_LEVEL_WARN, "Couldn't send to driver %*s: %s\n",
             usc->connected_to_name_len, usc->connected_to_name,
             strerror(errno));
 
+        drop_shm((shell_driver_t *)usc->priv);
+        forget_pending((shell_driver_t *)usc->priv);
+
         if (!unix_socket_client_reconnect(usc)) {
             LOG(LOG_LEVEL_WARN, "Couldn't reconnect to driver %*s: %s\n",
                 usc->connected_to_name_len, usc->connected_to_name,
@@ -594,11 +624,7 @@ void writer(usc_t *usc, int error, shell_t *sh) {
 
         LOG_MSG(LOG_LEVEL_WARN, "Repeat your command\n");
         fprintf(sh->output, PROMPT);
-        return;
     }
-
-    unix_socket_client_recv(usc, sizeof(pr_signature_t),
-                            (usc_reader_t)reader_signature, sh);
 }
 
 #define READ_ERROR_HANDLER                                                      \
@@ -608,6 +634,9 @@ do {
             strerror(errno));                                                   \
         LOG_MSG(LOG_LEVEL_WARN, "Reconnecting\n");                              \
                                                                                 \
+        drop_shm((shell_driver_t *)usc->priv);                                  \
+        forget_pending((shell_driver_t *)usc->priv);                            \
+                                                                                \
         if (!unix_socket_client_reconnect(usc))                                 \
             LOG(LOG_LEVEL_FATAL, "Can't reconnect to %*s: %s\n",                \
                 usc->connected_to_name_len, usc->connected_to_name,             \
@@ -649,7 +678,9 @@ void reader_info(usc_t *usc, int error, shell_t *sh) {
 
     sd = (shell_driver_t *)usc->priv;
     dci = (const pr_driver_command_info_t *)(di + 1);
-    vector_init(&sd->commands, sizeof(*sdc), di->commands_number);
+    vector_init_inline(&sd->commands, sizeof(*sdc),
+                       sd->commands_inline, SHELL_DRIVER_INLINE_COMMANDS);
+    vector_append_n(&sd->commands, di->commands_number);
     for (idx = 0; idx < di->commands_number; ++idx, ++dci) {
         sdc = (shell_driver_command_t *)vector_get(&sd->commands, idx);
 
@@ -659,15 +690,31 @@ void reader_info(usc_t *usc, int error, shell_t *sh) {
         sdc->descr[MAX_COMMAND_DESCRIPTION_LEN] = '\0';
         sdc->arity = dci->arity;
     }
+
+    if (sh->use_shm) {
+        pr_driver_shm_request_t req = {
+            .s.s = PR_DRV_SHM_REQUEST,
+            .ring_size = 0
+        };
+
+        unix_socket_client_send(usc, &req, sizeof(req),
+                                (usc_writer_t)writer, sh);
+    }
+
+    buffer_realloc(&usc->read_task.b, 0);
+    unix_socket_client_recv(usc, sizeof(pr_signature_t),
+                            (usc_reader_t)reader_signature, sh);
 }
 
 void reader_response(usc_t *usc, int error, shell_t *sh) {
     size_t required_length;
-    const pr_driver_response_t *dr = (const pr_driver_response_t *)usc->read_task.b.data;
+    response_t r;
 
     READ_ERROR_HANDLER;
 
-    required_length = sizeof(*dr) + dr->len;
+    /* header is complete, signature reader asked for it */
+    required_length = parse_response(usc->read_task.b.data,
+                                     usc->read_task.b.user_size, &r);
 
     if (usc->read_task.b.user_size < required_length) {
         usc->read_task.b.offset = usc->read_task.b.user_size;
@@ -680,8 +727,49 @@ void reader_response(usc_t *usc, int error, shell_t *sh) {
         return;
     }
 
-    fprintf(sh->output, "%.*s" NEW_LINE, dr->len, (const char *)(dr + 1));
-    finish_cmd(sh);
+    print_response((shell_driver_t *)usc->priv, &r);
+
+    /* more responses may follow right away */
+    buffer_realloc(&usc->read_task.b, 0);
+    unix_socket_client_recv(usc, sizeof(pr_signature_t),
+                            (usc_reader_t)reader_signature, sh);
+}
+
+void reader_shm_grant(usc_t *usc, int error, shell_t *sh) {
+    const pr_driver_shm_grant_t *g =
+        (const pr_driver_shm_grant_t *)usc->read_task.b.data;
+    shell_driver_t *sd = (shell_driver_t *)usc->priv;
+    size_t idx;
+
+    READ_ERROR_HANDLER;
+
+    if (g->ring_size && !sd->shm_active &&
+        usc->read_task.fds_number == SHM_CHANNEL_FDS) {
+        /* channel owns descriptors from now on */
+        usc->read_task.fds_number = 0;
+
+        if (shm_channel_attach(&sd->shm, sh->iosvc,
+                               usc->read_task.fds, g->ring_size)) {
+            sd->shm_active = true;
+            shm_channel_start(&sd->shm, (shm_channel_reader_t)shm_reader, sd);
+
+            LOG(LOG_LEVEL_DEBUG, "Shared memory with %.*s, ring size %u\n",
+                usc->connected_to_name_len, usc->connected_to_name,
+                (unsigned int)g->ring_size);
+        }
+    }
+    else
+        LOG(LOG_LEVEL_DEBUG, "No shared memory with %.*s, using socket\n",
+            usc->connected_to_name_len, usc->connected_to_name);
+
+    for (idx = 0; idx < usc->read_task.fds_number; ++idx)
+        close(usc->read_task.fds[idx]);
+
+    usc->read_task.fds_number = 0;
+
+    buffer_realloc(&usc->read_task.b, 0);
+    unix_socket_client_recv(usc, sizeof(pr_signature_t),
+                            (usc_reader_t)reader_signature, sh);
 }
 
 void reader_signature(usc_t *usc, int error, shell_t *sh) {
@@ -702,6 +790,17 @@ void reader_signature(usc_t *usc, int error, shell_t *sh) {
                                     sizeof(pr_driver_response_t) - sizeof(*s),
                                     (usc_reader_t)reader_response, sh);
             break;
+        case PR_DRV_RESPONSE_TAGGED:
+            unix_socket_client_recv(usc,
+                                    sizeof(pr_driver_response_tagged_t)
+                                        - sizeof(*s),
+                                    (usc_reader_t)reader_response, sh);
+            break;
+        case PR_DRV_SHM_GRANT:
+            unix_socket_client_recv(usc,
+                                    sizeof(pr_driver_shm_grant_t) - sizeof(*s),
+                                    (usc_reader_t)reader_shm_grant, sh);
+            break;
         case PR_DRV_COMMAND:
         default:
             LOG(LOG_LEVEL_WARN, "Invalid signature %#02x from %*s\n",
@@ -710,6 +809,9 @@ void reader_signature(usc_t *usc, int error, shell_t *sh) {
                 usc->connected_to_name);
             LOG_MSG(LOG_LEVEL_WARN, "Reconnecting\n");
 
+            drop_shm((shell_driver_t *)usc->priv);
+            forget_pending((shell_driver_t *)usc->priv);
+
             if (!unix_socket_client_reconnect(usc))
                 LOG(LOG_LEVEL_FATAL, "Can't reconnect to %*s: %s\n",
                     usc->connected_to_name_len, usc->connected_to_name,
@@ -720,9 +822,117 @@ void reader_signature(usc_t *usc, int error, shell_t *sh) {
 }
 #undef READ_ERROR_HANDLER
 
+ssize_t shm_reader(shm_channel_t *ch, const uint8_t *data, size_t len,
+                   shell_driver_t *sd) {
+    response_t r;
+    size_t frame_length;
+
+    if (PR_DRV_RESPONSE != data[0] && PR_DRV_RESPONSE_TAGGED != data[0]) {
+        LOG(LOG_LEVEL_WARN, "Invalid signature %#02x through shared memory "
+                            "from %.*s, falling back to socket\n",
+            (unsigned int)data[0],
+            sd->usc.connected_to_name_len, sd->usc.connected_to_name);
+        /* commands left in the ring won't be answered */
+        forget_pending(sd);
+        return -1;
+    }
+
+    frame_length = parse_response(data, len, &r);
+
+    if (!frame_length || len < frame_length)
+        return 0;
+
+    print_response(sd, &r);
+
+    return frame_length;
+}
+
+/*
+ * Parse response header.
+ * Return whole frame length or 0 if header is incomplete.
+ */
+size_t parse_response(const uint8_t *data, size_t len, response_t *r) {
+    const pr_driver_response_t *dr;
+    const pr_driver_response_tagged_t *drt;
+
+    if (PR_DRV_RESPONSE_TAGGED == data[0]) {
+        drt = (const pr_driver_response_tagged_t *)data;
+
+        if (len < sizeof(*drt))
+            return 0;
+
+        r->tagged = true;
+        r->id = drt->id;
+        r->len = drt->len;
+        r->text = (const char *)(drt + 1);
+
+        return sizeof(*drt) + drt->len;
+    }
+
+    dr = (const pr_driver_response_t *)data;
+
+    if (len < sizeof(*dr))
+        return 0;
+
+    r->tagged = false;
+    r->id = 0;
+    r->len = dr->len;
+    r->text = (const char *)(dr + 1);
+
+    return sizeof(*dr) + dr->len;
+}
+
+/* tagged response is matched with its command by request id */
+void print_response(shell_driver_t *sd, const response_t *r) {
+    avl_tree_node_t *atn;
+    const shell_driver_command_t *sdc;
+
+    if (!r->tagged) {
+        fprintf(sd->host->output, "%.*s" NEW_LINE, r->len, r->text);
+        finish_cmd(sd->host);
+        return;
+    }
+
+    atn = avl_tree_get(&sd->pending, r->id);
+
+    if (!atn) {
+        LOG(LOG_LEVEL_WARN, "Unexpected response #%u from %.*s\n",
+            (unsigned int)r->id,
+            sd->usc.connected_to_name_len, sd->usc.connected_to_name);
+        return;
+    }
+
+    sdc = (const shell_driver_command_t *)vector_get(
+        &sd->commands, ((const shell_request_t *)atn->data)->cmd_idx);
+
+    fprintf(sd->host->output, "%s.%u #%u %s: %.*s" NEW_LINE,
+            sd->name, sd->slot, (unsigned int)r->id, sdc->name,
+            r->len, r->text);
+    finish_cmd(sd->host);
+
+    avl_tree_remove(&sd->pending, r->id);
+}
+
+void forget_pending(shell_driver_t *sd) {
+    if (!sd->pending.count)
+        return;
+
+    LOG(LOG_LEVEL_WARN, "%zu commands to %s at slot %u left unanswered\n",
+        sd->pending.count, sd->name, sd->slot);
+
+    avl_tree_purge(&sd->pending);
+}
+
+void drop_shm(shell_driver_t *sd) {
+    if (!sd->shm_active)
+        return;
+
+    shm_channel_deinit(&sd->shm);
+    sd->shm_active = false;
+}
+
 void connector(usc_t *usc, shell_t *sh) {
     buffer_realloc(&usc->read_task.b, 0);
-    buffer_realloc(&usc->write_task.b, 0);
 
     unix_socket_client_recv(usc, sizeof(pr_signature_t),
                             (usc_reader_t)reader_signature, sh);
@@ -745,7 +955,9 @@ void purge_clients_list(avl_tree_node_t *atn) {
     for (le = list_begin(l); le; le = list_next(l, le)) {
         sd = (shell_driver_t *)le->data;
 
+        drop_shm(sd);
         unix_socket_client_deinit(&sd->usc);
+        avl_tree_purge(&sd->pending);
         free(sd->name);
     }
 
@@ -823,6 +1035,11 @@ void base_dir_smth_created(shell_t *sh, const char *name, size_t name_len) {
     }
 
     sd->usc.priv = sd;
+    sd->host = sh;
+    sd->shm_active = false;
+
+    avl_tree_init(&sd->pending, true, sizeof(shell_request_t));
+    sd->next_request_id = 0;
 
     sd->name_len = dd.driver_name_len;
     sd->name = (char *)malloc(dd.driver_name_len + 1);
@@ -886,7 +1103,9 @@ void base_dir_smth_deleted(shell_t *sh, const char *name, size_t name_len) {
         return;
     }
 
+    drop_shm(sd);
     unix_socket_client_deinit(&sd->usc);
+    avl_tree_purge(&sd->pending);
     free(sd->name);
 
     list_remove_and_advance(l, le);
@@ -1006,6 +1225,7 @@ bool shell_init(shell_t *sh,
     sh->base_path[sh->base_path_len] = '\0';
 
     sh->running = false;
+    sh->use_shm = true;
 
     buffer_init(&sh->input_buffer, 0, bp_non_shrinkable);
 
@@ -0,0 +1,513 @@
+#define _GNU_SOURCE
+
+#include "shm-channel.h"
+#include "log.h"
+
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+#define MEMFD_NAME      "supertel-shm"
+
+/* server reads ring 0 and writes ring 1 */
+#define RING_TO_SERVER  (0)
+#define RING_TO_CLIENT  (1)
+
+static
+void doorbell(int fd, io_svc_op_t op, shm_channel_t *ch);
+
+/**************** private ****************/
+static
+size_t round_ring_size(size_t sz) {
+    size_t r = SHM_CHANNEL_MIN_RING;
+
+    while (r < sz && r < SHM_CHANNEL_MAX_RING)
+        r <<= 1;
+
+    return r;
+}
+
+static inline
+shm_ring_header_t *ring_header(void *base, int idx) {
+    return (shm_ring_header_t *)base + idx;
+}
+
+static inline
+uint8_t *ring_data(void *base, size_t ring_size, int idx) {
+    return (uint8_t *)base + SHM_CHANNEL_HEADER_SIZE + idx * ring_size;
+}
+
+static
+bool map(shm_channel_t *ch, size_t ring_size, bool server) {
+    int rx_idx = server ? RING_TO_SERVER : RING_TO_CLIENT;
+    int tx_idx = server ? RING_TO_CLIENT : RING_TO_SERVER;
+
+    ch->map_size = SHM_CHANNEL_HEADER_SIZE + 2 * ring_size;
+    ch->base = mmap(NULL, ch->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    ch->memfd, 0);
+
+    if (MAP_FAILED == ch->base) {
+        ch->base = NULL;
+        return false;
+    }
+
+    ch->rx.hdr = ring_header(ch->base, rx_idx);
+    ch->rx.data = ring_data(ch->base, ring_size, rx_idx);
+    ch->rx.mask = ring_size - 1;
+
+    ch->tx.hdr = ring_header(ch->base, tx_idx);
+    ch->tx.data = ring_data(ch->base, ring_size, tx_idx);
+    ch->tx.mask = ring_size - 1;
+
+    return true;
+}
+
+static
+void init_common(shm_channel_t *ch, io_service_t *iosvc) {
+    memset(ch, 0, sizeof(*ch));
+
+    ch->iosvc = iosvc;
+    ch->memfd = ch->doorbell = ch->peer_doorbell = -1;
+
+    chain_buffer_init(&ch->pending, 0);
+    buffer_init(&ch->in, 0, bp_non_shrinkable);
+}
+
+static inline
+uint32_t ring_space(shm_ring_t *r) {
+    uint32_t tail = atomic_load_explicit(&r->hdr->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&r->hdr->head, memory_order_acquire);
+
+    /* head is written by peer, don't trust it to be behind tail */
+    if (tail - head > r->mask + 1)
+        return 0;
+
+    return r->mask + 1 - (tail - head);
+}
+
+static inline
+uint32_t ring_count(shm_ring_t *r) {
+    uint32_t head = atomic_load_explicit(&r->hdr->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&r->hdr->tail, memory_order_acquire);
+
+    return tail - head;
+}
+
+/* producer: copy as much as fits and publish it */
+static
+size_t ring_write(shm_ring_t *r, const void *d, size_t sz) {
+    uint32_t tail = atomic_load_explicit(&r->hdr->tail, memory_order_relaxed);
+    uint32_t space = ring_space(r);
+    uint32_t first;
+
+    if (sz > space)
+        sz = space;
+
+    if (!sz)
+        return 0;
+
+    first = r->mask + 1 - (tail & r->mask);
+
+    if (first > sz)
+        first = sz;
+
+    memcpy(r->data + (tail & r->mask), d, first);
+    memcpy(r->data, (const uint8_t *)d + first, sz - first);
+
+    atomic_store_explicit(&r->hdr->tail, tail + sz, memory_order_release);
+
+    return sz;
+}
+
+/* consumer: copy count bytes starting at head, head isn't moved */
+static
+void ring_peek(shm_ring_t *r, uint32_t head, void *dst, uint32_t count) {
+    uint32_t first = r->mask + 1 - (head & r->mask);
+
+    if (first > count)
+        first = count;
+
+    memcpy(dst, r->data + (head & r->mask), first);
+    memcpy((uint8_t *)dst + first, r->data, count - first);
+}
+
+/* wake peer if it sleeps waiting for data in tx */
+static
+void signal_reader(shm_channel_t *ch) {
+    /* either peer sees published tail or we see its flag */
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (!atomic_load_explicit(&ch->tx.hdr->reader_sleeping,
+                              memory_order_relaxed))
+        return;
+
+    if (atomic_exchange_explicit(&ch->tx.hdr->reader_sleeping, 0,
+                                 memory_order_acq_rel))
+        eventfd_write(ch->peer_doorbell, 1);
+}
+
+/* wake peer if it waits for space in rx */
+static
+void signal_writer(shm_channel_t *ch) {
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (!atomic_load_explicit(&ch->rx.hdr->writer_waiting,
+                              memory_order_relaxed))
+        return;
+
+    if (atomic_exchange_explicit(&ch->rx.hdr->writer_waiting, 0,
+                                 memory_order_acq_rel))
+        eventfd_write(ch->peer_doorbell, 1);
+}
+
+static
+void flush(shm_channel_t *ch) {
+    struct iovec iov[CHAIN_BUFFER_MAX_IOV];
+    size_t written, batch, w;
+    int cnt, idx;
+
+    for (;;) {
+        written = 0;
+
+        while (chain_buffer_length(&ch->pending)) {
+            cnt = chain_buffer_iovec(&ch->pending, iov, CHAIN_BUFFER_MAX_IOV);
+            batch = 0;
+
+            for (idx = 0; idx < cnt; ++idx) {
+                w = ring_write(&ch->tx, iov[idx].iov_base, iov[idx].iov_len);
+                batch += w;
+
+                if (w < iov[idx].iov_len)
+                    break;
+            }
+
+            if (!batch)
+                break;
+
+            chain_buffer_consume(&ch->pending, batch);
+            written += batch;
+        }
+
+        if (written)
+            signal_reader(ch);
+
+        if (!chain_buffer_length(&ch->pending))
+            return;
+
+        /* ring is full, peer rings the doorbell when it frees space */
+        atomic_store_explicit(&ch->tx.hdr->writer_waiting, 1,
+                              memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (!ring_space(&ch->tx))
+            return;
+
+        atomic_store_explicit(&ch->tx.hdr->writer_waiting, 0,
+                              memory_order_relaxed);
+    }
+}
+
+static
+ssize_t feed(shm_channel_t *ch, const uint8_t *data, size_t len) {
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < len && ch->running) {
+        n = ch->reader(ch, data + done, len - done, ch->ctx);
+
+        if (n < 0) {
+            shm_channel_stop(ch);
+            return -1;
+        }
+
+        if (!n)
+            break;
+
+        done += n;
+    }
+
+    return done;
+}
+
+static
+void drain(shm_channel_t *ch) {
+    uint32_t head, avail, first;
+    size_t old_size;
+    ssize_t n;
+
+    while (ch->running) {
+        head = atomic_load_explicit(&ch->rx.hdr->head, memory_order_relaxed);
+        avail = ring_count(&ch->rx);
+
+        if (!avail)
+            return;
+
+        /* tail is written by peer, more than a ring of data is a lie */
+        if (avail > ch->rx.mask + 1) {
+            LOG(LOG_LEVEL_WARN, "Peer published %u bytes into %u bytes ring, "
+                                "stopping shared memory channel\n",
+                (unsigned int)avail, (unsigned int)(ch->rx.mask + 1));
+            shm_channel_stop(ch);
+            return;
+        }
+
+        if (!ch->in.user_size) {
+            /* whole packets are parsed right within the ring */
+            first = ch->rx.mask + 1 - (head & ch->rx.mask);
+
+            if (first > avail)
+                first = avail;
+
+            n = feed(ch, ch->rx.data + (head & ch->rx.mask), first);
+
+            if (n < 0)
+                return;
+
+            head += n;
+            avail -= n;
+
+            /* the rest starts at ring beginning */
+            if (n == first) {
+                atomic_store_explicit(&ch->rx.hdr->head, head,
+                                      memory_order_release);
+                signal_writer(ch);
+                continue;
+            }
+        }
+
+        /* partial packet, collect it aside */
+        old_size = ch->in.user_size;
+        buffer_realloc(&ch->in, old_size + avail);
+        ring_peek(&ch->rx, head, (uint8_t *)ch->in.data + old_size, avail);
+        head += avail;
+
+        atomic_store_explicit(&ch->rx.hdr->head, head, memory_order_release);
+        signal_writer(ch);
+
+        n = feed(ch, ch->in.data, ch->in.user_size);
+
+        if (n < 0)
+            return;
+
+        memmove(ch->in.data, (uint8_t *)ch->in.data + n, ch->in.user_size - n);
+        buffer_realloc(&ch->in, ch->in.user_size - n);
+    }
+}
+
+void doorbell(int fd, io_svc_op_t op, shm_channel_t *ch) {
+    eventfd_t v;
+
+    eventfd_read(fd, &v);
+
+    flush(ch);
+
+    for (;;) {
+        drain(ch);
+
+        if (!ch->running)
+            return;
+
+        /* producer that published before the flag was raised
+         * doesn't ring, so check once more */
+        atomic_store_explicit(&ch->rx.hdr->reader_sleeping, 1,
+                              memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (!ring_count(&ch->rx))
+            break;
+
+        atomic_store_explicit(&ch->rx.hdr->reader_sleeping, 0,
+                              memory_order_relaxed);
+    }
+}
+
+/**************** API ****************/
+bool shm_channel_create(shm_channel_t *ch, io_service_t *iosvc,
+                        size_t ring_size) {
+    int idx;
+
+    assert(ch && iosvc);
+
+    init_common(ch, iosvc);
+
+    ring_size = round_ring_size(ring_size);
+
+    ch->memfd = memfd_create(MEMFD_NAME, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+    if (ch->memfd < 0)
+        goto fail;
+
+    if (ftruncate(ch->memfd, SHM_CHANNEL_HEADER_SIZE + 2 * ring_size))
+        goto fail;
+
+    /* client maps it as is, size may not change under it */
+    if (fcntl(ch->memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW))
+        goto fail;
+
+    ch->doorbell = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    ch->peer_doorbell = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if (ch->doorbell < 0 || ch->peer_doorbell < 0)
+        goto fail;
+
+    if (!map(ch, ring_size, true))
+        goto fail;
+
+    /* readers aren't running yet, first write has to ring */
+    for (idx = RING_TO_SERVER; idx <= RING_TO_CLIENT; ++idx)
+        atomic_store(&ring_header(ch->base, idx)->reader_sleeping, 1);
+
+    return true;
+
+fail:
+    LOG(LOG_LEVEL_WARN, "Can't create shared memory channel: %s\n",
+        strerror(errno));
+
+    shm_channel_deinit(ch);
+
+    return false;
+}
+
+bool shm_channel_attach(shm_channel_t *ch, io_service_t *iosvc,
+                        const int fds[SHM_CHANNEL_FDS], size_t ring_size) {
+    struct stat st;
+
+    assert(ch && iosvc && fds);
+
+    init_common(ch, iosvc);
+
+    ch->memfd = fds[0];
+    ch->peer_doorbell = fds[1];
+    ch->doorbell = fds[2];
+
+    /* size comes from peer, check it against the file */
+    if (ring_size < SHM_CHANNEL_MIN_RING || ring_size > SHM_CHANNEL_MAX_RING ||
+        (ring_size & (ring_size - 1))) {
+        LOG(LOG_LEVEL_WARN, "Invalid shared memory ring size: %zu\n",
+            ring_size);
+        goto fail;
+    }
+
+    if (fstat(ch->memfd, &st) ||
+        (size_t)st.st_size != SHM_CHANNEL_HEADER_SIZE + 2 * ring_size) {
+        LOG(LOG_LEVEL_WARN, "Shared memory size mismatch for ring %zu\n",
+            ring_size);
+        goto fail;
+    }
+
+    if (!map(ch, ring_size, false)) {
+        LOG(LOG_LEVEL_WARN, "Can't map shared memory: %s\n",
+            strerror(errno));
+        goto fail;
+    }
+
+    return true;
+
+fail:
+    shm_channel_deinit(ch);
+
+    return false;
+}
+
+void shm_channel_deinit(shm_channel_t *ch) {
+    assert(ch);
+
+    shm_channel_stop(ch);
+
+    if (ch->base)
+        munmap(ch->base, ch->map_size);
+
+    if (ch->memfd >= 0)
+        close(ch->memfd);
+
+    if (ch->doorbell >= 0)
+        close(ch->doorbell);
+
+    if (ch->peer_doorbell >= 0)
+        close(ch->peer_doorbell);
+
+    ch->base = NULL;
+    ch->memfd = ch->doorbell = ch->peer_doorbell = -1;
+
+    chain_buffer_deinit(&ch->pending);
+    buffer_deinit(&ch->in);
+    ch->in.data = NULL;
+}
+
+void shm_channel_fds(const shm_channel_t *ch, int fds[SHM_CHANNEL_FDS]) {
+    assert(ch && fds);
+
+    /* client's peer doorbell is ours and vice versa */
+    fds[0] = ch->memfd;
+    fds[1] = ch->doorbell;
+    fds[2] = ch->peer_doorbell;
+}
+
+size_t shm_channel_ring_size(const shm_channel_t *ch) {
+    assert(ch);
+
+    return (size_t)ch->rx.mask + 1;
+}
+
+void shm_channel_start(shm_channel_t *ch,
+                       shm_channel_reader_t reader, void *ctx) {
+    assert(ch && ch->base && reader);
+
+    ch->reader = reader;
+    ch->ctx = ctx;
+    ch->running = true;
+
+    io_service_post_job(ch->iosvc, ch->doorbell, IO_SVC_OP_READ,
+                        !IOSVC_JOB_ONESHOT,
+                        (iosvc_job_function_t)doorbell, ch);
+}
+
+void shm_channel_stop(shm_channel_t *ch) {
+    assert(ch);
+
+    if (!ch->running)
+        return;
+
+    ch->running = false;
+
+    io_service_remove_job(ch->iosvc, ch->doorbell, IO_SVC_OP_READ);
+}
+
+bool shm_channel_running(const shm_channel_t *ch) {
+    assert(ch);
+
+    return ch->running;
+}
+
+void shm_channel_send(shm_channel_t *ch, const void *d, size_t sz) {
+    size_t w = 0;
+
+    assert(ch && ch->base && (d || !sz));
+
+    /* keep order: nothing goes to the ring past pending data */
+    if (!chain_buffer_length(&ch->pending)) {
+        w = ring_write(&ch->tx, d, sz);
+
+        if (w)
+            signal_reader(ch);
+    }
+
+    if (w == sz)
+        return;
+
+    chain_buffer_append(&ch->pending, (const uint8_t *)d + w, sz - w);
+    flush(ch);
+}
+
+void shm_channel_send_chain(shm_channel_t *ch, chain_buffer_t *cb) {
+    assert(ch && ch->base && cb);
+
+    chain_buffer_append_chain(&ch->pending, cb);
+    flush(ch);
+}
@@ -23,6 +23,12 @@ void data_may_be_sent(int fd, io_svc_op_t op, usc_t *usc);
 static
 void data_may_be_read(int fd, io_svc_op_t op, usc_t *usc);
 
+static
+ssize_t receive(usc_t *usc, void *d, size_t sz);
+
+static
+void close_received_fds(usc_t *usc);
+
 static inline
 bool unix_socket_client_connect_(usc_t *usc,
                                  const char *name, size_t name_len,
@@ -40,17 +46,14 @@ void connector(int fd, io_svc_op_t op, usc_t *usc) {
 }
 
 void data_may_be_sent(int fd, io_svc_op_t op, usc_t *usc) {
-    size_t bytes_wrote = usc->write_task.currently_wrote;
-    size_t bytes_to_write = usc->write_task.b.user_size - bytes_wrote;
     ssize_t current_write;
     int err;
 
     errno = 0;
-    while (bytes_to_write) {
-        current_write = send(usc->fd,
-                             usc->write_task.b.data + bytes_wrote,
-                             bytes_to_write,
-                             MSG_DONTWAIT | MSG_NOSIGNAL);
+    while (chain_buffer_length(&usc->write_task.chain)) {
+        current_write = chain_buffer_sendmsg(usc->fd,
+                                             &usc->write_task.chain,
+                                             MSG_DONTWAIT | MSG_NOSIGNAL);
 
         if (current_write < 0) {
             if (errno == EINTR) {
@@ -60,16 +63,12 @@ void data_may_be_sent(int fd, io_svc_op_t op, usc_t *usc) {
             else
                 break;
         }
-
-        bytes_wrote += current_write;
-        bytes_to_write -= current_write;
     }
 
-    usc->write_task.currently_wrote = bytes_wrote;
-
     err = errno;
 
-    if (bytes_to_write && (errno == EAGAIN || errno == EWOULDBLOCK))
+    if (chain_buffer_length(&usc->write_task.chain) &&
+        (errno == EAGAIN || errno == EWOULDBLOCK))
         return;
 
     io_service_remove_job(usc->iosvc, fd, IO_SVC_OP_WRITE);
@@ -78,6 +77,59 @@ void data_may_be_sent(int fd, io_svc_op_t op, usc_t *usc) {
         usc->write_task.writer(usc, err, usc->write_task.ctx);
 }
 
+ssize_t receive(usc_t *usc, void *d, size_t sz) {
+    struct iovec iov = { .iov_base = d, .iov_len = sz };
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int) * USC_MAX_FDS)];
+    } control;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    const int *fds;
+    size_t fds_number, idx;
+    ssize_t rc;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    rc = recvmsg(usc->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL | MSG_CMSG_CLOEXEC);
+
+    if (rc <= 0)
+        return rc;
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        fds = (const int *)CMSG_DATA(cmsg);
+        fds_number = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+        for (idx = 0; idx < fds_number; ++idx) {
+            if (usc->read_task.fds_number < USC_MAX_FDS)
+                usc->read_task.fds[usc->read_task.fds_number++] = fds[idx];
+            else
+                close(fds[idx]);
+        }
+    }
+
+    if (msg.msg_flags & MSG_CTRUNC)
+        LOG_MSG(LOG_LEVEL_WARN, "Descriptors received were truncated\n");
+
+    return rc;
+}
+
+void close_received_fds(usc_t *usc) {
+    size_t idx;
+
+    for (idx = 0; idx < usc->read_task.fds_number; ++idx)
+        close(usc->read_task.fds[idx]);
+
+    usc->read_task.fds_number = 0;
+}
+
 void data_may_be_read(int fd, io_svc_op_t op, usc_t *usc) {
     size_t bytes_read = usc->read_task.currently_read;
     size_t bytes_to_read;
@@ -107,11 +159,10 @@ void data_may_be_read(int fd, io_svc_op_t op, usc_t *usc) {
 
     errno = 0;
     while (pending && !eof) {
-        current_read = recv(usc->fd,
-                            usc->read_task.b.data
-                                + usc->read_task.b.offset + bytes_read,
-                            pending,
-                            MSG_DONTWAIT | MSG_NOSIGNAL);
+        current_read = receive(usc,
+                               usc->read_task.b.data
+                                   + usc->read_task.b.offset + bytes_read,
+                               pending);
 
         if (current_read < 0) {
             if (errno == EINTR) {
@@ -221,6 +272,11 @@ void unix_socket_client_disconnect_(usc_t *usc, bool internal) {
 
     close(usc->fd);
 
+    /* queued data belongs to the closed connection */
+    chain_buffer_consume(&usc->write_task.chain,
+                         chain_buffer_length(&usc->write_task.chain));
+    close_received_fds(usc);
+
     if (!internal) {
         free(usc->connected_to_name);
         usc->connected_to_name = NULL;
@@ -250,7 +306,7 @@ bool unix_socket_client_init(usc_t *usc,
     usc->connected = false;
 
     buffer_init(&usc->read_task.b, 0, bp_non_shrinkable);
-    buffer_init(&usc->write_task.b, 0, bp_non_shrinkable);
+    chain_buffer_init(&usc->write_task.chain, 0);
 
     if (name_len) {
         usc->name = (char *)malloc(name_len);
@@ -266,6 +322,9 @@ void unix_socket_client_deinit(usc_t *usc) {
 
     unix_socket_client_disconnect(usc);
 
+    buffer_deinit(&usc->read_task.b);
+    chain_buffer_deinit(&usc->write_task.chain);
+
     unlink(usc->name);
     free(usc->name);
 }
@@ -290,9 +349,23 @@ void unix_socket_client_send(usc_t *usc,
                              usc_writer_t writer, void *ctx) {
     assert(usc);
 
-    usc->write_task.currently_wrote = 0;
-    buffer_realloc(&usc->write_task.b, sz);
-    memcpy(usc->write_task.b.data, d, sz);
+    chain_buffer_append(&usc->write_task.chain, d, sz);
+    usc->write_task.writer = writer;
+    usc->write_task.ctx = ctx;
+
+    io_service_post_job(
+        usc->iosvc, usc->fd, IO_SVC_OP_WRITE, !IOSVC_JOB_ONESHOT,
+        (iosvc_job_function_t)data_may_be_sent,
+        usc
+    );
+}
+
+void unix_socket_client_send_chain(usc_t *usc,
+                                   chain_buffer_t *cb,
+                                   usc_writer_t writer, void *ctx) {
+    assert(usc && cb);
+
+    chain_buffer_append_chain(&usc->write_task.chain, cb);
     usc->write_task.writer = writer;
     usc->write_task.ctx = ctx;
 
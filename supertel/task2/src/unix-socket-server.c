@@ -10,7 +10,6 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/un.h>
-#include <sys/ioctl.h>
 
 #define BACKLOG 50
 
@@ -22,8 +21,14 @@ static
 void acceptor(int fd, io_svc_op_t op, uss_t *srv);
 static
 void data_may_be_sent(int fd, io_svc_op_t op, uss_connection_t *ussc);
+
 static
 void data_may_be_read(int fd, io_svc_op_t op, uss_connection_t *ussc);
+static
+bool feed(uss_connection_t *ussc);
+
+static
+ssize_t send_with_fds(uss_connection_t *ussc);
 
 void close_connections(avl_tree_node_t *atn) {
     if (!atn)
@@ -39,8 +44,9 @@ void close_connection(uss_connection_t *ussc) {
     io_service_remove_job(ussc->host->iosvc, ussc->fd, IO_SVC_OP_READ);
     io_service_remove_job(ussc->host->iosvc, ussc->fd, IO_SVC_OP_WRITE);
 
-    buffer_deinit(&ussc->read_task.b);
-    buffer_deinit(&ussc->write_task.b);
+    chain_buffer_deinit(&ussc->read_task.chain);
+    buffer_deinit(&ussc->read_task.frame);
+    chain_buffer_deinit(&ussc->write_task.chain);
 
     shutdown(ussc->fd, SHUT_RDWR);
     close(ussc->fd);
@@ -51,7 +57,7 @@ void acceptor(int fd, io_svc_op_t op, uss_t *srv) {
     avl_tree_node_t *atn;
     uss_connection_t *ussc;
     struct sockaddr_un addr;
-    socklen_t addr_len;
+    socklen_t addr_len = sizeof(addr);
 
     fd = accept(srv->fd, (struct sockaddr *)&addr, &addr_len);
 
@@ -70,26 +76,63 @@ void acceptor(int fd, io_svc_op_t op, uss_t *srv) {
     ussc->host = srv;
     ussc->fd = fd;
     ussc->eof = false;
-    buffer_init(&ussc->read_task.b, 0, bp_non_shrinkable);
-    buffer_init(&ussc->write_task.b, 0, bp_non_shrinkable);
+    chain_buffer_init(&ussc->read_task.chain, USS_READ_CHUNK);
+    buffer_init(&ussc->read_task.frame, 0, bp_non_shrinkable);
+    chain_buffer_init(&ussc->write_task.chain, 0);
 
     if (srv->acceptor &&
         !srv->acceptor(srv, ussc, srv->acceptor_ctx))
         unix_socket_server_close_connection(srv, ussc);
 }
 
+ssize_t send_with_fds(uss_connection_t *ussc) {
+    struct iovec iov[CHAIN_BUFFER_MAX_IOV];
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int) * USS_MAX_FDS)];
+    } control;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    size_t fds_size = sizeof(int) * ussc->write_task.fds_number;
+    ssize_t rc;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = chain_buffer_iovec(&ussc->write_task.chain,
+                                        iov, CHAIN_BUFFER_MAX_IOV);
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(fds_size);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fds_size);
+    memcpy(CMSG_DATA(cmsg), ussc->write_task.fds, fds_size);
+
+    rc = sendmsg(ussc->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    if (rc < 0)
+        return rc;
+
+    /* descriptors went along with the first byte */
+    ussc->write_task.fds_number = 0;
+    chain_buffer_consume(&ussc->write_task.chain, rc);
+
+    return rc;
+}
+
 void data_may_be_sent(int fd, io_svc_op_t op, uss_connection_t *ussc) {
-    size_t bytes_wrote = ussc->write_task.currently_wrote;
-    size_t bytes_to_write = ussc->write_task.b.user_size - bytes_wrote;
     ssize_t current_write;
     int err;
 
     errno = 0;
-    while (bytes_to_write) {
-        current_write = send(ussc->fd,
-                             ussc->write_task.b.data + bytes_wrote,
-                             bytes_to_write,
-                             MSG_DONTWAIT | MSG_NOSIGNAL);
+    while (chain_buffer_length(&ussc->write_task.chain)) {
+        if (ussc->write_task.fds_number)
+            current_write = send_with_fds(ussc);
+        else
+            current_write = chain_buffer_sendmsg(ussc->fd,
+                                                 &ussc->write_task.chain,
+                                                 MSG_DONTWAIT | MSG_NOSIGNAL);
 
         if (current_write < 0) {
             if (errno == EINTR) {
@@ -99,16 +142,12 @@ void data_may_be_sent(int fd, io_svc_op_t op, uss_connection_t *ussc) {
             else
                 break;
         }
-
-        bytes_wrote += current_write;
-        bytes_to_write -= current_write;
     }
 
-    ussc->write_task.currently_wrote = bytes_wrote;
-
     err = errno;
 
-    if (bytes_to_write && (errno == EAGAIN || errno == EWOULDBLOCK))
+    if (chain_buffer_length(&ussc->write_task.chain) &&
+        (errno == EAGAIN || errno == EWOULDBLOCK))
         return;
 
     io_service_remove_job(ussc->host->iosvc, fd, IO_SVC_OP_WRITE);
@@ -117,78 +156,82 @@ void data_may_be_sent(int fd, io_svc_op_t op, uss_connection_t *ussc) {
         ussc->write_task.writer(ussc->host, ussc, err, ussc->write_task.ctx);
 }
 
-void data_may_be_read(int fd, io_svc_op_t op, uss_connection_t *ussc) {
-    size_t bytes_read = ussc->read_task.currently_read;
-    size_t bytes_to_read;
-    ssize_t current_read;
-    bool eof = false;
-    int err = 0;
-    int pending, rc;
+bool feed(uss_connection_t *ussc) {
+    chain_buffer_t *chain = &ussc->read_task.chain;
+    buffer_t *frame = &ussc->read_task.frame;
+    struct iovec front;
+    size_t len;
+    ssize_t n;
 
-    bytes_to_read = ussc->read_task.b.user_size -ussc->read_task.b.offset
-                    - bytes_read;
+    while ((len = chain_buffer_length(chain))) {
+        chain_buffer_iovec(chain, &front, 1);
 
-    rc = ioctl(fd, FIONREAD, &pending);
+        n = ussc->read_task.reader(ussc->host, ussc,
+                                   front.iov_base, front.iov_len,
+                                   ussc->read_task.ctx);
 
-    if (0 == pending) /* EOF */ {
-        ussc->eof = true;
+        /* frame spans slices, gather it */
+        if (!n && front.iov_len < len) {
+            buffer_realloc(frame, len);
+            chain_buffer_copy_out(chain, 0, frame->data, len);
 
-        io_service_remove_job(ussc->host->iosvc, fd, IO_SVC_OP_READ);
+            n = ussc->read_task.reader(ussc->host, ussc,
+                                       frame->data, len,
+                                       ussc->read_task.ctx);
+        }
 
-        if (ussc->read_task.reader)
-            ussc->read_task.reader(ussc->host, ussc, err, ussc->read_task.ctx);
+        if (n < 0)
+            return false;
 
-        return;
-    }
+        if (!n)
+            break;
 
-    if (pending > bytes_to_read)
-        pending = bytes_to_read;
+        chain_buffer_consume(chain, n);
+    }
 
-    errno = 0;
-    while (bytes_to_read && !eof) {
-        current_read = recv(ussc->fd,
-                            ussc->read_task.b.data
-                                + ussc->read_task.b.offset + bytes_read,
-                            bytes_to_read,
-                            MSG_DONTWAIT | MSG_NOSIGNAL);
-
-        if (current_read < 0) {
-            if (errno == EINTR) {
-                errno = 0;
-                continue;
-            }
-            else
-                break;
-        }
+    return true;
+}
 
-        if (current_read == 0) /* EOF */
-            eof = true;
+void data_may_be_read(int fd, io_svc_op_t op, uss_connection_t *ussc) {
+    ssize_t rc;
+    int err = 0;
 
-        bytes_read += current_read;
-        bytes_to_read -= current_read;
-    }
+    for (;;) {
+        rc = chain_buffer_readv(fd, &ussc->read_task.chain, USS_READ_CHUNK);
 
-    ussc->read_task.currently_read = bytes_read;
+        if (rc < 0 && errno == EINTR)
+            continue;
 
-    err = errno;
+        if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
 
-    ussc->eof = eof;
-    if (eof) {
-        io_service_remove_job(ussc->host->iosvc, fd, IO_SVC_OP_READ);
+        if (rc <= 0) {
+            ussc->eof = !rc;
+            err = rc ? errno : 0;
+            goto closed;
+        }
 
-        if (ussc->read_task.reader)
-            ussc->read_task.reader(ussc->host, ussc, err, ussc->read_task.ctx);
+        if (!feed(ussc)) {
+            err = EPROTO;
+            goto closed;
+        }
 
-        return;
+        /* short read drained the socket, spare a call ending with EAGAIN */
+        if (rc < USS_READ_CHUNK)
+            break;
     }
 
-    if (bytes_to_read && (errno == EAGAIN || errno == EWOULDBLOCK))
-        return;
+    /* whatever reader sent for the chunk goes at once */
+    if (chain_buffer_length(&ussc->write_task.chain))
+        data_may_be_sent(fd, IO_SVC_OP_WRITE, ussc);
+
+    return;
 
+closed:
     io_service_remove_job(ussc->host->iosvc, fd, IO_SVC_OP_READ);
 
-    if (ussc->read_task.reader)
-        ussc->read_task.reader(ussc->host, ussc, err, ussc->read_task.ctx);
+    if (ussc->read_task.closed)
+        ussc->read_task.closed(ussc->host, ussc, err, ussc->read_task.ctx);
 }
 
 /******************* API *******************/
@@ -252,30 +295,69 @@ void unix_socket_server_close_connection(uss_t *srv, uss_connection_t *conn) {
 void unix_socket_server_send(uss_t *srv, uss_connection_t *conn,
                              const void *d, size_t sz,
                              uss_writer_t writer, void *ctx) {
+    bool idle;
+
     assert(srv && conn);
 
-    conn->write_task.currently_wrote = 0;
-    buffer_realloc(&conn->write_task.b, sz);
-    memcpy(conn->write_task.b.data, d, sz);
+    /* job stays posted while there is queued data */
+    idle = !chain_buffer_length(&conn->write_task.chain);
+
+    chain_buffer_append(&conn->write_task.chain, d, sz);
     conn->write_task.writer = writer;
     conn->write_task.ctx = ctx;
 
-    io_service_post_job(
-        srv->iosvc, conn->fd, IO_SVC_OP_WRITE, !IOSVC_JOB_ONESHOT,
-        (iosvc_job_function_t)data_may_be_sent,
-        conn
-    );
+    if (idle)
+        io_service_post_job(
+            srv->iosvc, conn->fd, IO_SVC_OP_WRITE, !IOSVC_JOB_ONESHOT,
+            (iosvc_job_function_t)data_may_be_sent,
+            conn
+        );
 }
 
-void unix_socket_server_recv(uss_t *srv, uss_connection_t *conn,
-                             size_t sz,
-                             uss_reader_t reader, void *ctx) {
-    assert(srv && conn);
+void unix_socket_server_send_chain(uss_t *srv, uss_connection_t *conn,
+                                   chain_buffer_t *cb,
+                                   uss_writer_t writer, void *ctx) {
+    bool idle;
+
+    assert(srv && conn && cb);
+
+    idle = !chain_buffer_length(&conn->write_task.chain);
+
+    chain_buffer_append_chain(&conn->write_task.chain, cb);
+    conn->write_task.writer = writer;
+    conn->write_task.ctx = ctx;
+
+    if (idle)
+        io_service_post_job(
+            srv->iosvc, conn->fd, IO_SVC_OP_WRITE, !IOSVC_JOB_ONESHOT,
+            (iosvc_job_function_t)data_may_be_sent,
+            conn
+        );
+}
+
+void unix_socket_server_send_fds(uss_t *srv, uss_connection_t *conn,
+                                 const void *d, size_t sz,
+                                 const int *fds, size_t fds_number,
+                                 uss_writer_t writer, void *ctx) {
+    assert(srv && conn && sz && fds_number <= USS_MAX_FDS);
+
+    /* descriptors must accompany data of this call only */
+    assert(!chain_buffer_length(&conn->write_task.chain));
+
+    memcpy(conn->write_task.fds, fds, sizeof(int) * fds_number);
+    conn->write_task.fds_number = fds_number;
+
+    unix_socket_server_send(srv, conn, d, sz, writer, ctx);
+}
+
+void unix_socket_server_recv_stream(uss_t *srv, uss_connection_t *conn,
+                                    uss_stream_reader_t reader,
+                                    uss_closed_t closed,
+                                    void *ctx) {
+    assert(srv && conn && reader);
 
-    conn->read_task.currently_read = 0;
-    conn->read_task.b.offset = conn->read_task.b.user_size;
-    buffer_realloc(&conn->read_task.b, conn->read_task.b.offset + sz);
     conn->read_task.reader = reader;
+    conn->read_task.closed = closed;
     conn->read_task.ctx = ctx;
 
     io_service_post_job(